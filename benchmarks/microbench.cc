@@ -0,0 +1,223 @@
+#include "socket/channel.h"
+#include "socket/event_loop.h"
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <new>
+#include <span>
+#include <thread>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <infiniband/verbs.h>
+
+#include <rdmapp/rdmapp.h>
+
+#include <rdmapp/detail/blocking_queue.h>
+
+/*
+ * Microbenchmarks of the software on the data path, runnable on machines
+ * without an RDMA device. Each benchmark reports ns/op and, through the
+ * replaced global allocator, heap allocations per operation.
+ */
+
+static std::atomic<uint64_t> gAllocations = 0;
+
+void *operator new(std::size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+/*
+ * Counts the allocations made while the benchmark loop runs.
+ */
+class allocation_counter {
+  benchmark::State &state_;
+  uint64_t start_;
+
+public:
+  explicit allocation_counter(benchmark::State &state)
+      : state_(state), start_(gAllocations.load()) {}
+  ~allocation_counter() {
+    state_.counters["allocs/op"] = benchmark::Counter(
+        static_cast<double>(gAllocations.load() - start_),
+        benchmark::Counter::kAvgIterations);
+  }
+};
+
+static void BM_CallbackMakeDestroy(benchmark::State &state) {
+  allocation_counter counter(state);
+  int dummy = 0;
+  for (auto _ : state) {
+    auto cb = rdmapp::executor::make_callback(
+        [&dummy](struct ibv_wc const &wc) { dummy += wc.byte_len; });
+    benchmark::DoNotOptimize(cb);
+    rdmapp::executor::destroy_callback(cb);
+  }
+}
+BENCHMARK(BM_CallbackMakeDestroy);
+
+static void BM_BlockingQueuePushPop(benchmark::State &state) {
+  rdmapp::detail::blocking_queue<struct ibv_wc> queue;
+  struct ibv_wc wc = {};
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    queue.push(wc);
+    benchmark::DoNotOptimize(queue.pop());
+  }
+}
+BENCHMARK(BM_BlockingQueuePushPop);
+
+/*
+ * The path of a completion from the poller to its callback: the work
+ * completion is queued to an executor worker, which runs and frees the
+ * callback.
+ */
+static void BM_ExecutorDispatch(benchmark::State &state) {
+  rdmapp::executor executor(state.range(0));
+  std::atomic<bool> done = false;
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    struct ibv_wc wc = {};
+    wc.wr_id = reinterpret_cast<uint64_t>(rdmapp::executor::make_callback(
+        [&done](struct ibv_wc const &) {
+          done.store(true, std::memory_order_release);
+        }));
+    executor.process_wc(wc);
+    while (!done.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    done.store(false, std::memory_order_relaxed);
+  }
+}
+BENCHMARK(BM_ExecutorDispatch)->Arg(1)->Arg(4)->UseRealTime();
+
+static rdmapp::task<int> ready_task() { co_return 42; }
+
+static void BM_TaskFuture(benchmark::State &state) {
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    auto task = ready_task();
+    benchmark::DoNotOptimize(task.get_future().get());
+  }
+}
+BENCHMARK(BM_TaskFuture);
+
+static rdmapp::lazy_task<int> ready_lazy_task() { co_return 42; }
+
+static rdmapp::lazy_task<void> await_lazy_tasks(benchmark::State &state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(co_await ready_lazy_task());
+  }
+}
+
+static void BM_LazyTaskAwait(benchmark::State &state) {
+  allocation_counter counter(state);
+  rdmapp::sync_wait(await_lazy_tasks(state));
+}
+BENCHMARK(BM_LazyTaskAwait);
+
+static void BM_LazyTaskSyncWait(benchmark::State &state) {
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(rdmapp::sync_wait(ready_lazy_task()));
+  }
+}
+BENCHMARK(BM_LazyTaskSyncWait);
+
+/*
+ * The handshake record a Queue Pair sends and its parse on the peer. It needs
+ * a device, e.g. the mock verbs backend, and is skipped without one.
+ */
+static void BM_HandshakeSerdes(benchmark::State &state) {
+  using header = rdmapp::deserialized_qp::qp_header;
+  std::shared_ptr<rdmapp::device> device;
+  std::shared_ptr<rdmapp::pd> pd;
+  std::shared_ptr<rdmapp::cq> cq;
+  std::shared_ptr<rdmapp::qp> qp;
+  try {
+    device = std::make_shared<rdmapp::device>(0, 1);
+    pd = std::make_shared<rdmapp::pd>(device);
+    cq = std::make_shared<rdmapp::cq>(device);
+    qp = std::make_shared<rdmapp::qp>(pd, cq);
+  } catch (std::exception &e) {
+    state.SkipWithError(e.what());
+    return;
+  }
+  std::array<uint8_t, rdmapp::qp::kSerializedHeaderSize> buffer;
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    qp->serialize_header(
+        std::span<uint8_t, rdmapp::qp::kSerializedHeaderSize>(buffer));
+    auto remote = rdmapp::deserialized_qp::deserialize(
+        std::span<uint8_t const, header::kSerializedSize>(
+            buffer.data(), header::kSerializedSize));
+    remote.capabilities = rdmapp::qp_capabilities::deserialize(
+        buffer.cbegin() + header::kSerializedSize);
+    benchmark::DoNotOptimize(remote);
+  }
+}
+BENCHMARK(BM_HandshakeSerdes);
+
+static void BM_RemoteMrSerdes(benchmark::State &state) {
+  constexpr size_t kSize = rdmapp::remote_mr::kSerializedSize;
+  rdmapp::remote_mr mr(reinterpret_cast<void *>(0x1000), 4096, 7);
+  std::array<uint8_t, kSize> buffer;
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    mr.serialize(std::span<uint8_t, kSize>(buffer));
+    auto copy =
+        rdmapp::remote_mr::deserialize(std::span<uint8_t const, kSize>(buffer));
+    benchmark::DoNotOptimize(copy);
+  }
+}
+BENCHMARK(BM_RemoteMrSerdes);
+
+/*
+ * One readiness round trip through the event loop: the channel is registered,
+ * becomes readable, and its callback runs on the loop thread.
+ */
+static void BM_EventLoopReadable(benchmark::State &state) {
+  int fds[2];
+  if (::pipe(fds) != 0) {
+    state.SkipWithError("failed to create pipe");
+    return;
+  }
+  auto loop = rdmapp::socket::event_loop::new_loop();
+  auto looper = std::thread([loop]() { loop->loop(); });
+  auto channel = std::make_shared<rdmapp::socket::channel>(fds[0], loop);
+  std::atomic<bool> done = false;
+  channel->set_readable_callback([&]() {
+    char byte;
+    benchmark::DoNotOptimize(::read(fds[0], &byte, 1));
+    done.store(true, std::memory_order_release);
+  });
+  allocation_counter counter(state);
+  for (auto _ : state) {
+    channel->wait_readable();
+    char byte = 0;
+    benchmark::DoNotOptimize(::write(fds[1], &byte, 1));
+    while (!done.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    done.store(false, std::memory_order_relaxed);
+  }
+  loop->close();
+  looper.join();
+  channel.reset();
+  ::close(fds[1]);
+}
+BENCHMARK(BM_EventLoopReadable)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,17 @@
+find_path(RDMACM_INCLUDE_DIRS
+  NAMES rdma/rdma_cma.h
+  HINTS
+  ${RDMACM_INCLUDE_DIR}
+  ${RDMACM_ROOT_DIR}
+  ${RDMACM_ROOT_DIR}/include)
+
+find_library(RDMACM_LIBRARIES
+  NAMES rdmacm
+  HINTS
+  ${RDMACM_LIB_DIR}
+  ${RDMACM_ROOT_DIR}
+  ${RDMACM_ROOT_DIR}/lib)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(rdmacm DEFAULT_MSG RDMACM_INCLUDE_DIRS RDMACM_LIBRARIES)
+mark_as_advanced(RDMACM_INCLUDE_DIR RDMACM_LIBRARIES)
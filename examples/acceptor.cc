@@ -12,6 +12,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <strings.h>
+#include <utility>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -46,20 +47,62 @@ acceptor::acceptor(std::shared_ptr<socket::event_loop> loop,
                    std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
                    std::shared_ptr<cq> send_cq, std::shared_ptr<srq> srq)
     : listener_(std::make_unique<socket::tcp_listener>(loop, hostname, port)),
-      pd_(pd), recv_cq_(recv_cq), send_cq_(send_cq), srq_(srq) {}
+      pd_(pd), recv_cq_(recv_cq), send_cq_(send_cq), srq_(srq),
+      max_qps_(kDefaultMaxQps) {}
+
+void acceptor::set_qp_pool(std::shared_ptr<qp_pool> pool) {
+  qp_pool_ = pool;
+  qp_pool_->reserve(pd_, recv_cq_, send_cq_, srq_);
+}
+
+void acceptor::set_max_qps(uint32_t max_qps) { max_qps_ = max_qps; }
+
+std::shared_ptr<qp> acceptor::new_qp() {
+  if (qp_pool_) {
+    return qp_pool_->acquire(pd_, recv_cq_, send_cq_, srq_);
+  }
+  return std::make_shared<qp>(pd_, recv_cq_, send_cq_, srq_);
+}
 
 task<std::shared_ptr<qp>> acceptor::accept() {
   auto channel = co_await listener_->accept();
   auto connection = socket::tcp_connection(channel);
   auto remote_qp = co_await recv_qp(connection);
-  auto local_qp = std::make_shared<qp>(
-      remote_qp.header.lid, remote_qp.header.qp_num, remote_qp.header.sq_psn,
-      remote_qp.header.gid, pd_, recv_cq_, send_cq_);
+  auto local_qp = new_qp();
+  local_qp->negotiate(remote_qp.capabilities);
+  local_qp->rtr(remote_qp.header.lid, remote_qp.header.qp_num,
+                remote_qp.header.sq_psn, remote_qp.header.gid);
+  local_qp->rts();
   local_qp->user_data() = std::move(remote_qp.user_data);
   co_await send_qp(*local_qp, connection);
   co_return local_qp;
 }
 
+task<std::vector<std::shared_ptr<qp>>> acceptor::accept_many() {
+  auto channel = co_await listener_->accept();
+  auto connection = socket::tcp_connection(channel);
+  auto remote_qps = co_await recv_qps(connection, max_qps_);
+  std::vector<std::shared_ptr<qp>> local_qps(remote_qps.size());
+  co_await offload([&]() {
+    parallel_for(remote_qps.size(), [&](size_t i) {
+      auto &remote_qp = remote_qps[i];
+      local_qps[i] = new_qp();
+      local_qps[i]->negotiate(remote_qp.capabilities);
+      local_qps[i]->rtr(remote_qp.header.lid, remote_qp.header.qp_num,
+                        remote_qp.header.sq_psn, remote_qp.header.gid);
+      local_qps[i]->rts();
+      local_qps[i]->user_data() = std::move(remote_qp.user_data);
+    });
+  });
+  co_await send_qps(local_qps, connection);
+  co_return local_qps;
+}
+
+task<std::shared_ptr<striped_qp>> acceptor::accept_striped() {
+  auto qps = co_await accept_many();
+  co_return std::make_shared<striped_qp>(std::move(qps));
+}
+
 acceptor::~acceptor() {}
 
 } // namespace rdmapp
@@ -0,0 +1,108 @@
+#include "cm_acceptor.h"
+
+#include "cm_event_channel.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <rdma/rdma_cma.h>
+
+#include <rdmapp/error.h>
+#include <rdmapp/qp.h>
+
+#include <rdmapp/detail/debug.h>
+
+namespace rdmapp {
+
+cm_acceptor::cm_acceptor(std::shared_ptr<socket::event_loop> loop,
+                         std::string const &hostname, uint16_t port,
+                         std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+                         std::shared_ptr<cq> send_cq, std::shared_ptr<srq> srq,
+                         std::vector<uint8_t> user_data)
+    : loop_(loop), listen_channel_(std::make_unique<cm_event_channel>(loop)),
+      pd_(pd), recv_cq_(recv_cq), send_cq_(send_cq), srq_(srq),
+      user_data_(std::move(user_data)),
+      connections_(std::make_shared<cm_connection_set>()) {
+  struct rdma_cm_id *id = nullptr;
+  check_errno(::rdma_create_id(listen_channel_->channel(), &id, nullptr,
+                            RDMA_PS_TCP),
+           "failed to create cm id");
+  listen_id_.reset(id);
+
+  struct addrinfo hints, *servinfo;
+  ::bzero(&hints, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  auto const port_str = std::to_string(port);
+  if (auto rc = ::getaddrinfo(hostname.empty() ? nullptr : hostname.c_str(),
+                              port_str.c_str(), &hints, &servinfo);
+      rc != 0) {
+    throw_with("getaddrinfo: %s", ::gai_strerror(rc));
+  }
+  auto rc = ::rdma_bind_addr(listen_id_.get(), servinfo->ai_addr);
+  ::freeaddrinfo(servinfo);
+  check_errno(rc, "failed to bind cm id");
+  check_errno(::rdma_listen(listen_id_.get(), 128), "failed to listen");
+  RDMAPP_LOG_DEBUG("cm acceptor listening on %d", port);
+}
+
+cm_acceptor::cm_acceptor(std::shared_ptr<socket::event_loop> loop,
+                         uint16_t port, std::shared_ptr<pd> pd,
+                         std::shared_ptr<cq> cq, std::shared_ptr<srq> srq)
+    : cm_acceptor(loop, "", port, pd, cq, cq, srq) {}
+
+task<std::shared_ptr<qp>> cm_acceptor::accept() {
+  // Every connection gets its own event channel, so that waiting for it to be
+  // established does not consume requests of other connections. It is
+  // declared first as it has to outlive the id.
+  auto channel = std::make_unique<cm_event_channel>(loop_);
+  auto request =
+      co_await listen_channel_->expect(RDMA_CM_EVENT_CONNECT_REQUEST);
+  cm_id_ptr id(request->id);
+  auto const remote_param = request->param.conn;
+  auto remote_user_data = decode_cm_private_data(remote_param);
+  // The request has to be acknowledged before its id can be migrated.
+  request.reset();
+  check_errno(::rdma_migrate_id(id.get(), channel->channel()),
+              "failed to migrate cm id");
+
+  std::shared_ptr<qp> qp_ptr;
+  try {
+    check_cm_device(id.get(), *pd_->device_ptr());
+    qp_ptr = std::make_shared<qp>(pd_, recv_cq_, send_cq_, srq_);
+    qp_ptr->user_data() = std::move(remote_user_data);
+    cm_transition_to_rts(id.get(), *qp_ptr);
+    auto private_data = encode_cm_private_data(user_data_, kMaxUserDataSize);
+    struct rdma_conn_param param = {};
+    param.private_data = private_data.data();
+    param.private_data_len = private_data.size();
+    param.responder_resources =
+        std::min(remote_param.initiator_depth, kCmMaxRdAtomic);
+    param.initiator_depth =
+        std::min(remote_param.responder_resources, kCmMaxRdAtomic);
+    param.rnr_retry_count = 7;
+    param.qp_num = qp_ptr->qp_num();
+    check_errno(::rdma_accept(id.get(), &param), "failed to accept");
+  } catch (std::runtime_error &e) {
+    RDMAPP_LOG_ERROR("%s", e.what());
+    ::rdma_reject(id.get(), nullptr, 0);
+    throw;
+  }
+  co_await channel->expect(RDMA_CM_EVENT_ESTABLISHED);
+  RDMAPP_LOG_DEBUG("cm connection established qpn=%u", qp_ptr->qp_num());
+  connections_->add(std::move(channel), std::move(id));
+  co_return qp_ptr;
+}
+
+cm_acceptor::~cm_acceptor() {}
+
+} // namespace rdmapp
@@ -0,0 +1,92 @@
+#include "cm_connector.h"
+
+#include "cm_event_channel.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <netdb.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <rdma/rdma_cma.h>
+
+#include <rdmapp/error.h>
+#include <rdmapp/qp.h>
+
+#include <rdmapp/detail/debug.h>
+
+namespace rdmapp {
+
+cm_connector::cm_connector(std::shared_ptr<socket::event_loop> loop,
+                           std::string const &hostname, uint16_t port,
+                           std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+                           std::shared_ptr<cq> send_cq,
+                           std::shared_ptr<srq> srq,
+                           std::vector<uint8_t> user_data)
+    : loop_(loop), pd_(pd), recv_cq_(recv_cq), send_cq_(send_cq), srq_(srq),
+      hostname_(hostname), port_(port), user_data_(std::move(user_data)),
+      connections_(std::make_shared<cm_connection_set>()) {}
+
+cm_connector::cm_connector(std::shared_ptr<socket::event_loop> loop,
+                           std::string const &hostname, uint16_t port,
+                           std::shared_ptr<pd> pd, std::shared_ptr<cq> cq,
+                           std::shared_ptr<srq> srq)
+    : cm_connector(loop, hostname, port, pd, cq, cq, srq) {}
+
+task<std::shared_ptr<qp>> cm_connector::connect() {
+  auto channel = std::make_unique<cm_event_channel>(loop_);
+  struct rdma_cm_id *raw_id = nullptr;
+  check_errno(
+      ::rdma_create_id(channel->channel(), &raw_id, nullptr, RDMA_PS_TCP),
+      "failed to create cm id");
+  cm_id_ptr id(raw_id);
+
+  struct addrinfo hints, *servinfo;
+  ::bzero(&hints, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  auto const port_str = std::to_string(port_);
+  if (auto rc = ::getaddrinfo(hostname_.c_str(), port_str.c_str(), &hints,
+                              &servinfo);
+      rc != 0) {
+    throw_with("failed to getaddrinfo: %s", ::gai_strerror(rc));
+  }
+  auto rc = ::rdma_resolve_addr(id.get(), nullptr, servinfo->ai_addr,
+                                kCmResolveTimeoutMs);
+  ::freeaddrinfo(servinfo);
+  check_errno(rc, "failed to resolve address");
+  co_await channel->expect(RDMA_CM_EVENT_ADDR_RESOLVED);
+  check_errno(::rdma_resolve_route(id.get(), kCmResolveTimeoutMs),
+              "failed to resolve route");
+  co_await channel->expect(RDMA_CM_EVENT_ROUTE_RESOLVED);
+  check_cm_device(id.get(), *pd_->device_ptr());
+
+  auto qp_ptr = std::make_shared<qp>(pd_, recv_cq_, send_cq_, srq_);
+  auto private_data = encode_cm_private_data(user_data_, kMaxUserDataSize);
+  struct rdma_conn_param param = {};
+  param.private_data = private_data.data();
+  param.private_data_len = private_data.size();
+  param.responder_resources = kCmMaxRdAtomic;
+  param.initiator_depth = kCmMaxRdAtomic;
+  param.retry_count = 7;
+  param.rnr_retry_count = 7;
+  param.qp_num = qp_ptr->qp_num();
+  check_errno(::rdma_connect(id.get(), &param), "failed to connect");
+
+  // The Queue Pair is not owned by rdma_cm, so it has to be transitioned here
+  // before the connection is established.
+  auto response =
+      co_await channel->expect(RDMA_CM_EVENT_CONNECT_RESPONSE);
+  qp_ptr->user_data() = decode_cm_private_data(response->param.conn);
+  response.reset();
+  cm_transition_to_rts(id.get(), *qp_ptr);
+  check_errno(::rdma_establish(id.get()), "failed to establish connection");
+  RDMAPP_LOG_DEBUG("cm connection established qpn=%u", qp_ptr->qp_num());
+  connections_->add(std::move(channel), std::move(id));
+  co_return qp_ptr;
+}
+
+cm_connector::~cm_connector() {}
+
+} // namespace rdmapp
@@ -0,0 +1,241 @@
+#include "cm_event_channel.h"
+
+#include "socket/channel.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include <rdma/rdma_cma.h>
+
+#include <rdmapp/device.h>
+#include <rdmapp/error.h>
+#include <rdmapp/qp.h>
+
+#include <rdmapp/detail/debug.h>
+#include <rdmapp/detail/serdes.h>
+
+namespace rdmapp {
+
+void cm_event_deleter::operator()(struct rdma_cm_event *event) const {
+  if (auto rc = ::rdma_ack_cm_event(event); rc != 0) [[unlikely]] {
+    RDMAPP_LOG_ERROR("failed to ack cm event: %s (errno=%d)", strerror(errno),
+                     errno);
+  }
+}
+
+void cm_id_deleter::operator()(struct rdma_cm_id *id) const {
+  if (auto rc = ::rdma_destroy_id(id); rc != 0) [[unlikely]] {
+    RDMAPP_LOG_ERROR("failed to destroy cm id %p: %s (errno=%d)",
+                     reinterpret_cast<void *>(id), strerror(errno), errno);
+  } else {
+    RDMAPP_LOG_TRACE("destroyed cm id %p", reinterpret_cast<void *>(id));
+  }
+}
+
+static cm_event_ptr try_get_event(struct rdma_event_channel *channel) {
+  struct rdma_cm_event *event = nullptr;
+  if (auto rc = ::rdma_get_cm_event(channel, &event); rc != 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return nullptr;
+    }
+    check_errno(rc, "failed to get cm event");
+  }
+  RDMAPP_LOG_TRACE("cm event %s status=%d id=%p",
+                   ::rdma_event_str(event->event), event->status,
+                   reinterpret_cast<void *>(event->id));
+  return cm_event_ptr(event);
+}
+
+cm_event_channel::event_awaitable::event_awaitable(cm_event_channel &channel)
+    : channel_(channel) {}
+
+bool cm_event_channel::event_awaitable::await_ready() {
+  event_ = channel_.try_get_event();
+  return event_ != nullptr;
+}
+
+void cm_event_channel::event_awaitable::await_suspend(
+    std::coroutine_handle<> h) {
+  channel_.wait_readable([h]() { h.resume(); });
+}
+
+cm_event_ptr cm_event_channel::event_awaitable::await_resume() {
+  if (!event_) {
+    event_ = channel_.try_get_event();
+  }
+  return std::move(event_);
+}
+
+cm_event_channel::cm_event_channel(std::shared_ptr<socket::event_loop> loop)
+    : channel_(::rdma_create_event_channel()) {
+  check_ptr(channel_, "failed to create cm event channel");
+  // The poll channel closes its descriptor, so it gets a duplicate and the
+  // original stays owned by the event channel.
+  int fd = ::dup(channel_->fd);
+  try {
+    check_errno(fd, "failed to duplicate cm event channel fd");
+    poll_channel_ = std::make_shared<socket::channel>(fd, loop);
+    poll_channel_->set_nonblocking();
+  } catch (...) {
+    ::rdma_destroy_event_channel(channel_);
+    throw;
+  }
+}
+
+struct rdma_event_channel *cm_event_channel::channel() { return channel_; }
+
+cm_event_ptr cm_event_channel::try_get_event() {
+  return rdmapp::try_get_event(channel_);
+}
+
+void cm_event_channel::wait_readable(socket::channel::callback_fn callback) {
+  poll_channel_->set_readable_callback(std::move(callback));
+  poll_channel_->wait_readable();
+}
+
+cm_event_channel::event_awaitable cm_event_channel::get_event() {
+  return event_awaitable(*this);
+}
+
+task<cm_event_ptr> cm_event_channel::expect(enum rdma_cm_event_type type) {
+  cm_event_ptr event;
+  while (!event) {
+    event = co_await get_event();
+  }
+  if (event->event != type) {
+    throw_with("unexpected cm event %s (status=%d), expected %s",
+               ::rdma_event_str(event->event), event->status,
+               ::rdma_event_str(type));
+  }
+  co_return event;
+}
+
+cm_event_channel::~cm_event_channel() {
+  poll_channel_.reset();
+  ::rdma_destroy_event_channel(channel_);
+}
+
+std::vector<uint8_t>
+encode_cm_private_data(std::vector<uint8_t> const &user_data, size_t max_size) {
+  if (user_data.size() > max_size) {
+    throw_with("user data of %zu bytes exceeds cm private data limit %zu",
+               user_data.size(), max_size);
+  }
+  std::vector<uint8_t> private_data;
+  auto it = std::back_inserter(private_data);
+  detail::serialize(static_cast<uint32_t>(user_data.size()), it);
+  std::copy(user_data.cbegin(), user_data.cend(), it);
+  return private_data;
+}
+
+std::vector<uint8_t>
+decode_cm_private_data(struct rdma_conn_param const &conn) {
+  if (conn.private_data == nullptr ||
+      conn.private_data_len < sizeof(uint32_t)) {
+    return {};
+  }
+  auto data = static_cast<uint8_t const *>(conn.private_data);
+  uint32_t user_data_size = 0;
+  detail::deserialize(data, user_data_size);
+  if (user_data_size > conn.private_data_len - sizeof(uint32_t)) {
+    throw_with("malformed cm private data: user_data_size=%u length=%u",
+               user_data_size, conn.private_data_len);
+  }
+  return std::vector<uint8_t>(data, data + user_data_size);
+}
+
+void cm_connection_set::add(std::unique_ptr<cm_event_channel> channel,
+                            cm_id_ptr id) {
+  auto raw_id = id.get();
+  std::lock_guard lock(mutex_);
+  auto &added = connections_
+                    .emplace(raw_id,
+                             connection{std::move(channel), std::move(id)})
+                    .first->second;
+  watch(raw_id, *added.channel);
+}
+
+void cm_connection_set::watch(struct rdma_cm_id *id,
+                              cm_event_channel &channel) {
+  channel.wait_readable([weak = weak_from_this(), id]() {
+    if (auto set = weak.lock()) {
+      set->on_events(id);
+    }
+  });
+}
+
+void cm_connection_set::on_events(struct rdma_cm_id *id) {
+  std::unique_lock lock(mutex_);
+  auto it = connections_.find(id);
+  if (it == connections_.end()) {
+    return;
+  }
+  bool released = false;
+  try {
+    while (auto event = it->second.channel->try_get_event()) {
+      switch (event->event) {
+      case RDMA_CM_EVENT_DISCONNECTED:
+        // Answer the peer so that it does not wait for the disconnect to time
+        // out.
+        ::rdma_disconnect(id);
+        released = true;
+        break;
+      case RDMA_CM_EVENT_TIMEWAIT_EXIT:
+      case RDMA_CM_EVENT_DEVICE_REMOVAL:
+        released = true;
+        break;
+      default:
+        RDMAPP_LOG_DEBUG("ignored cm event %s on established connection",
+                         ::rdma_event_str(event->event));
+        break;
+      }
+    }
+  } catch (std::runtime_error &e) {
+    RDMAPP_LOG_ERROR("%s", e.what());
+    released = true;
+  }
+  if (!released) {
+    watch(id, *it->second.channel);
+    return;
+  }
+  // The id is destroyed before its channel once the lock is dropped.
+  auto connection = std::move(it->second);
+  connections_.erase(it);
+  lock.unlock();
+  RDMAPP_LOG_DEBUG("released cm connection id=%p",
+                   reinterpret_cast<void *>(id));
+}
+
+void check_cm_device(struct rdma_cm_id *id, device const &device) {
+  if (id->verbs == nullptr) {
+    throw_with("cm connection is not bound to a device");
+  }
+  // librdmacm opens its own device contexts, so devices are matched by name.
+  std::string const name = ::ibv_get_device_name(id->verbs->device);
+  if (name != device.name() || id->port_num != device.port_num()) {
+    throw_with("cm connection routes through %s port %u, expected %s port %u",
+               name.c_str(), id->port_num, device.name().c_str(),
+               device.port_num());
+  }
+}
+
+void cm_transition_to_rts(struct rdma_cm_id *id, qp &qp) {
+  for (auto state : {IBV_QPS_RTR, IBV_QPS_RTS}) {
+    struct ibv_qp_attr qp_attr = {};
+    int attr_mask = 0;
+    qp_attr.qp_state = state;
+    check_errno(::rdma_init_qp_attr(id, &qp_attr, &attr_mask),
+             "failed to get qp attributes from cm");
+    qp.modify(qp_attr, attr_mask);
+  }
+}
+
+} // namespace rdmapp
@@ -0,0 +1,71 @@
+#include "cm_acceptor.h"
+#include "cm_connector.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rdmapp/rdmapp.h>
+
+rdmapp::task<void> handle_qp(std::shared_ptr<rdmapp::qp> qp) {
+  std::cout << "Accepted qp with user data: "
+            << std::string(qp->user_data().begin(), qp->user_data().end())
+            << std::endl;
+  char buffer[6] = "hello";
+  co_await qp->send(buffer, sizeof(buffer));
+  std::cout << "Sent to client: " << buffer << std::endl;
+  co_await qp->recv(buffer, sizeof(buffer));
+  std::cout << "Received from client: " << buffer << std::endl;
+  co_return;
+}
+
+rdmapp::task<void> server(rdmapp::cm_acceptor &acceptor) {
+  while (true) {
+    auto qp = co_await acceptor.accept();
+    handle_qp(qp).detach();
+  }
+  co_return;
+}
+
+rdmapp::task<void> client(rdmapp::cm_connector &connector) {
+  auto qp = co_await connector.connect();
+  std::cout << "Connected qp with user data: "
+            << std::string(qp->user_data().begin(), qp->user_data().end())
+            << std::endl;
+  char buffer[6];
+  co_await qp->recv(buffer, sizeof(buffer));
+  std::cout << "Received from server: " << buffer << std::endl;
+  std::copy_n("world", sizeof(buffer), buffer);
+  co_await qp->send(buffer, sizeof(buffer));
+  std::cout << "Sent to server: " << buffer << std::endl;
+  co_return;
+}
+
+int main(int argc, char *argv[]) {
+  auto device = std::make_shared<rdmapp::device>(0, 1);
+  auto pd = std::make_shared<rdmapp::pd>(device);
+  auto cq = std::make_shared<rdmapp::cq>(device);
+  auto cq_poller = std::make_shared<rdmapp::cq_poller>(cq);
+  auto loop = rdmapp::socket::event_loop::new_loop();
+  auto looper = std::thread([loop]() { loop->loop(); });
+  std::string const greeting = "rdmapp";
+  std::vector<uint8_t> user_data(greeting.begin(), greeting.end());
+  if (argc == 2) {
+    rdmapp::cm_acceptor acceptor(loop, "", std::stoi(argv[1]), pd, cq, cq,
+                                 nullptr, user_data);
+    server(acceptor);
+  } else if (argc == 3) {
+    rdmapp::cm_connector connector(loop, argv[1], std::stoi(argv[2]), pd, cq,
+                                   cq, nullptr, user_data);
+    client(connector);
+  } else {
+    std::cout << "Usage: " << argv[0] << " [port] for server and " << argv[0]
+              << " [server_ip] [port] for client" << std::endl;
+  }
+  loop->close();
+  looper.join();
+  return 0;
+}
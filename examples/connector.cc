@@ -8,24 +8,19 @@
 namespace rdmapp {
 
 /**
- * @brief This function is used to receive a Queue Pair from a remote peer.
+ * @brief This function is used to exchange a Queue Pair with a remote peer.
  *
  * @param connection The TCP connection to the remote peer.
- * @param pd The protection domain of the new Queue Pair.
- * @param recv_cq The completion queue of recv work completions.
- * @param send_cq The completion queue of send work completions.
- * @param srq (Optional) If set, all recv work requests will be posted to this
- * SRQ.
+ * @param qp_ptr The new Queue Pair in the INIT state.
  * @return task<std::shared_ptr<qp>> A coroutine that returns a shared pointer
  * to the new Queue Pair.
  */
 static task<std::shared_ptr<qp>>
-from_tcp_connection(socket::tcp_connection &connection, std::shared_ptr<pd> pd,
-                    std::shared_ptr<cq> recv_cq, std::shared_ptr<cq> send_cq,
-                    std::shared_ptr<srq> srq = nullptr) {
-  auto qp_ptr = std::make_shared<qp>(pd, recv_cq, send_cq, srq);
+from_tcp_connection(socket::tcp_connection &connection,
+                    std::shared_ptr<qp> qp_ptr) {
   co_await send_qp(*qp_ptr, connection);
   auto remote_qp = co_await recv_qp(connection);
+  qp_ptr->negotiate(remote_qp.capabilities);
   qp_ptr->rtr(remote_qp.header.lid, remote_qp.header.qp_num,
               remote_qp.header.sq_psn, remote_qp.header.gid);
   qp_ptr->user_data() = std::move(remote_qp.user_data);
@@ -46,12 +41,55 @@ connector::connector(std::shared_ptr<socket::event_loop> loop,
                      std::shared_ptr<srq> srq)
     : connector(loop, hostname, port, pd, cq, cq, srq) {}
 
+void connector::set_qp_pool(std::shared_ptr<qp_pool> pool) {
+  qp_pool_ = pool;
+  qp_pool_->reserve(pd_, recv_cq_, send_cq_, srq_);
+}
+
+std::shared_ptr<qp> connector::new_qp() {
+  if (qp_pool_) {
+    return qp_pool_->acquire(pd_, recv_cq_, send_cq_, srq_);
+  }
+  return std::make_shared<qp>(pd_, recv_cq_, send_cq_, srq_);
+}
+
 task<std::shared_ptr<qp>> connector::connect() {
   auto connection =
       co_await rdmapp::socket::tcp_connection::connect(loop_, hostname_, port_);
-  auto qp =
-      co_await from_tcp_connection(*connection, pd_, recv_cq_, send_cq_, srq_);
+  auto qp = co_await from_tcp_connection(*connection, new_qp());
   co_return qp;
 }
 
+task<std::vector<std::shared_ptr<qp>>> connector::connect_many(size_t nr_qps) {
+  auto connection =
+      co_await rdmapp::socket::tcp_connection::connect(loop_, hostname_, port_);
+  std::vector<std::shared_ptr<qp>> qps(nr_qps);
+  co_await offload([&]() {
+    parallel_for(nr_qps, [&](size_t i) { qps[i] = new_qp(); });
+  });
+  co_await send_qps(qps, *connection);
+  auto remote_qps =
+      co_await recv_qps(*connection, static_cast<uint32_t>(nr_qps));
+  if (remote_qps.size() != nr_qps) {
+    throw_with("remote returned %zu qps, expected %zu", remote_qps.size(),
+               nr_qps);
+  }
+  co_await offload([&]() {
+    parallel_for(nr_qps, [&](size_t i) {
+      auto &remote_qp = remote_qps[i];
+      qps[i]->negotiate(remote_qp.capabilities);
+      qps[i]->rtr(remote_qp.header.lid, remote_qp.header.qp_num,
+                  remote_qp.header.sq_psn, remote_qp.header.gid);
+      qps[i]->user_data() = std::move(remote_qp.user_data);
+      qps[i]->rts();
+    });
+  });
+  co_return qps;
+}
+
+task<std::shared_ptr<striped_qp>> connector::connect_striped(size_t nr_qps) {
+  auto qps = co_await connect_many(nr_qps);
+  co_return std::make_shared<striped_qp>(std::move(qps));
+}
+
 } // namespace rdmapp
\ No newline at end of file
@@ -6,11 +6,14 @@
 #include <cstdint>
 #include <memory>
 #include <sys/socket.h>
+#include <vector>
 
 #include <rdmapp/detail/noncopyable.h>
 #include <rdmapp/device.h>
 #include <rdmapp/pd.h>
 #include <rdmapp/qp.h>
+#include <rdmapp/qp_pool.h>
+#include <rdmapp/striped_qp.h>
 #include <rdmapp/task.h>
 
 namespace rdmapp {
@@ -25,8 +28,19 @@ class acceptor : public noncopyable {
   std::shared_ptr<cq> recv_cq_;
   std::shared_ptr<cq> send_cq_;
   std::shared_ptr<srq> srq_;
+  std::shared_ptr<qp_pool> qp_pool_;
+  uint32_t max_qps_;
+
+  std::shared_ptr<qp> new_qp();
 
 public:
+  /**
+   * @brief The default largest batch of Queue Pairs `accept_many` accepts
+   * from one peer.
+   *
+   */
+  static constexpr uint32_t kDefaultMaxQps = 1024;
+
   /**
    * @brief Construct a new acceptor object.
    *
@@ -96,6 +110,44 @@ public:
    * pointer to the new queue pair. It will be in the RTS state.
    */
   task<std::shared_ptr<qp>> accept();
+
+  /**
+   * @brief Draw new Queue Pairs from a pool of Queue Pairs in the INIT state,
+   * so that accepting only transitions them to RTR and RTS.
+   *
+   * @param pool The Queue Pair pool. A pool for the acceptor's resources is
+   * reserved in it.
+   */
+  void set_qp_pool(std::shared_ptr<qp_pool> pool);
+
+  /**
+   * @brief Set the largest batch of Queue Pairs `accept_many` accepts from one
+   * peer. Larger batches are rejected before any Queue Pair is created.
+   *
+   * @param max_qps The number of Queue Pairs.
+   */
+  void set_max_qps(uint32_t max_qps);
+
+  /**
+   * @brief This function is used to accept an incoming connection and a batch
+   * of queue pairs sent by `connector::connect_many`. All queue pairs are
+   * exchanged in one message each way over the same connection.
+   *
+   * @return task<std::vector<std::shared_ptr<qp>>> A completion task that
+   * returns the new queue pairs in the order the peer created them. They will
+   * be in the RTS state.
+   */
+  task<std::vector<std::shared_ptr<qp>>> accept_many();
+
+  /**
+   * @brief This function is used to accept an incoming connection and
+   * establish a striped Queue Pair over it, sent by
+   * `connector::connect_striped`.
+   *
+   * @return task<std::shared_ptr<striped_qp>> A completion task that returns
+   * the striped Queue Pair. Its Queue Pairs will be in the RTS state.
+   */
+  task<std::shared_ptr<striped_qp>> accept_striped();
   ~acceptor();
 };
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "cm_event_channel.h"
+#include "socket/event_loop.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <rdmapp/cq.h>
+#include <rdmapp/pd.h>
+#include <rdmapp/qp.h>
+#include <rdmapp/srq.h>
+#include <rdmapp/task.h>
+
+#include <rdmapp/detail/noncopyable.h>
+
+namespace rdmapp {
+
+/**
+ * @brief This class is used to accept incoming Queue Pairs through rdma_cm
+ * instead of a TCP side channel. Addresses, routes and PSNs are resolved by
+ * the connection manager, which also handles RoCEv2 GIDs correctly.
+ *
+ */
+class cm_acceptor : public noncopyable {
+  std::shared_ptr<socket::event_loop> loop_;
+  std::unique_ptr<cm_event_channel> listen_channel_;
+  cm_id_ptr listen_id_;
+  std::shared_ptr<pd> pd_;
+  std::shared_ptr<cq> recv_cq_;
+  std::shared_ptr<cq> send_cq_;
+  std::shared_ptr<srq> srq_;
+  std::vector<uint8_t> user_data_;
+  std::shared_ptr<cm_connection_set> connections_;
+
+public:
+  /**
+   * @brief Construct a new cm acceptor object.
+   *
+   * @param loop The event loop to poll connection events with.
+   * @param hostname The address to listen on. Empty to listen on all.
+   * @param port The port to listen on.
+   * @param pd The protection domain for all new Queue Pairs. Its device should
+   * be the one the listening address routes through.
+   * @param recv_cq The recv completion queue to use for incoming Queue Pairs.
+   * @param send_cq The send completion queue to use for incoming Queue Pairs.
+   * @param srq (Optional) The shared receive queue to use for incoming Queue
+   * Pairs.
+   * @param user_data (Optional) Data sent to every peer as connection private
+   * data. It should be no longer than `kMaxUserDataSize`.
+   */
+  cm_acceptor(std::shared_ptr<socket::event_loop> loop,
+              std::string const &hostname, uint16_t port,
+              std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+              std::shared_ptr<cq> send_cq, std::shared_ptr<srq> srq = nullptr,
+              std::vector<uint8_t> user_data = {});
+
+  /**
+   * @brief Construct a new cm acceptor object.
+   *
+   * @param loop The event loop to poll connection events with.
+   * @param port The port to listen on.
+   * @param pd The protection domain for all new Queue Pairs.
+   * @param cq The send/recv completion queue to use for all new Queue Pairs.
+   * @param srq (Optional) The shared receive queue to use for all new Queue
+   * Pairs.
+   */
+  cm_acceptor(std::shared_ptr<socket::event_loop> loop, uint16_t port,
+              std::shared_ptr<pd> pd, std::shared_ptr<cq> cq,
+              std::shared_ptr<srq> srq = nullptr);
+
+  /**
+   * @brief The maximum length of user data in the accept message.
+   *
+   */
+  static constexpr size_t kMaxUserDataSize = 192;
+
+  /**
+   * @brief This function is used to accept an incoming Queue Pair. This should
+   * be called in a loop. The private data of the peer is available as the
+   * `user_data` of the new Queue Pair. The rdma_cm id of the connection is kept
+   * until the peer disconnects or the acceptor is destroyed. Connections
+   * routed through another device than the protection domain's are rejected.
+   *
+   * @return task<std::shared_ptr<qp>> A completion task that returns a shared
+   * pointer to the new queue pair. It will be in the RTS state.
+   */
+  task<std::shared_ptr<qp>> accept();
+
+  ~cm_acceptor();
+};
+
+} // namespace rdmapp
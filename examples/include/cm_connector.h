@@ -0,0 +1,93 @@
+#pragma once
+
+#include "cm_event_channel.h"
+#include "socket/event_loop.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <rdmapp/cq.h>
+#include <rdmapp/pd.h>
+#include <rdmapp/qp.h>
+#include <rdmapp/srq.h>
+#include <rdmapp/task.h>
+
+#include <rdmapp/detail/noncopyable.h>
+
+namespace rdmapp {
+
+/**
+ * @brief This class is used to actively connect to a `cm_acceptor` through
+ * rdma_cm and establish a Queue Pair.
+ *
+ */
+class cm_connector : public noncopyable {
+  std::shared_ptr<socket::event_loop> loop_;
+  std::shared_ptr<pd> pd_;
+  std::shared_ptr<cq> recv_cq_;
+  std::shared_ptr<cq> send_cq_;
+  std::shared_ptr<srq> srq_;
+  std::string hostname_;
+  uint16_t port_;
+  std::vector<uint8_t> user_data_;
+  std::shared_ptr<cm_connection_set> connections_;
+
+public:
+  /**
+   * @brief Construct a new cm connector object.
+   *
+   * @param loop The event loop to poll connection events with.
+   * @param hostname The address to connect to.
+   * @param port The port to connect to.
+   * @param pd The protection domain for new Queue Pairs. Its device should be
+   * the one the remote address routes through.
+   * @param recv_cq The recv completion queue to use for new Queue Pairs.
+   * @param send_cq The send completion queue to use for new Queue Pairs.
+   * @param srq (Optional) The shared receive queue to use for new Queue Pairs.
+   * @param user_data (Optional) Data sent to the peer as connection private
+   * data. It should be no longer than `kMaxUserDataSize`.
+   */
+  cm_connector(std::shared_ptr<socket::event_loop> loop,
+               std::string const &hostname, uint16_t port,
+               std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+               std::shared_ptr<cq> send_cq, std::shared_ptr<srq> srq = nullptr,
+               std::vector<uint8_t> user_data = {});
+
+  /**
+   * @brief Construct a new cm connector object.
+   *
+   * @param loop The event loop to poll connection events with.
+   * @param hostname The address to connect to.
+   * @param port The port to connect to.
+   * @param pd The protection domain for new Queue Pairs.
+   * @param cq The send/recv completion queue to use for new Queue Pairs.
+   * @param srq (Optional) The shared receive queue to use for new Queue Pairs.
+   */
+  cm_connector(std::shared_ptr<socket::event_loop> loop,
+               std::string const &hostname, uint16_t port,
+               std::shared_ptr<pd> pd, std::shared_ptr<cq> cq,
+               std::shared_ptr<srq> srq = nullptr);
+
+  /**
+   * @brief The maximum length of user data in the connect message.
+   *
+   */
+  static constexpr size_t kMaxUserDataSize = 52;
+
+  /**
+   * @brief This function is used to connect to the remote acceptor and
+   * establish a Queue Pair. The private data of the peer is available as the
+   * `user_data` of the new Queue Pair. The rdma_cm id of the connection is
+   * kept until the peer disconnects or the connector is destroyed. It throws
+   * if the route goes through another device than the protection domain's.
+   *
+   * @return task<std::shared_ptr<qp>> A coroutine returning the new Queue Pair
+   * in the RTS state.
+   */
+  task<std::shared_ptr<qp>> connect();
+
+  ~cm_connector();
+};
+
+} // namespace rdmapp
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "socket/channel.h"
+#include "socket/event_loop.h"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <rdma/rdma_cma.h>
+
+#include <rdmapp/device.h>
+#include <rdmapp/qp.h>
+#include <rdmapp/task.h>
+
+#include <rdmapp/detail/noncopyable.h>
+
+namespace rdmapp {
+
+struct cm_event_deleter {
+  void operator()(struct rdma_cm_event *event) const;
+};
+
+struct cm_id_deleter {
+  void operator()(struct rdma_cm_id *id) const;
+};
+
+/**
+ * @brief An rdma_cm event, acknowledged when destroyed.
+ *
+ */
+using cm_event_ptr = std::unique_ptr<struct rdma_cm_event, cm_event_deleter>;
+
+/**
+ * @brief An rdma_cm id, destroyed with the pointer.
+ *
+ */
+using cm_id_ptr = std::unique_ptr<struct rdma_cm_id, cm_id_deleter>;
+
+/**
+ * @brief This class wraps an rdma_cm event channel whose file descriptor is
+ * polled by the event loop, so that connection events can be awaited.
+ *
+ */
+class cm_event_channel : public noncopyable {
+  struct rdma_event_channel *channel_;
+  std::shared_ptr<socket::channel> poll_channel_;
+
+public:
+  class event_awaitable {
+    cm_event_channel &channel_;
+    cm_event_ptr event_;
+
+  public:
+    event_awaitable(cm_event_channel &channel);
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> h);
+    cm_event_ptr await_resume();
+  };
+
+  /**
+   * @brief Construct a new cm event channel object.
+   *
+   * @param loop The event loop to poll the channel with.
+   */
+  cm_event_channel(std::shared_ptr<socket::event_loop> loop);
+
+  /**
+   * @brief Get the underlying event channel.
+   *
+   * @return struct rdma_event_channel* The event channel.
+   */
+  struct rdma_event_channel *channel();
+
+  /**
+   * @brief Get the next event if one is pending.
+   *
+   * @return cm_event_ptr The event, or nullptr if there is none.
+   */
+  cm_event_ptr try_get_event();
+
+  /**
+   * @brief Call a function on the event loop once events are pending. It is
+   * called once per call.
+   *
+   * @param callback The function to call.
+   */
+  void wait_readable(socket::channel::callback_fn callback);
+
+  /**
+   * @brief Wait for the next event on the channel.
+   *
+   * @return event_awaitable A coroutine returning the event, or nullptr if
+   * the wakeup was spurious.
+   */
+  event_awaitable get_event();
+
+  /**
+   * @brief Wait for the next event and check its type.
+   *
+   * @param type The expected event type.
+   * @return task<cm_event_ptr> A coroutine returning the event. It throws if
+   * an event of another type arrives.
+   */
+  task<cm_event_ptr> expect(enum rdma_cm_event_type type);
+
+  ~cm_event_channel();
+};
+
+/**
+ * @brief The rdma_cm ids of established connections with their event
+ * channels. A connection is released as soon as the peer disconnects, and the
+ * others when the set is destroyed.
+ *
+ */
+class cm_connection_set
+    : public std::enable_shared_from_this<cm_connection_set>,
+      public noncopyable {
+  struct connection {
+    // The channel has to outlive the id.
+    std::unique_ptr<cm_event_channel> channel;
+    cm_id_ptr id;
+  };
+  std::mutex mutex_;
+  std::unordered_map<struct rdma_cm_id *, connection> connections_;
+
+  void watch(struct rdma_cm_id *id, cm_event_channel &channel);
+  void on_events(struct rdma_cm_id *id);
+
+public:
+  /**
+   * @brief Keep an established connection until it is disconnected.
+   *
+   * @param channel The event channel the id is migrated to. It should not be
+   * waited on by anyone else.
+   * @param id The rdma_cm id of the connection.
+   */
+  void add(std::unique_ptr<cm_event_channel> channel, cm_id_ptr id);
+};
+
+/**
+ * @brief Check that a connection routes through the device and port of a
+ * protection domain, as its Queue Pair is created there.
+ *
+ * @param id The rdma_cm id of the connection, with its route resolved.
+ * @param device The device of the protection domain.
+ */
+void check_cm_device(struct rdma_cm_id *id, device const &device);
+
+/**
+ * @brief The number of outstanding RDMA reads and atomics requested for
+ * connections, matching `qp::rts`.
+ *
+ */
+constexpr uint8_t kCmMaxRdAtomic = 16;
+
+/**
+ * @brief The timeout of address and route resolution in milliseconds.
+ *
+ */
+constexpr int kCmResolveTimeoutMs = 2000;
+
+/**
+ * @brief Encode user data as connection private data. The connection manager
+ * may pad private data, so it is prefixed with its length.
+ *
+ * @param user_data The user data.
+ * @param max_size The maximum length of user data allowed in the message.
+ * @return std::vector<uint8_t> The private data.
+ */
+std::vector<uint8_t>
+encode_cm_private_data(std::vector<uint8_t> const &user_data, size_t max_size);
+
+/**
+ * @brief Decode user data from connection private data.
+ *
+ * @param conn The connection parameters of the event.
+ * @return std::vector<uint8_t> The user data.
+ */
+std::vector<uint8_t> decode_cm_private_data(struct rdma_conn_param const &conn);
+
+/**
+ * @brief Take a Queue Pair in the INIT state to RTS using the attributes the
+ * connection manager resolved for the connection.
+ *
+ * @param id The rdma_cm id of the connection.
+ * @param qp The Queue Pair.
+ */
+void cm_transition_to_rts(struct rdma_cm_id *id, qp &qp);
+
+} // namespace rdmapp
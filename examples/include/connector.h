@@ -1,11 +1,15 @@
 #pragma once
 
 #include "socket/event_loop.h"
+#include <cstddef>
 #include <memory>
+#include <vector>
 
 #include <rdmapp/cq.h>
 #include <rdmapp/pd.h>
 #include <rdmapp/qp.h>
+#include <rdmapp/qp_pool.h>
+#include <rdmapp/striped_qp.h>
 #include <rdmapp/task.h>
 
 #include "rdmapp/detail/noncopyable.h"
@@ -25,6 +29,9 @@ class connector : public noncopyable {
   std::shared_ptr<socket::event_loop> loop_;
   std::string hostname_;
   uint16_t port_;
+  std::shared_ptr<qp_pool> qp_pool_;
+
+  std::shared_ptr<qp> new_qp();
 
 public:
   /**
@@ -62,6 +69,37 @@ public:
    * @return task<std::shared_ptr<qp>>
    */
   task<std::shared_ptr<qp>> connect();
+
+  /**
+   * @brief Draw new Queue Pairs from a pool of Queue Pairs in the INIT state,
+   * so that connecting only transitions them to RTR and RTS.
+   *
+   * @param pool The Queue Pair pool. A pool for the connector's resources is
+   * reserved in it.
+   */
+  void set_qp_pool(std::shared_ptr<qp_pool> pool);
+
+  /**
+   * @brief This function is used to connect to a remote endpoint and establish
+   * many Queue Pairs over a single TCP exchange. The peer should call
+   * `acceptor::accept_many`.
+   *
+   * @param nr_qps The number of Queue Pairs to establish.
+   * @return task<std::vector<std::shared_ptr<qp>>> The new Queue Pairs in the
+   * RTS state, in the same order as on the peer.
+   */
+  task<std::vector<std::shared_ptr<qp>>> connect_many(size_t nr_qps);
+
+  /**
+   * @brief This function is used to connect to a remote endpoint and establish
+   * a striped Queue Pair of `nr_qps` Queue Pairs over a single TCP exchange.
+   * The peer should call `acceptor::accept_striped`.
+   *
+   * @param nr_qps The number of Queue Pairs to stripe over.
+   * @return task<std::shared_ptr<striped_qp>> The striped Queue Pair. Its Queue
+   * Pairs will be in the RTS state.
+   */
+  task<std::shared_ptr<striped_qp>> connect_striped(size_t nr_qps);
 };
 
 } // namespace rdmapp
\ No newline at end of file
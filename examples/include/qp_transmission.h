@@ -1,6 +1,13 @@
 #pragma once
 
 #include "socket/tcp_connection.h"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include <rdmapp/qp.h>
 #include <rdmapp/task.h>
@@ -11,4 +18,65 @@ task<deserialized_qp> recv_qp(socket::tcp_connection &connection);
 
 task<void> send_qp(qp const &qp, socket::tcp_connection &connection);
 
-} // namespace rdmapp
\ No newline at end of file
+/**
+ * @brief This function receives a batch of Queue Pairs sent with `send_qps`
+ * in a single message.
+ *
+ * @param connection The TCP connection to the remote peer.
+ * @param max_qps The largest batch to accept. A peer announcing more is
+ * rejected before anything is allocated for it.
+ * @return task<std::vector<deserialized_qp>> A coroutine returning the remote
+ * Queue Pairs in the order they were sent.
+ */
+task<std::vector<deserialized_qp>> recv_qps(socket::tcp_connection &connection,
+                                            uint32_t max_qps);
+
+/**
+ * @brief This function sends a batch of Queue Pairs in a single message: the
+ * number of Queue Pairs followed by their serialized records.
+ *
+ * @param qps The Queue Pairs to send.
+ * @param connection The TCP connection to the remote peer.
+ */
+task<void> send_qps(std::vector<std::shared_ptr<qp>> const &qps,
+                    socket::tcp_connection &connection);
+
+/**
+ * @brief This function calls `fn` for every index in [0, n), spreading the
+ * calls over a few threads when there are many. It is used to create and
+ * transition Queue Pairs in parallel as each step is a separate system call.
+ * The first exception thrown by `fn` is rethrown.
+ *
+ * @param n The number of indices.
+ * @param fn The function to call.
+ */
+void parallel_for(size_t n, std::function<void(size_t)> const &fn);
+
+/**
+ * @brief This awaitable runs a blocking function on a new thread and resumes
+ * the awaiting coroutine there, so that the event loop thread keeps serving
+ * other connections meanwhile. The exception thrown by the function is
+ * rethrown.
+ *
+ */
+class offload_awaitable {
+  std::function<void()> fn_;
+  std::exception_ptr exception_;
+
+public:
+  explicit offload_awaitable(std::function<void()> fn);
+  bool await_ready() const noexcept;
+  void await_suspend(std::coroutine_handle<> h);
+  void await_resume() const;
+};
+
+/**
+ * @brief Run a blocking function off the calling thread, e.g. to create many
+ * Queue Pairs without stalling the event loop.
+ *
+ * @param fn The function to run.
+ * @return offload_awaitable An awaitable to be `co_await`ed.
+ */
+[[nodiscard]] offload_awaitable offload(std::function<void()> fn);
+
+} // namespace rdmapp
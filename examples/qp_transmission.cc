@@ -1,25 +1,39 @@
 #include "qp_transmission.h"
 
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <span>
+#include <mutex>
+#include <thread>
+#include <utility>
+
 #include <rdmapp/detail/debug.h>
+#include <rdmapp/detail/serdes.h>
 
 namespace rdmapp {
 
-task<void> send_qp(qp const &qp, socket::tcp_connection &connection) {
-  auto local_qp_data = qp.serialize();
-  assert(local_qp_data.size() != 0);
-  size_t local_qp_sent = 0;
-  while (local_qp_sent < local_qp_data.size()) {
-    int n = co_await connection.send(&local_qp_data[local_qp_sent],
-                                     local_qp_data.size() - local_qp_sent);
+static task<void> send_all(std::vector<uint8_t> const &data,
+                           socket::tcp_connection &connection) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    int n = co_await connection.send(&data[sent], data.size() - sent);
     if (n == 0) {
       throw_with("remote closed unexpectedly while sending qp");
     }
     check_errno(n, "failed to send qp");
-    local_qp_sent += n;
+    sent += n;
   }
   co_return;
 }
 
+task<void> send_qp(qp const &qp, socket::tcp_connection &connection) {
+  auto local_qp_data = qp.serialize();
+  assert(local_qp_data.size() != 0);
+  co_await send_all(local_qp_data, connection);
+  co_return;
+}
+
 task<deserialized_qp> recv_qp(socket::tcp_connection &connection) {
   size_t header_read = 0;
   uint8_t header[deserialized_qp::qp_header::kSerializedSize];
@@ -34,11 +48,36 @@ task<deserialized_qp> recv_qp(socket::tcp_connection &connection) {
   }
 
   auto remote_qp = deserialized_qp::deserialize(header);
+  if (remote_qp.header.version != deserialized_qp::kWireVersion) {
+    throw_with("unsupported qp handshake version %u",
+               remote_qp.header.version);
+  }
   auto const remote_gid_str = device::gid_hex_string(remote_qp.header.gid);
   RDMAPP_LOG_TRACE(
-      "received header gid=%s lid=%u qpn=%u psn=%u user_data_size=%u",
-      remote_gid_str.c_str(), remote_qp.header.lid, remote_qp.header.qp_num,
-      remote_qp.header.sq_psn, remote_qp.header.user_data_size);
+      "received header version=%u gid=%s lid=%u qpn=%u psn=%u "
+      "user_data_size=%u",
+      remote_qp.header.version, remote_gid_str.c_str(), remote_qp.header.lid,
+      remote_qp.header.qp_num, remote_qp.header.sq_psn,
+      remote_qp.header.user_data_size);
+
+  // Newer peers may append fields to the capabilities block. Only the known
+  // prefix is parsed.
+  if (remote_qp.header.capabilities_size < qp_capabilities::kSerializedSize) {
+    throw_with("qp capabilities too short: %u bytes",
+               remote_qp.header.capabilities_size);
+  }
+  std::vector<uint8_t> capabilities(remote_qp.header.capabilities_size);
+  size_t capabilities_read = 0;
+  while (capabilities_read < capabilities.size()) {
+    int n = co_await connection.recv(&capabilities[capabilities_read],
+                                     capabilities.size() - capabilities_read);
+    if (n == 0) {
+      throw_with("remote closed unexpectedly while receiving capabilities");
+    }
+    check_errno(n, "failed to receive capabilities");
+    capabilities_read += n;
+  }
+  remote_qp.capabilities = qp_capabilities::deserialize(capabilities.cbegin());
   remote_qp.user_data.resize(remote_qp.header.user_data_size);
 
   if (remote_qp.header.user_data_size > 0) {
@@ -59,4 +98,122 @@ task<deserialized_qp> recv_qp(socket::tcp_connection &connection) {
   co_return remote_qp;
 }
 
+task<void> send_qps(std::vector<std::shared_ptr<qp>> const &qps,
+                    socket::tcp_connection &connection) {
+  size_t size = sizeof(uint32_t);
+  for (auto const &qp : qps) {
+    size += qp::kSerializedHeaderSize + qp->user_data().size();
+  }
+  // All records are written in place into one buffer.
+  std::vector<uint8_t> data(size);
+  detail::pack(std::span<uint8_t, sizeof(uint32_t)>(data.data(),
+                                                    sizeof(uint32_t)),
+               static_cast<uint32_t>(qps.size()));
+  auto offset = sizeof(uint32_t);
+  for (auto const &qp : qps) {
+    qp->serialize_header(std::span<uint8_t, qp::kSerializedHeaderSize>(
+        data.data() + offset, qp::kSerializedHeaderSize));
+    offset += qp::kSerializedHeaderSize;
+    auto const &user_data = qp->user_data();
+    std::copy(user_data.cbegin(), user_data.cend(), data.begin() + offset);
+    offset += user_data.size();
+  }
+  co_await send_all(data, connection);
+  co_return;
+}
+
+task<std::vector<deserialized_qp>>
+recv_qps(socket::tcp_connection &connection, uint32_t max_qps) {
+  uint8_t count_data[sizeof(uint32_t)];
+  size_t count_read = 0;
+  while (count_read < sizeof(count_data)) {
+    int n = co_await connection.recv(&count_data[count_read],
+                                     sizeof(count_data) - count_read);
+    if (n == 0) {
+      throw_with("remote closed unexpectedly while receiving qp count");
+    }
+    check_errno(n, "failed to receive qp count");
+    count_read += n;
+  }
+  uint32_t nr_qps = 0;
+  auto count_it = &count_data[0];
+  detail::deserialize(count_it, nr_qps);
+  if (nr_qps > max_qps) {
+    throw_with("remote sent %u qps, at most %u are accepted", nr_qps, max_qps);
+  }
+  RDMAPP_LOG_TRACE("receiving %u qps", nr_qps);
+
+  // The records follow the count in the same message, so reading them one by
+  // one costs no extra round trips.
+  std::vector<deserialized_qp> remote_qps;
+  remote_qps.reserve(nr_qps);
+  for (uint32_t i = 0; i < nr_qps; ++i) {
+    remote_qps.emplace_back(co_await recv_qp(connection));
+  }
+  co_return remote_qps;
+}
+
+void parallel_for(size_t n, std::function<void(size_t)> const &fn) {
+  constexpr size_t kMinPerThread = 64;
+  size_t const nr_threads = std::min<size_t>(
+      std::max(1U, std::thread::hardware_concurrency()), n / kMinPerThread);
+  if (nr_threads <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  std::mutex exception_mutex;
+  std::exception_ptr exception;
+  auto worker = [&](size_t begin, size_t end) {
+    try {
+      for (size_t i = begin; i < end; ++i) {
+        fn(i);
+      }
+    } catch (...) {
+      std::lock_guard lock(exception_mutex);
+      if (!exception) {
+        exception = std::current_exception();
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(nr_threads);
+  for (size_t t = 0; t < nr_threads; ++t) {
+    threads.emplace_back(worker, n * t / nr_threads, n * (t + 1) / nr_threads);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+offload_awaitable::offload_awaitable(std::function<void()> fn)
+    : fn_(std::move(fn)) {}
+
+bool offload_awaitable::await_ready() const noexcept { return false; }
+
+void offload_awaitable::await_suspend(std::coroutine_handle<> h) {
+  std::thread([this, h]() {
+    try {
+      fn_();
+    } catch (...) {
+      exception_ = std::current_exception();
+    }
+    h.resume();
+  }).detach();
+}
+
+void offload_awaitable::await_resume() const {
+  if (exception_) {
+    std::rethrow_exception(exception_);
+  }
+}
+
+offload_awaitable offload(std::function<void()> fn) {
+  return offload_awaitable(std::move(fn));
+}
+
 } // namespace rdmapp
\ No newline at end of file
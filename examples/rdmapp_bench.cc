@@ -0,0 +1,675 @@
+#include "acceptor.h"
+#include "connector.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <rdmapp/rdmapp.h>
+
+#include <rdmapp/detail/serdes.h>
+
+/*
+ * A perftest-style benchmark of the library. It measures the latency of
+ * send, write, read and atomic operations with percentiles, and sweeps their
+ * bandwidth and message rate over message size, queue depth and number of
+ * Queue Pairs. Every case runs once per executor worker count, each round on
+ * a fresh executor and poller. The results are printed as a table, CSV or
+ * JSON.
+ *
+ * Without --host or --server, both ends run in this process over Queue Pairs
+ * connected to each other, which also works on Soft-RoCE. Otherwise the
+ * server is passive and the client drives every case over the connection.
+ */
+
+using clock_type = std::chrono::steady_clock;
+
+enum class op_kind : uint8_t { send, write, read, atomic };
+
+struct test_info {
+  const char *name;
+  op_kind op;
+  bool latency;
+};
+
+constexpr std::array<test_info, 8> kTests = {{
+    {"send_lat", op_kind::send, true},
+    {"write_lat", op_kind::write, true},
+    {"read_lat", op_kind::read, true},
+    {"atomic_lat", op_kind::atomic, true},
+    {"send_bw", op_kind::send, false},
+    {"write_bw", op_kind::write, false},
+    {"read_bw", op_kind::read, false},
+    {"atomic_bw", op_kind::atomic, false},
+}};
+
+// The client ends every round of cases but the last with kNextRoundTest.
+constexpr uint8_t kNextRoundTest = 0xFE;
+constexpr uint8_t kQuitTest = 0xFF;
+constexpr size_t kAtomicSize = sizeof(uint64_t);
+
+struct options {
+  std::optional<std::string> host;
+  uint16_t port = 0;
+  bool server = false;
+  uint16_t device = 0;
+  uint16_t ib_port = 1;
+  std::vector<size_t> threads = {4};
+  size_t iterations = 10000;
+  size_t warmup = 100;
+  std::vector<size_t> tests = {0, 1, 2, 3, 4, 5, 6, 7};
+  std::vector<size_t> sizes = {8, 64, 512, 4096, 65536};
+  std::vector<size_t> depths = {1, 16, 64};
+  std::vector<size_t> qps = {1};
+  std::string format = "text";
+  std::optional<std::string> output;
+  bool stats = false;
+};
+
+/*
+ * The control message the client sends before each case. `iterations` counts
+ * every operation of the case, warmup included.
+ */
+struct bench_case {
+  uint8_t test;
+  uint32_t size;
+  uint32_t iterations;
+  uint32_t depth;
+  uint32_t qps;
+
+  static constexpr size_t kSerializedSize =
+      rdmapp::detail::packed_size<uint8_t, uint32_t, uint32_t, uint32_t,
+                                  uint32_t>;
+  using buffer_type = std::array<uint8_t, kSerializedSize>;
+
+  buffer_type serialize() const {
+    buffer_type buffer;
+    rdmapp::detail::pack(std::span<uint8_t, kSerializedSize>(buffer), test,
+                         size, iterations, depth, qps);
+    return buffer;
+  }
+
+  static bench_case deserialize(buffer_type const &buffer) {
+    bench_case bc;
+    rdmapp::detail::unpack(std::span<uint8_t const, kSerializedSize>(buffer),
+                           bc.test, bc.size, bc.iterations, bc.depth, bc.qps);
+    return bc;
+  }
+};
+
+struct case_result {
+  std::string test;
+  size_t size;
+  size_t depth;
+  size_t qps;
+  size_t threads;
+  size_t iterations;
+  double seconds;
+  double mops;
+  double gbps;
+  double avg_us;
+  double p50_us;
+  double p90_us;
+  double p99_us;
+  double p999_us;
+  double max_us;
+};
+
+static std::vector<size_t> parse_list(std::string const &value) {
+  std::vector<size_t> list;
+  std::stringstream ss(value);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    list.push_back(std::stoull(item));
+  }
+  if (list.empty()) {
+    throw std::invalid_argument("empty list: " + value);
+  }
+  return list;
+}
+
+static std::vector<size_t> parse_tests(std::string const &value) {
+  std::vector<size_t> tests;
+  std::stringstream ss(value);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    auto it = std::find_if(kTests.begin(), kTests.end(),
+                           [&](auto const &info) { return item == info.name; });
+    if (it == kTests.end()) {
+      throw std::invalid_argument("unknown test: " + item);
+    }
+    tests.push_back(it - kTests.begin());
+  }
+  return tests;
+}
+
+static void usage(const char *argv0) {
+  std::cout
+      << "Usage: " << argv0 << " [options]\n"
+      << "  --server --port P        serve a client on port P\n"
+      << "  --host H --port P        run the client against server H:P\n"
+      << "                           (neither: loopback in this process)\n"
+      << "  --device N --ib-port N   RDMA device index and port (0, 1)\n"
+      << "  --threads a,b,...        executor workers, one round each (4)\n"
+      << "  --tests a,b,...          send_lat,write_lat,read_lat,atomic_lat,\n"
+      << "                           send_bw,write_bw,read_bw,atomic_bw (all)\n"
+      << "  --sizes a,b,...          message sizes (8,64,512,4096,65536)\n"
+      << "  --depths a,b,...         outstanding ops per Queue Pair (1,16,64)\n"
+      << "  --qps a,b,...            Queue Pairs used in parallel (1)\n"
+      << "  --iters N                measured operations per case (10000)\n"
+      << "  --warmup N               unmeasured latency operations (100)\n"
+      << "  --format text|csv|json   output format (text)\n"
+      << "  --output FILE            write results to FILE\n"
+      << "  --stats                  print counters to stderr per round\n";
+}
+
+static options parse_options(int argc, char *argv[]) {
+  options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::invalid_argument("missing value for " + arg);
+      }
+      return argv[++i];
+    };
+    if (arg == "--server") {
+      opts.server = true;
+    } else if (arg == "--host") {
+      opts.host = next();
+    } else if (arg == "--port") {
+      opts.port = std::stoi(next());
+    } else if (arg == "--device") {
+      opts.device = std::stoi(next());
+    } else if (arg == "--ib-port") {
+      opts.ib_port = std::stoi(next());
+    } else if (arg == "--threads") {
+      opts.threads = parse_list(next());
+    } else if (arg == "--tests") {
+      opts.tests = parse_tests(next());
+    } else if (arg == "--sizes") {
+      opts.sizes = parse_list(next());
+    } else if (arg == "--depths") {
+      opts.depths = parse_list(next());
+    } else if (arg == "--qps") {
+      opts.qps = parse_list(next());
+    } else if (arg == "--iters") {
+      opts.iterations = std::stoull(next());
+    } else if (arg == "--warmup") {
+      opts.warmup = std::stoull(next());
+    } else if (arg == "--format") {
+      opts.format = next();
+    } else if (arg == "--output") {
+      opts.output = next();
+    } else if (arg == "--stats") {
+      opts.stats = true;
+    } else if (arg == "--help" || arg == "-h") {
+      usage(argv[0]);
+      std::exit(0);
+    } else {
+      throw std::invalid_argument("unknown option: " + arg);
+    }
+  }
+  if ((opts.server || opts.host) && opts.port == 0) {
+    throw std::invalid_argument("--port is required with --server or --host");
+  }
+  if (std::find(opts.threads.begin(), opts.threads.end(), 0) !=
+      opts.threads.end()) {
+    throw std::invalid_argument("--threads needs at least one worker");
+  }
+  if (opts.format != "text" && opts.format != "csv" && opts.format != "json") {
+    throw std::invalid_argument("unknown format: " + opts.format);
+  }
+  return opts;
+}
+
+/*
+ * Split `total` operations over `streams` concurrent loops. The server splits
+ * receives the same way, so each stream's sends meet posted receives.
+ */
+static size_t stream_share(size_t total, size_t streams, size_t stream) {
+  return total / streams + (stream < total % streams ? 1 : 0);
+}
+
+struct buffer {
+  std::vector<uint8_t> data;
+  std::shared_ptr<rdmapp::local_mr> mr;
+
+  buffer(std::shared_ptr<rdmapp::pd> const &pd, size_t size)
+      : data(std::max(size, kAtomicSize)),
+        mr(std::make_shared<rdmapp::local_mr>(
+            pd->reg_mr(data.data(), data.size()))) {}
+};
+
+static rdmapp::lazy_task<void> send_control(std::shared_ptr<rdmapp::qp> qp,
+                                            void *data, size_t length) {
+  co_await qp->send(data, length);
+}
+
+static rdmapp::lazy_task<void> recv_control(std::shared_ptr<rdmapp::qp> qp,
+                                            void *data, size_t length) {
+  co_await qp->recv(data, length);
+}
+
+static rdmapp::qp::send_awaitable
+make_op(std::shared_ptr<rdmapp::qp> const &qp, op_kind op,
+        rdmapp::remote_mr const &remote_mr,
+        std::shared_ptr<rdmapp::local_mr> const &local_mr) {
+  switch (op) {
+  case op_kind::write:
+    return qp->write(remote_mr, local_mr);
+  case op_kind::read:
+    return qp->read(remote_mr, local_mr);
+  case op_kind::atomic:
+    return qp->fetch_and_add(remote_mr, local_mr, 1);
+  default:
+    return qp->send(local_mr);
+  }
+}
+
+static rdmapp::lazy_task<void>
+client_stream(std::shared_ptr<rdmapp::qp> qp, op_kind op,
+              rdmapp::remote_mr remote_mr,
+              std::shared_ptr<rdmapp::local_mr> local_mr, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    co_await make_op(qp, op, remote_mr, local_mr);
+  }
+}
+
+static rdmapp::lazy_task<void>
+server_stream(std::shared_ptr<rdmapp::qp> qp,
+              std::shared_ptr<rdmapp::local_mr> local_mr, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    co_await qp->recv(local_mr);
+  }
+}
+
+static case_result make_result(test_info const &info, bench_case const &bc,
+                               size_t measured, clock_type::duration elapsed,
+                               std::vector<double> samples_us) {
+  case_result result = {};
+  result.test = info.name;
+  result.size = bc.size;
+  result.depth = bc.depth;
+  result.qps = bc.qps;
+  result.iterations = measured;
+  result.seconds = std::chrono::duration<double>(elapsed).count();
+  result.mops = measured / result.seconds / 1e6;
+  result.gbps = measured * bc.size * 8 / result.seconds / 1e9;
+  if (!samples_us.empty()) {
+    std::sort(samples_us.begin(), samples_us.end());
+    auto percentile = [&](double q) {
+      auto index = static_cast<size_t>(q * samples_us.size());
+      return samples_us[std::min(index, samples_us.size() - 1)];
+    };
+    double sum = 0;
+    for (auto sample : samples_us) {
+      sum += sample;
+    }
+    result.avg_us = sum / samples_us.size();
+    result.p50_us = percentile(0.5);
+    result.p90_us = percentile(0.9);
+    result.p99_us = percentile(0.99);
+    result.p999_us = percentile(0.999);
+    result.max_us = samples_us.back();
+  }
+  return result;
+}
+
+static rdmapp::lazy_task<case_result>
+run_case(std::vector<std::shared_ptr<rdmapp::qp>> const &qps,
+         bench_case const &bc, size_t warmup) {
+  auto const &info = kTests[bc.test];
+  auto control = qps.front();
+  auto header = bc.serialize();
+  co_await send_control(control, header.data(), header.size());
+  std::array<uint8_t, rdmapp::remote_mr::kSerializedSize> remote_mr_buffer;
+  co_await recv_control(control, remote_mr_buffer.data(),
+                        remote_mr_buffer.size());
+  auto remote_mr = rdmapp::remote_mr::deserialize(remote_mr_buffer.begin());
+
+  auto pd = control->pd_ptr();
+  buffer local(pd, bc.size);
+  std::vector<double> samples_us;
+  clock_type::duration elapsed{};
+  size_t measured = bc.iterations;
+
+  if (info.latency) {
+    buffer pong(pd, bc.size);
+    measured = bc.iterations - warmup;
+    samples_us.reserve(measured);
+    for (size_t i = 0; i < bc.iterations; ++i) {
+      auto const start = clock_type::now();
+      if (info.op == op_kind::send) {
+        co_await rdmapp::when_all(control->recv(pong.mr),
+                                  control->send(local.mr));
+      } else {
+        co_await make_op(control, info.op, remote_mr, local.mr);
+      }
+      auto const rtt = clock_type::now() - start;
+      if (i >= warmup) {
+        elapsed += rtt;
+        auto us = std::chrono::duration<double, std::micro>(rtt).count();
+        samples_us.push_back(info.op == op_kind::send ? us / 2 : us);
+      }
+    }
+  } else {
+    auto const streams = bc.qps * bc.depth;
+    std::vector<rdmapp::lazy_task<void>> tasks;
+    for (size_t i = 0; i < streams; ++i) {
+      tasks.emplace_back(
+          client_stream(qps[i % bc.qps], info.op, remote_mr, local.mr,
+                        stream_share(bc.iterations, streams, i)));
+    }
+    auto const start = clock_type::now();
+    co_await rdmapp::when_all(std::move(tasks));
+    elapsed = clock_type::now() - start;
+  }
+
+  uint8_t end = 0;
+  co_await send_control(control, &end, sizeof(end));
+  co_return make_result(info, bc, measured, elapsed, std::move(samples_us));
+}
+
+/*
+ * Serve cases until the client ends the round. Returns whether another round
+ * follows.
+ */
+static rdmapp::lazy_task<bool>
+serve(std::vector<std::shared_ptr<rdmapp::qp>> qps) {
+  auto control = qps.front();
+  auto pd = control->pd_ptr();
+  while (true) {
+    bench_case::buffer_type header;
+    co_await recv_control(control, header.data(), header.size());
+    auto bc = bench_case::deserialize(header);
+    if (bc.test == kNextRoundTest || bc.test == kQuitTest) {
+      co_return bc.test == kNextRoundTest;
+    }
+    if (bc.test >= kTests.size() || bc.qps > qps.size() || bc.qps == 0 ||
+        bc.depth == 0) {
+      throw std::runtime_error("invalid benchmark case");
+    }
+    auto const &info = kTests[bc.test];
+    buffer target(pd, bc.size);
+    auto mr_buffer = target.mr->serialize();
+
+    if (info.op == op_kind::send && !info.latency) {
+      // The reply is sent last: when_all starts the streams in order and each
+      // posts its first receive before suspending, so the client's first
+      // sends never find an empty receive queue.
+      auto const streams = bc.qps * bc.depth;
+      std::vector<rdmapp::lazy_task<void>> tasks;
+      for (size_t i = 0; i < streams; ++i) {
+        tasks.emplace_back(
+            server_stream(qps[i % bc.qps], target.mr,
+                          stream_share(bc.iterations, streams, i)));
+      }
+      tasks.emplace_back(
+          send_control(control, mr_buffer.data(), mr_buffer.size()));
+      co_await rdmapp::when_all(std::move(tasks));
+    } else {
+      co_await send_control(control, mr_buffer.data(), mr_buffer.size());
+    }
+
+    if (info.op == op_kind::send && info.latency) {
+      buffer other(pd, bc.size);
+      auto ping = target.mr;
+      auto pong = other.mr;
+      co_await control->recv(ping);
+      for (size_t i = 1; i < bc.iterations; ++i) {
+        co_await rdmapp::when_all(control->recv(pong), control->send(ping));
+        std::swap(ping, pong);
+      }
+      co_await control->send(ping);
+    }
+
+    uint8_t end;
+    co_await recv_control(control, &end, sizeof(end));
+  }
+}
+
+/*
+ * Run one round of cases and end it, with the quit header if it is the last.
+ */
+static rdmapp::lazy_task<std::vector<case_result>>
+drive(std::vector<std::shared_ptr<rdmapp::qp>> qps, options const &opts,
+      size_t threads, bool last) {
+  std::vector<case_result> results;
+  for (auto test : opts.tests) {
+    auto const &info = kTests[test];
+    auto sizes = info.op == op_kind::atomic ? std::vector<size_t>{kAtomicSize}
+                                            : opts.sizes;
+    auto depths = info.latency ? std::vector<size_t>{1} : opts.depths;
+    auto qp_counts = info.latency ? std::vector<size_t>{1} : opts.qps;
+    for (auto nr_qps : qp_counts) {
+      for (auto depth : depths) {
+        for (auto size : sizes) {
+          bench_case bc;
+          bc.test = test;
+          bc.size = size;
+          bc.iterations = opts.iterations + (info.latency ? opts.warmup : 0);
+          bc.depth = depth;
+          bc.qps = std::min(nr_qps, qps.size());
+          auto result = co_await run_case(qps, bc, opts.warmup);
+          result.threads = threads;
+          if (opts.format == "text") {
+            std::cerr << info.name << " size=" << size << " depth=" << depth
+                      << " qps=" << bc.qps << " threads=" << threads
+                      << " done" << std::endl;
+          }
+          results.push_back(std::move(result));
+        }
+      }
+    }
+  }
+  bench_case end = {};
+  end.test = last ? kQuitTest : kNextRoundTest;
+  auto header = end.serialize();
+  co_await send_control(qps.front(), header.data(), header.size());
+  co_return results;
+}
+
+static rdmapp::lazy_task<void>
+run_loopback(std::vector<std::shared_ptr<rdmapp::qp>> client_qps,
+             std::vector<std::shared_ptr<rdmapp::qp>> server_qps,
+             options const &opts, size_t threads, bool last,
+             std::vector<case_result> &results) {
+  auto [client_results, more] = co_await rdmapp::when_all(
+      drive(client_qps, opts, threads, last), serve(server_qps));
+  (void)more;
+  std::move(client_results.begin(), client_results.end(),
+            std::back_inserter(results));
+}
+
+static void connect_loopback(rdmapp::qp &local, rdmapp::qp &remote) {
+  auto serialized = remote.serialize();
+  auto header = rdmapp::deserialized_qp::deserialize(serialized.data()).header;
+  local.rtr(header.lid, header.qp_num, header.sq_psn, header.gid);
+  local.rts();
+}
+
+static void print_results(std::vector<case_result> const &results,
+                          std::string const &format, std::ostream &out) {
+  out << std::fixed << std::setprecision(3);
+  if (format == "csv") {
+    out << "test,size,depth,qps,threads,iterations,seconds,mops,gbps,avg_us,"
+           "p50_us,p90_us,p99_us,p999_us,max_us\n";
+    for (auto const &r : results) {
+      out << r.test << ',' << r.size << ',' << r.depth << ',' << r.qps << ','
+          << r.threads << ',' << r.iterations << ',' << r.seconds << ','
+          << r.mops << ',' << r.gbps << ',' << r.avg_us << ',' << r.p50_us
+          << ',' << r.p90_us << ',' << r.p99_us << ',' << r.p999_us << ','
+          << r.max_us << '\n';
+    }
+  } else if (format == "json") {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+      auto const &r = results[i];
+      out << "  {\"test\": \"" << r.test << "\", \"size\": " << r.size
+          << ", \"depth\": " << r.depth << ", \"qps\": " << r.qps
+          << ", \"threads\": " << r.threads
+          << ", \"iterations\": " << r.iterations
+          << ", \"seconds\": " << r.seconds << ", \"mops\": " << r.mops
+          << ", \"gbps\": " << r.gbps << ", \"avg_us\": " << r.avg_us
+          << ", \"p50_us\": " << r.p50_us << ", \"p90_us\": " << r.p90_us
+          << ", \"p99_us\": " << r.p99_us << ", \"p999_us\": " << r.p999_us
+          << ", \"max_us\": " << r.max_us << "}"
+          << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+  } else {
+    out << std::left << std::setw(11) << "test" << std::right
+        << std::setw(9) << "size" << std::setw(7) << "depth" << std::setw(5)
+        << "qps" << std::setw(8) << "threads" << std::setw(10) << "Mops"
+        << std::setw(10) << "Gbps" << std::setw(10) << "avg_us"
+        << std::setw(10) << "p50_us" << std::setw(10) << "p99_us"
+        << std::setw(10) << "p999_us" << std::setw(10) << "max_us" << "\n";
+    for (auto const &r : results) {
+      out << std::left << std::setw(11) << r.test << std::right
+          << std::setw(9) << r.size << std::setw(7) << r.depth << std::setw(5)
+          << r.qps << std::setw(8) << r.threads << std::setw(10) << r.mops
+          << std::setw(10) << r.gbps;
+      if (r.test.ends_with("_lat")) {
+        out << std::setw(10) << r.avg_us << std::setw(10) << r.p50_us
+            << std::setw(10) << r.p99_us << std::setw(10) << r.p999_us
+            << std::setw(10) << r.max_us;
+      }
+      out << "\n";
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  options opts;
+  try {
+    opts = parse_options(argc, argv);
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+  auto const max_qps = *std::max_element(opts.qps.begin(), opts.qps.end());
+  auto const max_depth =
+      *std::max_element(opts.depths.begin(), opts.depths.end());
+  auto const cq_size =
+      std::max<size_t>(128, 2 * max_qps * (max_depth + 2) + 16);
+
+  auto device = std::make_shared<rdmapp::device>(opts.device, opts.ib_port);
+  auto pd = std::make_shared<rdmapp::pd>(device);
+  auto cq = std::make_shared<rdmapp::cq>(device, cq_size);
+  rdmapp::stats_registry registry;
+  std::shared_ptr<rdmapp::executor> executor;
+  std::shared_ptr<rdmapp::cq_poller> cq_poller;
+  // Each round gets a fresh executor and poller with its number of workers.
+  // The Queue Pairs stay on the same completion queue, which is idle between
+  // rounds. The server keeps the last count once its list runs out.
+  auto start_round = [&](size_t round) {
+    auto threads = opts.threads[std::min(round, opts.threads.size() - 1)];
+    cq_poller.reset();
+    executor.reset();
+    executor = std::make_shared<rdmapp::executor>(threads);
+    cq_poller = std::make_shared<rdmapp::cq_poller>(cq, executor);
+    registry.add("cq", cq_poller);
+    return threads;
+  };
+  auto threads = start_round(0);
+  // Dumped after each round while the Queue Pairs and the round's poller are
+  // alive; the registry only holds weak references to them.
+  auto dump_stats = [&]() {
+    if (opts.stats) {
+      std::cerr << registry.snapshot().to_prometheus();
+    }
+  };
+
+  std::vector<case_result> results;
+  if (!opts.server && !opts.host) {
+    std::vector<std::shared_ptr<rdmapp::qp>> client_qps;
+    std::vector<std::shared_ptr<rdmapp::qp>> server_qps;
+    for (size_t i = 0; i < max_qps; ++i) {
+      auto client_qp = std::make_shared<rdmapp::qp>(pd, cq);
+      auto server_qp = std::make_shared<rdmapp::qp>(pd, cq);
+      connect_loopback(*client_qp, *server_qp);
+      connect_loopback(*server_qp, *client_qp);
+      client_qps.push_back(client_qp);
+      server_qps.push_back(server_qp);
+      registry.add(client_qp);
+      registry.add(server_qp);
+    }
+    for (size_t round = 0; round < opts.threads.size(); ++round) {
+      if (round > 0) {
+        threads = start_round(round);
+      }
+      auto last = round + 1 == opts.threads.size();
+      rdmapp::sync_wait(
+          run_loopback(client_qps, server_qps, opts, threads, last, results));
+      dump_stats();
+    }
+  } else {
+    auto loop = rdmapp::socket::event_loop::new_loop();
+    auto looper = std::thread([loop]() { loop->loop(); });
+    if (opts.server) {
+      rdmapp::acceptor acceptor(loop, opts.port, pd, cq);
+      auto accept = acceptor.accept_many();
+      auto qps = rdmapp::sync_wait(accept);
+      for (auto const &qp : qps) {
+        registry.add(qp);
+      }
+      for (size_t round = 0;; ++round) {
+        if (round > 0) {
+          threads = start_round(round);
+        }
+        auto more = rdmapp::sync_wait(serve(qps));
+        dump_stats();
+        if (!more) {
+          break;
+        }
+      }
+    } else {
+      rdmapp::connector connector(loop, *opts.host, opts.port, pd, cq);
+      auto connect = connector.connect_many(max_qps);
+      auto qps = rdmapp::sync_wait(connect);
+      for (auto const &qp : qps) {
+        registry.add(qp);
+      }
+      for (size_t round = 0; round < opts.threads.size(); ++round) {
+        if (round > 0) {
+          threads = start_round(round);
+        }
+        auto last = round + 1 == opts.threads.size();
+        auto round_results = rdmapp::sync_wait(drive(qps, opts, threads, last));
+        std::move(round_results.begin(), round_results.end(),
+                  std::back_inserter(results));
+        dump_stats();
+      }
+    }
+    loop->close();
+    looper.join();
+  }
+
+  if (opts.server) {
+    return 0;
+  }
+  if (opts.output) {
+    std::ofstream out(*opts.output);
+    print_results(results, opts.format, out);
+  } else {
+    print_results(results, opts.format, std::cout);
+  }
+  return 0;
+}
@@ -21,7 +21,7 @@ constexpr size_t kPrintInterval = 1024;
 constexpr size_t kTotalSizeBytes = kBufferSizeBytes * kSendCount * kWorkerCount;
 
 template <bool Client = false>
-rdmapp::task<void> worker(size_t id, std::shared_ptr<rdmapp::qp> qp) {
+rdmapp::lazy_task<void> worker(size_t id, std::shared_ptr<rdmapp::qp> qp) {
   std::vector<uint8_t> buffer;
   buffer.resize(kBufferSizeBytes);
   auto local_mr = std::make_shared<rdmapp::local_mr>(
@@ -44,16 +44,12 @@ rdmapp::task<void> worker(size_t id, std::shared_ptr<rdmapp::qp> qp) {
 
 template <bool Client = false>
 rdmapp::task<void> handler(std::shared_ptr<rdmapp::qp> qp) {
-  std::vector<std::future<void> *> futures;
+  std::vector<rdmapp::lazy_task<void>> workers;
   for (size_t i = 0; i < kWorkerCount; ++i) {
-    auto task = worker<Client>(i, qp);
-    futures.emplace_back(&task.get_future());
-    task.detach();
+    workers.emplace_back(worker<Client>(i, qp));
   }
   auto tik = std::chrono::high_resolution_clock::now();
-  for (auto fut : futures) {
-    fut->get();
-  }
+  co_await rdmapp::when_all(std::move(workers));
   auto tok = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> seconds = tok - tik;
   double mb = static_cast<double>(kTotalSizeBytes) / 1024 / 1024;
@@ -0,0 +1,121 @@
+#include "acceptor.h"
+#include "connector.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rdmapp/rdmapp.h>
+
+constexpr size_t kBufferSizeBytes = 1024 * 1024 * 1024; // 1 GB
+constexpr size_t kQpsPerDevice = 4;
+constexpr size_t kRounds = 16;
+
+rdmapp::task<void> server(rdmapp::acceptor &acceptor) {
+  std::vector<std::shared_ptr<rdmapp::qp>> qps;
+  qps.emplace_back(co_await acceptor.accept());
+  uint64_t nr_qps = 0;
+  co_await qps[0]->recv(&nr_qps, sizeof(nr_qps));
+  for (size_t i = 1; i < nr_qps; ++i) {
+    qps.emplace_back(co_await acceptor.accept());
+  }
+  std::vector<uint8_t> buffer(kBufferSizeBytes);
+  auto local_mr = std::make_shared<rdmapp::local_mr>(
+      qps[0]->pd_ptr()->reg_mr(&buffer[0], buffer.size()));
+  auto local_mr_serialized = local_mr->serialize();
+  co_await qps[0]->send(local_mr_serialized.data(),
+                        local_mr_serialized.size());
+  std::cout << "Sent mr addr=" << local_mr->addr()
+            << " length=" << local_mr->length() << " rkey=" << local_mr->rkey()
+            << " to client over " << nr_qps << " qps" << std::endl;
+  co_await qps[0]->recv(local_mr_serialized.data(),
+                        local_mr_serialized.size());
+  std::cout << "Client finished" << std::endl;
+  co_return;
+}
+
+rdmapp::task<void> client(std::vector<rdmapp::connector> &connectors) {
+  std::vector<std::shared_ptr<rdmapp::qp>> qps;
+  qps.emplace_back(co_await connectors[0].connect());
+  uint64_t nr_qps = connectors.size() * kQpsPerDevice;
+  co_await qps[0]->send(&nr_qps, sizeof(nr_qps));
+  while (qps.size() < nr_qps) {
+    qps.emplace_back(co_await connectors[qps.size() / kQpsPerDevice].connect());
+  }
+  char remote_mr_serialized[rdmapp::remote_mr::kSerializedSize];
+  co_await qps[0]->recv(remote_mr_serialized, sizeof(remote_mr_serialized));
+  auto remote_mr = rdmapp::remote_mr::deserialize(remote_mr_serialized);
+
+  // Queue Pairs on different devices need their own registrations of the same
+  // buffer.
+  std::vector<uint8_t> buffer(kBufferSizeBytes);
+  std::vector<std::shared_ptr<rdmapp::local_mr>> local_mrs;
+  for (size_t i = 0; i < qps.size(); ++i) {
+    if (i % kQpsPerDevice == 0) {
+      local_mrs.emplace_back(std::make_shared<rdmapp::local_mr>(
+          qps[i]->pd_ptr()->reg_mr(&buffer[0], buffer.size())));
+    } else {
+      local_mrs.emplace_back(local_mrs.back());
+    }
+  }
+  std::vector<rdmapp::remote_mr> remote_mrs(qps.size(), remote_mr);
+  rdmapp::striped_qp striped(qps);
+
+  auto tik = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < kRounds; ++i) {
+    co_await striped.write_bulk(remote_mrs, local_mrs);
+  }
+  auto tok = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> seconds = tok - tik;
+  double mb = static_cast<double>(kBufferSizeBytes) * kRounds / 1024 / 1024;
+  std::cout << "QPs: " << qps.size() << ", Total: " << mb
+            << " MB, Elapsed: " << seconds.count()
+            << " s, Throughput: " << mb / seconds.count() << " MB/s"
+            << std::endl;
+  co_await qps[0]->send(remote_mr_serialized, sizeof(remote_mr_serialized));
+  co_return;
+}
+
+int main(int argc, char *argv[]) {
+  auto loop = rdmapp::socket::event_loop::new_loop();
+  auto looper = std::thread([loop]() { loop->loop(); });
+  if (argc == 2) {
+    auto device = std::make_shared<rdmapp::device>(0, 1);
+    auto pd = std::make_shared<rdmapp::pd>(device);
+    auto cq = std::make_shared<rdmapp::cq>(device);
+    auto cq_poller = std::make_shared<rdmapp::cq_poller>(cq);
+    rdmapp::acceptor acceptor(loop, std::stoi(argv[1]), pd, cq);
+    server(acceptor);
+  } else if (argc >= 3) {
+    // Every extra argument names a device to stripe over, defaulting to the
+    // first one.
+    std::vector<uint16_t> device_nums;
+    for (int i = 3; i < argc; ++i) {
+      device_nums.push_back(std::stoi(argv[i]));
+    }
+    if (device_nums.empty()) {
+      device_nums.push_back(0);
+    }
+    auto executor = std::make_shared<rdmapp::executor>();
+    std::vector<std::shared_ptr<rdmapp::cq_poller>> pollers;
+    std::vector<rdmapp::connector> connectors;
+    connectors.reserve(device_nums.size());
+    for (auto device_num : device_nums) {
+      auto device = std::make_shared<rdmapp::device>(device_num, 1);
+      auto pd = std::make_shared<rdmapp::pd>(device);
+      auto cq = std::make_shared<rdmapp::cq>(device);
+      pollers.emplace_back(std::make_shared<rdmapp::cq_poller>(cq, executor));
+      connectors.emplace_back(loop, argv[1], std::stoi(argv[2]), pd, cq);
+    }
+    client(connectors);
+  } else {
+    std::cout << "Usage: " << argv[0] << " [port] for server and " << argv[0]
+              << " [server_ip] [port] [device_num...] for client" << std::endl;
+  }
+  loop->close();
+  looper.join();
+  return 0;
+}
@@ -23,6 +23,7 @@ class cq : public noncopyable {
   std::shared_ptr<device> device_;
   struct ibv_cq *cq_;
   friend class qp;
+  friend class ud_qp;
 
 public:
   /**
@@ -1,14 +1,21 @@
 #pragma once
 
+#include <array>
 #include <atomic>
+#include <coroutine>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include <infiniband/verbs.h>
 
 #include "rdmapp/cq.h"
 #include "rdmapp/executor.h"
+#include "rdmapp/stats.h"
+
+#include "rdmapp/detail/counter.h"
 
 namespace rdmapp {
 
@@ -19,10 +26,26 @@ namespace rdmapp {
 class cq_poller {
   std::shared_ptr<cq> cq_;
   std::atomic<bool> stopped_;
-  std::thread poller_thread_;
   std::shared_ptr<executor> executor_;
   std::vector<struct ibv_wc> wc_vec_;
+
+  // Written only by the poller thread.
+  detail::counter polls_;
+  detail::counter empty_polls_;
+  std::array<detail::counter, cq_stats::kNrOpcodes> completions_;
+  std::array<detail::counter, cq_stats::kNrOpcodes> completion_bytes_;
+  std::array<detail::counter, cq_stats::kNrStatuses> errors_;
+
+  std::mutex posted_mutex_;
+  std::vector<std::function<void()>> posted_;
+  std::atomic<bool> has_posted_;
+  bool posted_closed_;
+
+  // Started last, once everything it uses is initialized.
+  std::thread poller_thread_;
   void worker();
+  void count(struct ibv_wc const &wc);
+  void run_posted(bool close);
 
 public:
   /**
@@ -43,7 +66,54 @@ public:
   cq_poller(std::shared_ptr<cq> cq, std::shared_ptr<executor> executor,
             size_t batch_size = 16);
 
+  /**
+   * @brief Take a snapshot of the counters of the poller. The counters are
+   * updated without synchronization, so a snapshot may be slightly behind the
+   * poller thread.
+   *
+   * @return cq_stats The counters.
+   */
+  cq_stats stats() const;
+
+  /**
+   * @brief Run a function on the poller thread between two polls. It should
+   * be short, as completions are not polled while it runs.
+   *
+   * @param fn The function to run.
+   */
+  void post(std::function<void()> fn);
+
+  /**
+   * @brief This awaitable resumes the awaiting coroutine on the poller thread.
+   *
+   */
+  class schedule_awaitable {
+    cq_poller &poller_;
+
+  public:
+    explicit schedule_awaitable(cq_poller &poller);
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() const noexcept;
+  };
+
+  /**
+   * @brief Move the awaiting coroutine to the poller thread, e.g. to post the
+   * next work request right where completions are polled.
+   *
+   * @return schedule_awaitable An awaitable to be `co_await`ed.
+   */
+  [[nodiscard]] schedule_awaitable schedule();
+
   ~cq_poller();
 };
 
+/**
+ * @brief Move the awaiting coroutine to the thread of a cq poller.
+ *
+ * @param poller The poller to resume on.
+ * @return cq_poller::schedule_awaitable An awaitable to be `co_await`ed.
+ */
+[[nodiscard]] cq_poller::schedule_awaitable schedule_on(cq_poller &poller);
+
 } // namespace rdmapp
\ No newline at end of file
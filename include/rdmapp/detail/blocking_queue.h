@@ -12,7 +12,7 @@ template <class T> class blocking_queue {
   std::mutex mutex_;
   std::condition_variable cv_;
   std::queue<T> queue_;
-  bool closed_;
+  bool closed_ = false;
 
 public:
   struct queue_closed_error {};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace rdmapp {
+namespace detail {
+
+/**
+ * @brief A statistics counter that only its owner thread increments. An
+ * increment is a relaxed load and store instead of a locked read-modify-write,
+ * so it costs as much as a plain add, while any thread may read the counter.
+ *
+ */
+class counter {
+  std::atomic<uint64_t> value_ = 0;
+
+public:
+  void add(uint64_t n = 1) noexcept {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+
+  uint64_t load() const noexcept {
+    return value_.load(std::memory_order_relaxed);
+  }
+};
+
+} // namespace detail
+} // namespace rdmapp
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <endian.h>
 #include <netinet/in.h>
+#include <span>
 #include <type_traits>
 
 #include <infiniband/verbs.h>
@@ -59,5 +62,69 @@ deserialize(It &it, T &value) {
   it += sizeof(T);
 }
 
+/**
+ * @brief The number of bytes the given fields occupy when packed back to back.
+ *
+ */
+template <class... Ts>
+inline constexpr size_t packed_size = (sizeof(Ts) + ... + size_t(0));
+
+template <class T>
+inline constexpr bool is_packable_v =
+    std::is_integral<T>::value || std::is_same<T, union ibv_gid>::value;
+
+/**
+ * @brief Store a field at the given position in network byte order.
+ *
+ */
+template <class T> inline void store(uint8_t *dst, T const &value) {
+  static_assert(is_packable_v<T>, "unsupported field type");
+  if constexpr (std::is_integral<T>::value && sizeof(T) > 1) {
+    T nvalue = hton(value);
+    std::memcpy(dst, &nvalue, sizeof(T));
+  } else {
+    std::memcpy(dst, &value, sizeof(T));
+  }
+}
+
+/**
+ * @brief Load a field stored by `store`.
+ *
+ */
+template <class T> inline void load(uint8_t const *src, T &value) {
+  static_assert(is_packable_v<T>, "unsupported field type");
+  std::memcpy(&value, src, sizeof(T));
+  if constexpr (std::is_integral<T>::value && sizeof(T) > 1) {
+    value = ntoh(value);
+  }
+}
+
+/**
+ * @brief Encode fields back to back into a buffer whose size is checked at
+ * compile time. Nothing is allocated.
+ *
+ * @param out The buffer, exactly as large as the packed fields.
+ * @param values The fields.
+ */
+template <class... Ts>
+inline void pack(std::span<uint8_t, packed_size<Ts...>> out,
+                 Ts const &...values) {
+  size_t offset = 0;
+  ((store(out.data() + offset, values), offset += sizeof(Ts)), ...);
+}
+
+/**
+ * @brief Decode fields encoded by `pack`.
+ *
+ * @param in The buffer, exactly as large as the packed fields.
+ * @param values The fields to decode into.
+ */
+template <class... Ts>
+inline void unpack(std::span<uint8_t const, packed_size<Ts...>> in,
+                   Ts &...values) {
+  size_t offset = 0;
+  ((load(in.data() + offset, values), offset += sizeof(Ts)), ...);
+}
+
 } // namespace detail
 } // namespace rdmapp
\ No newline at end of file
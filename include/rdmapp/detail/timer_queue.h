@@ -0,0 +1,122 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "rdmapp/detail/noncopyable.h"
+
+namespace rdmapp {
+namespace detail {
+
+/**
+ * @brief A single thread that runs callbacks at their deadlines. It is used
+ * for operation timeouts, so callbacks must be short and must not block.
+ *
+ */
+class timer_queue : public noncopyable {
+public:
+  using clock = std::chrono::steady_clock;
+  using timer_id = uint64_t;
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::map<std::pair<clock::time_point, timer_id>, std::function<void()>>
+      timers_;
+  std::unordered_map<timer_id, clock::time_point> deadlines_;
+  timer_id next_id_ = 1;
+  bool stopped_ = false;
+  std::thread thread_;
+
+  void worker() {
+    std::unique_lock lock(mutex_);
+    while (!stopped_) {
+      if (timers_.empty()) {
+        cv_.wait(lock);
+        continue;
+      }
+      auto it = timers_.begin();
+      if (clock::now() < it->first.first) {
+        cv_.wait_until(lock, it->first.first);
+        continue;
+      }
+      auto fn = std::move(it->second);
+      deadlines_.erase(it->first.second);
+      timers_.erase(it);
+      lock.unlock();
+      fn();
+      lock.lock();
+    }
+  }
+
+public:
+  timer_queue() : thread_(&timer_queue::worker, this) {}
+
+  /**
+   * @brief Get the process-wide timer queue. Its thread is started on first
+   * use.
+   *
+   * @return timer_queue& The timer queue.
+   */
+  static timer_queue &instance() {
+    static timer_queue queue;
+    return queue;
+  }
+
+  /**
+   * @brief Schedule a callback.
+   *
+   * @param deadline When to run the callback.
+   * @param fn The callback.
+   * @return timer_id An identifier to cancel the callback with.
+   */
+  timer_id schedule(clock::time_point deadline, std::function<void()> fn) {
+    std::lock_guard lock(mutex_);
+    auto id = next_id_++;
+    auto it =
+        timers_.emplace(std::make_pair(deadline, id), std::move(fn)).first;
+    deadlines_.emplace(id, deadline);
+    if (it == timers_.begin()) {
+      cv_.notify_one();
+    }
+    return id;
+  }
+
+  /**
+   * @brief Cancel a callback. A callback that is already running is not
+   * waited for.
+   *
+   * @param id The identifier returned by `schedule`.
+   * @return true The callback was cancelled before it ran.
+   * @return false The callback has already run or is running.
+   */
+  bool cancel(timer_id id) {
+    std::lock_guard lock(mutex_);
+    auto it = deadlines_.find(id);
+    if (it == deadlines_.end()) {
+      return false;
+    }
+    timers_.erase(std::make_pair(it->second, id));
+    deadlines_.erase(it);
+    return true;
+  }
+
+  ~timer_queue() {
+    {
+      std::lock_guard lock(mutex_);
+      stopped_ = true;
+      cv_.notify_one();
+    }
+    thread_.join();
+  }
+};
+
+} // namespace detail
+} // namespace rdmapp
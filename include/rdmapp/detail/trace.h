@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/trace.h"
+
+/*
+ * RDMAPP_TRACE(event, wr_id, qp_num, opcode, status) emits a trace event. The
+ * build selects what it expands to:
+ *
+ *   RDMAPP_TRACE_USDT   a USDT probe rdmapp:<event> with the four values as
+ *                       arguments; bpftrace supplies the timestamps.
+ *   RDMAPP_TRACE_HOOKS  a call of the installed `trace_hook`, if any.
+ *   neither             nothing; the arguments are not evaluated.
+ */
+
+#if defined(RDMAPP_TRACE_USDT)
+
+#include <sys/sdt.h>
+
+#define RDMAPP_TRACE_ENABLED 1
+#define RDMAPP_TRACE(event, wr_id, qp_num, opcode, status)                     \
+  DTRACE_PROBE4(rdmapp, event, static_cast<uint64_t>(wr_id),                   \
+                static_cast<uint32_t>(qp_num), static_cast<uint32_t>(opcode),  \
+                static_cast<uint32_t>(status))
+
+#elif defined(RDMAPP_TRACE_HOOKS)
+
+namespace rdmapp {
+namespace detail {
+
+extern std::atomic<trace_hook> current_trace_hook;
+
+inline void emit_trace(trace_event event, uint64_t wr_id, uint32_t qp_num,
+                       uint32_t opcode, uint32_t status) {
+  auto hook = current_trace_hook.load(std::memory_order_acquire);
+  if (hook == nullptr) [[likely]] {
+    return;
+  }
+  auto const now = std::chrono::steady_clock::now().time_since_epoch();
+  hook(trace_record{
+      event, wr_id, qp_num, opcode, status,
+      static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(now).count())});
+}
+
+} // namespace detail
+} // namespace rdmapp
+
+#define RDMAPP_TRACE_ENABLED 1
+#define RDMAPP_TRACE(event, wr_id, qp_num, opcode, status)                     \
+  ::rdmapp::detail::emit_trace(::rdmapp::trace_event::event,                   \
+                               static_cast<uint64_t>(wr_id),                   \
+                               static_cast<uint32_t>(qp_num),                  \
+                               static_cast<uint32_t>(opcode),                  \
+                               static_cast<uint32_t>(status))
+
+#else
+
+#define RDMAPP_TRACE_ENABLED 0
+#define RDMAPP_TRACE(event, wr_id, qp_num, opcode, status)                     \
+  do {                                                                         \
+  } while (0)
+
+#endif
+
+namespace rdmapp {
+namespace detail {
+
+/**
+ * @brief Trace every work request of a send chain.
+ *
+ */
+inline void trace_post_send([[maybe_unused]] uint32_t qp_num,
+                            [[maybe_unused]] struct ibv_send_wr const *wr) {
+#if RDMAPP_TRACE_ENABLED
+  for (; wr != nullptr; wr = wr->next) {
+    RDMAPP_TRACE(post_send, wr->wr_id, qp_num, wr->opcode, 0);
+  }
+#endif
+}
+
+/**
+ * @brief Trace every work request of a receive chain.
+ *
+ */
+inline void trace_post_recv([[maybe_unused]] uint32_t qp_num,
+                            [[maybe_unused]] struct ibv_recv_wr const *wr) {
+#if RDMAPP_TRACE_ENABLED
+  for (; wr != nullptr; wr = wr->next) {
+    RDMAPP_TRACE(post_recv, wr->wr_id, qp_num, 0, 0);
+  }
+#endif
+}
+
+} // namespace detail
+} // namespace rdmapp
+
+/*
+ * Trace a work completion at one of the completion events.
+ */
+#define RDMAPP_TRACE_WC(event, wc)                                             \
+  RDMAPP_TRACE(event, (wc).wr_id, (wc).qp_num, (wc).opcode, (wc).status)
@@ -58,6 +58,8 @@ class device : public noncopyable {
   friend class cq;
   friend class qp;
   friend class srq;
+  friend class ud_qp;
+  friend class address_handle;
   void open_device(struct ibv_device *target, uint16_t port_num);
 
 public:
@@ -85,6 +87,13 @@ public:
    */
   device(uint16_t device_num = 0, uint16_t port_num = 1);
 
+  /**
+   * @brief Get the name of the device.
+   *
+   * @return std::string The name, e.g. mlx5_0.
+   */
+  std::string name() const;
+
   /**
    * @brief Get the device port number.
    *
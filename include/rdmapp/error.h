@@ -11,6 +11,46 @@ namespace rdmapp {
 
 constexpr size_t kErrorStringBufferSize = 1024;
 
+/**
+ * @brief Thrown by an awaitable whose operation was cancelled through its stop
+ * token before it completed.
+ *
+ */
+class operation_cancelled : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Thrown by an awaitable whose operation did not complete before its
+ * deadline.
+ *
+ */
+class operation_timed_out : public operation_cancelled {
+public:
+  using operation_cancelled::operation_cancelled;
+};
+
+/**
+ * @brief Thrown when a verbs or system call fails. It carries the return code
+ * or errno of the call.
+ *
+ */
+class verbs_error : public std::runtime_error {
+  int code_;
+
+public:
+  verbs_error(const char *message, int code)
+      : std::runtime_error(message), code_(code) {}
+
+  /**
+   * @brief Get the error code.
+   *
+   * @return int The return code or errno of the failed call.
+   */
+  int code() const noexcept { return code_; }
+};
+
 static inline void throw_with(const char *message) {
   throw std::runtime_error(message);
 }
@@ -22,9 +62,17 @@ static inline void throw_with(const char *format, Args... args) {
   throw std::runtime_error(buffer);
 }
 
+template <class... Args>
+static inline void throw_verbs_error(int code, const char *format,
+                                     Args... args) {
+  char buffer[kErrorStringBufferSize];
+  ::snprintf(buffer, sizeof(buffer), format, args...);
+  throw verbs_error(buffer, code);
+}
+
 static inline void check_rc(int rc, const char *message) {
   if (rc != 0) [[unlikely]] {
-    throw_with("%s: %s (rc=%d)", message, ::strerror(rc), rc);
+    throw_verbs_error(rc, "%s: %s (rc=%d)", message, ::strerror(rc), rc);
   }
 }
 
@@ -89,13 +137,15 @@ static inline void check_wc_status(enum ibv_wc_status status,
 }
 static inline void check_ptr(void *ptr, const char *message) {
   if (ptr == nullptr) [[unlikely]] {
-    throw_with("%s: %s (errno=%d)", message, ::strerror(errno), errno);
+    throw_verbs_error(errno, "%s: %s (errno=%d)", message, ::strerror(errno),
+                      errno);
   }
 }
 
 static inline void check_errno(int rc, const char *message) {
   if (rc < 0) [[unlikely]] {
-    throw_with("%s: %s (errno=%d)", message, ::strerror(errno), errno);
+    throw_verbs_error(errno, "%s: %s (errno=%d)", message, ::strerror(errno),
+                      errno);
   }
 }
 
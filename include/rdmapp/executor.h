@@ -1,5 +1,6 @@
 #pragma once
 
+#include <coroutine>
 #include <functional>
 #include <thread>
 #include <vector>
@@ -39,6 +40,45 @@ public:
    */
   void process_wc(struct ibv_wc const &wc);
 
+  /**
+   * @brief Run a function on one of the executor's workers. It is queued
+   * behind the completion entries already waiting.
+   *
+   * @param fn The function to run.
+   */
+  void post(std::function<void()> fn);
+
+  /**
+   * @brief This awaitable resumes the awaiting coroutine on one of the
+   * executor's workers.
+   *
+   */
+  class schedule_awaitable {
+    executor &executor_;
+
+  public:
+    explicit schedule_awaitable(executor &executor);
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() const noexcept;
+  };
+
+  /**
+   * @brief Move the awaiting coroutine to this executor, e.g. to take
+   * CPU-heavy processing off the threads that drain completions.
+   *
+   * @return schedule_awaitable An awaitable to be `co_await`ed.
+   */
+  [[nodiscard]] schedule_awaitable schedule();
+
+  /**
+   * @brief Get the executor whose worker is running the calling thread.
+   *
+   * @return executor* The executor, or nullptr if the calling thread is not
+   * an executor worker.
+   */
+  static executor *current();
+
   /**
    * @brief Shutdown the executor.
    *
@@ -59,6 +99,19 @@ public:
     return new executor::callback_fn(cb);
   }
 
+  /**
+   * @brief Make the wr_id of an unsignaled work request whose failure is
+   * recorded instead of dropped. `process_wc` stores the status of its error
+   * completion in the slot on the polling thread, before the completions
+   * polled after it are queued, and keeps the first status that is not a
+   * flush error. The slot must live until the signaled work request behind it
+   * completes.
+   *
+   * @param slot The status slot, set to IBV_WC_SUCCESS beforehand.
+   * @return uint64_t The wr_id.
+   */
+  static uint64_t make_status_wr_id(enum ibv_wc_status *slot);
+
   /**
    * @brief Destroy a callback function.
    *
@@ -67,4 +120,35 @@ public:
   static void destroy_callback(callback_ptr cb);
 };
 
+/**
+ * @brief Move the awaiting coroutine to an executor.
+ *
+ * @param executor The executor to resume on.
+ * @return executor::schedule_awaitable An awaitable to be `co_await`ed.
+ */
+[[nodiscard]] executor::schedule_awaitable schedule_on(executor &executor);
+
+/**
+ * @brief This awaitable re-queues the awaiting coroutine behind the work
+ * already waiting on the current executor, so that a long-running coroutine
+ * lets completions be processed. It does nothing outside executor workers.
+ *
+ */
+class yield_awaitable {
+  executor *executor_;
+
+public:
+  yield_awaitable();
+  bool await_ready() const noexcept;
+  void await_suspend(std::coroutine_handle<> h);
+  void await_resume() const noexcept;
+};
+
+/**
+ * @brief Let other work on the current executor run before continuing.
+ *
+ * @return yield_awaitable An awaitable to be `co_await`ed.
+ */
+[[nodiscard]] yield_awaitable yield();
+
 } // namespace rdmapp
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace rdmapp {
+
+/**
+ * @brief Statistics of coroutine frame allocations, summed over all threads.
+ *
+ */
+struct frame_stats {
+  /**
+   * @brief Frames are rounded up to a multiple of this size. Frames of the
+   * same size class share a free list.
+   *
+   */
+  static constexpr size_t kSizeClassBytes = 64;
+
+  /**
+   * @brief The number of size classes. Larger frames are not pooled.
+   *
+   */
+  static constexpr size_t kSizeClasses = 32;
+
+  uint64_t allocations = 0;
+  uint64_t deallocations = 0;
+
+  /**
+   * @brief Allocations served from a thread's free list without calling the
+   * global allocator.
+   *
+   */
+  uint64_t pool_hits = 0;
+
+  /**
+   * @brief Allocations larger than the largest size class.
+   *
+   */
+  uint64_t oversized = 0;
+
+  size_t max_frame_size = 0;
+
+  /**
+   * @brief The number of allocations in each size class, i.e. a histogram of
+   * frame sizes with a bucket width of `kSizeClassBytes`.
+   *
+   */
+  std::array<uint64_t, kSizeClasses> size_class_allocations{};
+};
+
+/**
+ * @brief Get the coroutine frame allocation statistics.
+ *
+ * @return frame_stats The statistics of all live and exited threads.
+ */
+frame_stats get_frame_stats();
+
+namespace detail {
+
+/**
+ * @brief Allocate a coroutine frame from the free list of the calling thread.
+ *
+ * @param size The frame size.
+ * @return void* The frame.
+ */
+void *allocate_frame(size_t size);
+
+/**
+ * @brief Return a coroutine frame to the free list of the calling thread,
+ * which need not be the thread that allocated it.
+ *
+ * @param frame The frame.
+ * @param size The frame size, as passed to `allocate_frame`.
+ */
+void deallocate_frame(void *frame, size_t size) noexcept;
+
+/**
+ * @brief Promise types inherit from this class to allocate their coroutine
+ * frames from the per-thread frame pools.
+ *
+ */
+struct pooled_frame {
+  static void *operator new(size_t size) { return allocate_frame(size); }
+  static void operator delete(void *frame, size_t size) noexcept {
+    deallocate_frame(frame, size);
+  }
+};
+
+} // namespace detail
+
+} // namespace rdmapp
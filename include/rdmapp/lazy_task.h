@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cassert>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "rdmapp/frame_allocator.h"
+
+namespace rdmapp {
+
+template <class T = void> class lazy_task;
+
+namespace detail {
+
+/**
+ * @brief The part of the promise shared by all result types. It holds the
+ * continuation, which is resumed through symmetric transfer once the task
+ * completes, and the detached flag.
+ *
+ */
+class lazy_promise_base : public pooled_frame {
+public:
+  std::coroutine_handle<> continuation_;
+  bool detached_ = false;
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  template <class Promise> struct final_awaiter {
+    bool await_ready() noexcept { return false; }
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<Promise> h) noexcept {
+      auto &promise = h.promise();
+      if (promise.detached_) {
+        h.destroy();
+        return std::noop_coroutine();
+      }
+      if (promise.continuation_) {
+        return promise.continuation_;
+      }
+      return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+};
+
+template <class T> class lazy_promise : public lazy_promise_base {
+  std::variant<std::monostate, T, std::exception_ptr> result_;
+
+public:
+  lazy_task<T> get_return_object() noexcept;
+
+  auto final_suspend() noexcept { return final_awaiter<lazy_promise<T>>{}; }
+
+  template <class U>
+    requires std::is_convertible_v<U &&, T>
+  void return_value(U &&value) noexcept(
+      std::is_nothrow_constructible_v<T, U &&>) {
+    result_.template emplace<1>(std::forward<U>(value));
+  }
+
+  void unhandled_exception() noexcept {
+    result_.template emplace<2>(std::current_exception());
+  }
+
+  T result() {
+    if (result_.index() == 2) [[unlikely]] {
+      std::rethrow_exception(std::get<2>(result_));
+    }
+    assert(result_.index() == 1);
+    return std::move(std::get<1>(result_));
+  }
+};
+
+template <> class lazy_promise<void> : public lazy_promise_base {
+  std::exception_ptr exception_;
+
+public:
+  lazy_task<void> get_return_object() noexcept;
+
+  auto final_suspend() noexcept {
+    return final_awaiter<lazy_promise<void>>{};
+  }
+
+  void return_void() noexcept {}
+
+  void unhandled_exception() noexcept {
+    exception_ = std::current_exception();
+  }
+
+  void result() {
+    if (exception_) [[unlikely]] {
+      std::rethrow_exception(exception_);
+    }
+  }
+};
+
+} // namespace detail
+
+/**
+ * @brief A coroutine task that stores its result or exception inline in the
+ * coroutine frame. Unlike `task`, it does not allocate a shared state, it
+ * starts only when awaited and it resumes its awaiter through symmetric
+ * transfer. Destroying an unfinished task does not block; use `sync_wait` to
+ * block on a result or `detach` to run it in the background.
+ *
+ * @tparam T The result type.
+ */
+template <class T> class [[nodiscard]] lazy_task {
+public:
+  using promise_type = detail::lazy_promise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+private:
+  handle_type h_;
+
+public:
+  struct awaiter {
+    handle_type h_;
+    bool await_ready() const noexcept { return h_.done(); }
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> awaiting) noexcept {
+      h_.promise().continuation_ = awaiting;
+      return h_;
+    }
+    T await_resume() { return h_.promise().result(); }
+  };
+
+  explicit lazy_task(handle_type h) noexcept : h_(h) {}
+
+  lazy_task(lazy_task &&other) noexcept : h_(std::exchange(other.h_, {})) {}
+
+  lazy_task &operator=(lazy_task &&other) noexcept {
+    if (this != &other) {
+      if (h_) {
+        h_.destroy();
+      }
+      h_ = std::exchange(other.h_, {});
+    }
+    return *this;
+  }
+
+  lazy_task(lazy_task const &) = delete;
+  lazy_task &operator=(lazy_task const &) = delete;
+
+  ~lazy_task() {
+    if (h_) {
+      h_.destroy();
+    }
+  }
+
+  awaiter operator co_await() const noexcept {
+    assert(h_);
+    return awaiter{h_};
+  }
+
+  /**
+   * @brief Start the task and let it destroy itself once it completes. As with
+   * `task::detach`, an exception escaping a detached task is dropped.
+   *
+   */
+  void detach() {
+    assert(h_);
+    auto h = std::exchange(h_, {});
+    h.promise().detached_ = true;
+    h.resume();
+  }
+
+  /**
+   * @brief Check whether the task has completed.
+   *
+   * @return true The task has completed.
+   * @return false The task has not started or is suspended.
+   */
+  bool done() const noexcept { return !h_ || h_.done(); }
+};
+
+namespace detail {
+
+template <class T>
+lazy_task<T> lazy_promise<T>::get_return_object() noexcept {
+  return lazy_task<T>(
+      std::coroutine_handle<lazy_promise<T>>::from_promise(*this));
+}
+
+inline lazy_task<void> lazy_promise<void>::get_return_object() noexcept {
+  return lazy_task<void>(
+      std::coroutine_handle<lazy_promise<void>>::from_promise(*this));
+}
+
+template <class Awaitable> decltype(auto) get_awaiter(Awaitable &&awaitable) {
+  if constexpr (requires {
+                  std::forward<Awaitable>(awaitable).operator co_await();
+                }) {
+    return std::forward<Awaitable>(awaitable).operator co_await();
+  } else {
+    return std::forward<Awaitable>(awaitable);
+  }
+}
+
+template <class Awaitable>
+using await_result_t =
+    decltype(get_awaiter(std::declval<Awaitable>()).await_resume());
+
+/**
+ * @brief The result type of an awaitable with `void` mapped to
+ * `std::monostate`, so that it can be stored in a tuple, variant or vector.
+ *
+ */
+template <class Awaitable>
+using non_void_result_t = std::conditional_t<
+    std::is_void_v<await_result_t<Awaitable>>, std::monostate,
+    std::remove_cvref_t<await_result_t<Awaitable>>>;
+
+/**
+ * @brief A one-shot event that a blocked thread waits on. The flag is set
+ * under the mutex, so the waiter cannot return and destroy the event while
+ * the notifier is still using it.
+ *
+ */
+class sync_wait_event {
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool set_ = false;
+
+public:
+  void set() {
+    std::lock_guard lock(mutex_);
+    set_ = true;
+    cv_.notify_one();
+  }
+  void wait() {
+    std::unique_lock lock(mutex_);
+    cv_.wait(lock, [this]() { return set_; });
+  }
+};
+
+class sync_wait_task {
+public:
+  struct promise_type : public pooled_frame {
+    sync_wait_event *event_ = nullptr;
+    std::exception_ptr exception_;
+    sync_wait_task get_return_object() noexcept {
+      return sync_wait_task(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+      struct awaiter {
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+          h.promise().event_->set();
+        }
+        void await_resume() noexcept {}
+      };
+      return awaiter{};
+    }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept {
+      exception_ = std::current_exception();
+    }
+  };
+
+private:
+  std::coroutine_handle<promise_type> h_;
+
+public:
+  explicit sync_wait_task(std::coroutine_handle<promise_type> h) : h_(h) {}
+  sync_wait_task(sync_wait_task &&other) noexcept
+      : h_(std::exchange(other.h_, {})) {}
+  ~sync_wait_task() {
+    if (h_) {
+      h_.destroy();
+    }
+  }
+
+  void run() {
+    sync_wait_event event;
+    h_.promise().event_ = &event;
+    h_.resume();
+    event.wait();
+    if (h_.promise().exception_) {
+      std::rethrow_exception(h_.promise().exception_);
+    }
+  }
+};
+
+template <class Awaitable, class Result>
+sync_wait_task make_sync_wait_task(Awaitable &awaitable,
+                                   std::optional<Result> &result) {
+  result.emplace(co_await awaitable);
+}
+
+template <class Awaitable>
+sync_wait_task make_sync_wait_task(Awaitable &awaitable) {
+  co_await awaitable;
+}
+
+} // namespace detail
+
+/**
+ * @brief Block the calling thread until an awaitable completes, and return
+ * its result. It must not be called from a thread that the awaitable needs
+ * to make progress, such as an executor worker.
+ *
+ * @param awaitable The awaitable, e.g. a `lazy_task` or a Queue Pair
+ * operation.
+ * @return The result of the awaitable. Exceptions are rethrown.
+ */
+template <class Awaitable> auto sync_wait(Awaitable &&awaitable) {
+  using result_type =
+      std::remove_cvref_t<detail::await_result_t<Awaitable>>;
+  if constexpr (std::is_void_v<result_type>) {
+    detail::make_sync_wait_task<Awaitable>(awaitable).run();
+  } else {
+    std::optional<result_type> result;
+    detail::make_sync_wait_task<Awaitable, result_type>(awaitable, result)
+        .run();
+    return std::move(*result);
+  }
+}
+
+} // namespace rdmapp
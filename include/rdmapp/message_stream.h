@@ -0,0 +1,156 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/mr.h"
+#include "rdmapp/qp.h"
+
+namespace rdmapp {
+
+/**
+ * @brief A stream of incoming messages of a Queue Pair, backed by a ring of
+ * pre-registered receive buffers that are kept posted. Each message is a view
+ * of its buffer, which is posted again as soon as the view is destroyed, so a
+ * receive is always outstanding while the consumer processes earlier
+ * messages. Messages are delivered in the order they arrived, even if their
+ * completions are processed by different executor workers.
+ *
+ * Usage:
+ *   auto stream = qp->messages();
+ *   while (auto msg = co_await stream.next()) { ... msg->data() ... }
+ *
+ * There must be at most one consumer awaiting `next` at a time. The stream
+ * does not keep the Queue Pair alive. Its receives stay posted after the stream
+ * is destroyed and release its buffers once they complete, when messages
+ * arrive or the Queue Pair is flushed. Messages they receive are dropped.
+ */
+class message_stream {
+  struct completion {
+    size_t buffer;
+    struct ibv_wc wc;
+  };
+
+  class state : public std::enable_shared_from_this<state> {
+  public:
+    std::weak_ptr<qp> qp_;
+    size_t buffer_size_;
+    std::vector<uint8_t> buffers_;
+    local_mr local_mr_;
+    std::mutex mutex_;
+    uint64_t next_post_seq_;
+    uint64_t next_deliver_seq_;
+    std::map<uint64_t, completion> completed_;
+    std::coroutine_handle<> waiter_;
+    bool ended_;
+
+    state(std::shared_ptr<qp> qp, size_t nr_buffers, size_t buffer_size);
+    void post_locked(qp &qp, size_t buffer);
+    void repost(size_t buffer) noexcept;
+    void on_complete(uint64_t seq, size_t buffer, struct ibv_wc const &wc);
+    void end() noexcept;
+    bool ready_locked() const;
+  };
+
+  std::shared_ptr<state> state_;
+
+public:
+  /**
+   * @brief A received message. Its buffer is posted again when it is
+   * destroyed.
+   *
+   */
+  class message {
+    std::shared_ptr<state> state_;
+    size_t buffer_;
+    std::span<uint8_t> data_;
+    std::optional<uint32_t> imm_;
+
+  public:
+    message(std::shared_ptr<state> state, size_t buffer,
+            std::span<uint8_t> data, std::optional<uint32_t> imm);
+    message(message &&other) noexcept;
+    message &operator=(message &&other) noexcept;
+    message(message const &) = delete;
+    message &operator=(message const &) = delete;
+    ~message();
+
+    /**
+     * @brief Get the payload of the message.
+     *
+     * @return std::span<uint8_t> The payload. It is valid until the message is
+     * destroyed.
+     */
+    std::span<uint8_t> data() const;
+
+    /**
+     * @brief Get the immediate data of the message.
+     *
+     * @return std::optional<uint32_t> The immediate data, if any.
+     */
+    std::optional<uint32_t> imm() const;
+  };
+
+  class next_awaitable {
+    std::shared_ptr<state> state_;
+
+  public:
+    explicit next_awaitable(std::shared_ptr<state> state);
+    bool await_ready() const;
+    bool await_suspend(std::coroutine_handle<> h);
+    std::optional<message> await_resume();
+  };
+
+  /**
+   * @brief Construct a new message stream and post all of its buffers.
+   *
+   * @param qp The Queue Pair to receive from. It must not use a shared receive
+   * queue, whose receives may be consumed by other Queue Pairs.
+   * @param nr_buffers The number of buffers. It must not exceed the receive
+   * queue depth of the Queue Pair minus other outstanding receives.
+   * @param buffer_size The size of each buffer, i.e. the largest message.
+   */
+  message_stream(std::shared_ptr<qp> qp, size_t nr_buffers,
+                 size_t buffer_size);
+
+  message_stream(message_stream &&other) noexcept;
+  message_stream &operator=(message_stream &&other) noexcept;
+  message_stream(message_stream const &) = delete;
+  message_stream &operator=(message_stream const &) = delete;
+
+  /**
+   * @brief Destroy the message stream. A consumer still awaiting `next` is
+   * woken with `std::nullopt`. The Queue Pair is left untouched.
+   *
+   */
+  ~message_stream();
+
+  /**
+   * @brief End the stream and move the Queue Pair to the error state, so that
+   * the posted receives are returned right away. This fails every other
+   * outstanding operation of the Queue Pair and breaks the connection.
+   *
+   */
+  void close();
+
+  /**
+   * @brief Wait for the next message.
+   *
+   * @return next_awaitable An awaitable that yields the next message, or
+   * `std::nullopt` once the Queue Pair has been flushed. Other completion
+   * errors are thrown.
+   */
+  next_awaitable next();
+};
+
+} // namespace rdmapp
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
-#include <vector>
+#include <span>
+#include <type_traits>
 
 #include <infiniband/verbs.h>
 
@@ -36,6 +39,14 @@ template <> class mr<tags::mr::local> : public noncopyable {
   std::shared_ptr<pd> pd_;
 
 public:
+  /**
+   * @brief The size of a serialized memory region handle: the address, the
+   * length and the remote key.
+   *
+   */
+  static constexpr size_t kSerializedSize =
+      detail::packed_size<uint64_t, uint64_t, uint32_t>;
+
   /**
    * @brief Construct a new mr object
    *
@@ -68,9 +79,18 @@ public:
   /**
    * @brief Serialize the memory region handle to be sent to a remote peer.
    *
-   * @return std::vector<uint8_t> The serialized memory region handle.
+   * @return std::array<uint8_t, kSerializedSize> The serialized memory region
+   * handle.
+   */
+  std::array<uint8_t, kSerializedSize> serialize() const;
+
+  /**
+   * @brief Serialize the memory region handle into a caller-provided buffer,
+   * such as a registered send buffer.
+   *
+   * @param out The buffer to write to.
    */
-  std::vector<uint8_t> serialize() const;
+  void serialize(std::span<uint8_t, kSerializedSize> out) const;
 
   /**
    * @brief Get the address of the memory region.
@@ -117,6 +137,8 @@ public:
    */
   static constexpr size_t kSerializedSize =
       sizeof(addr_) + sizeof(length_) + sizeof(rkey_);
+  static_assert(kSerializedSize == mr<tags::mr::local>::kSerializedSize,
+                "local and remote memory region layouts differ");
 
   mr() = default;
 
@@ -164,13 +186,35 @@ public:
    * @param it The iterator to deserialize from.
    * @return mr<tags::mr::remote> The deserialized remote memory region handle.
    */
-  template <class It> static mr<tags::mr::remote> deserialize(It it) {
+  template <class It>
+  static typename std::enable_if<
+      !std::is_convertible<It,
+                           std::span<uint8_t const, kSerializedSize>>::value,
+      mr<tags::mr::remote>>::type
+  deserialize(It it) {
     mr<tags::mr::remote> remote_mr;
     detail::deserialize(it, remote_mr.addr_);
     detail::deserialize(it, remote_mr.length_);
     detail::deserialize(it, remote_mr.rkey_);
     return remote_mr;
   }
+
+  /**
+   * @brief Deserialize a remote memory region handle from a fixed-size buffer.
+   *
+   * @param in The buffer to read from.
+   * @return mr<tags::mr::remote> The deserialized remote memory region handle.
+   */
+  static mr<tags::mr::remote>
+  deserialize(std::span<uint8_t const, kSerializedSize> in);
+
+  /**
+   * @brief Serialize the remote memory region handle, to pass it on to
+   * another peer.
+   *
+   * @param out The buffer to write to.
+   */
+  void serialize(std::span<uint8_t, kSerializedSize> out) const;
 };
 
 using local_mr = mr<tags::mr::local>;
@@ -22,6 +22,8 @@ class pd : public noncopyable, public std::enable_shared_from_this<pd> {
   struct ibv_pd *pd_;
   friend class qp;
   friend class srq;
+  friend class ud_qp;
+  friend class address_handle;
 
 public:
   /**
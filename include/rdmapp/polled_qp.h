@@ -0,0 +1,173 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/cq.h"
+#include "rdmapp/mr.h"
+#include "rdmapp/qp.h"
+#include "rdmapp/result.h"
+
+#include "rdmapp/detail/noncopyable.h"
+
+namespace rdmapp {
+
+/**
+ * @brief A Queue Pair that owns its Completion Queue and waits for its
+ * operations by spinning on that queue from the calling thread. There is no
+ * `cq_poller`, no `executor` and no completion callback in the path: each
+ * operation is posted with a sequence number as `wr_id`, and the call returns
+ * once the matching completion has been polled. This is meant for ping-pong
+ * request/response traffic where every microsecond counts.
+ *
+ * The Completion Queue must not be attached to a `cq_poller`, and the
+ * awaitables of the wrapped `qp` must not be used while it is polled this
+ * way. A polled qp is not thread-safe; use it from one thread.
+ *
+ * Usage:
+ *   auto ticket = polled.post_recv(*recv_mr);
+ *   polled.send(*send_mr).get();
+ *   auto [length, imm] = polled.wait_recv(ticket).get();
+ */
+class polled_qp : public noncopyable {
+  std::shared_ptr<qp> qp_;
+  std::shared_ptr<cq> cq_;
+  uint64_t next_wr_id_;
+  uint32_t max_inline_data_;
+  std::vector<struct ibv_wc> stashed_;
+
+  static constexpr int kPollBatch = 16;
+
+  result<uint32_t> execute(struct ibv_sge &sge, enum ibv_wr_opcode opcode,
+                           remote_mr *remote_mr);
+  struct ibv_wc wait(uint64_t wr_id);
+
+public:
+  /**
+   * @brief The outcome of an operation that has already completed. Awaiting
+   * it never suspends, and `get` returns the same value without a coroutine.
+   *
+   * @tparam T The value type.
+   */
+  template <class T> class [[nodiscard]] completion {
+    result<T> result_;
+
+  public:
+    completion(result<T> result) : result_(std::move(result)) {}
+    bool await_ready() const noexcept { return true; }
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    T await_resume() { return std::move(result_).value(); }
+
+    /**
+     * @brief Get the value, or throw if the operation failed.
+     *
+     * @return T The value.
+     */
+    T get() { return std::move(result_).value(); }
+
+    /**
+     * @brief Get the outcome without throwing.
+     *
+     * @return result<T> The value, or why the operation failed.
+     */
+    result<T> as_result() && noexcept { return std::move(result_); }
+  };
+
+  /**
+   * @brief Identifies a posted receive until it is waited for.
+   *
+   */
+  struct recv_ticket {
+    uint64_t wr_id;
+  };
+
+  /**
+   * @brief Construct a new polled qp object.
+   *
+   * @param qp The Queue Pair. Its send and receive completions must both go
+   * to `cq`, and it must not use a shared receive queue.
+   * @param cq The Completion Queue, used by no other Queue Pair or poller.
+   */
+  polled_qp(std::shared_ptr<qp> qp, std::shared_ptr<cq> cq);
+
+  /**
+   * @brief Send the local buffer and wait until the send completes. Buffers
+   * that fit are sent inline.
+   *
+   * @param local_mr The registered buffer.
+   * @param length The number of leading bytes of the buffer to send.
+   * @return completion<uint32_t> The completion.
+   */
+  completion<uint32_t> send(local_mr const &local_mr, size_t length);
+  completion<uint32_t> send(local_mr const &local_mr);
+
+  /**
+   * @brief Write the local buffer to the remote buffer and wait until the
+   * write completes. Buffers that fit are sent inline.
+   *
+   * @param remote_mr The remote buffer.
+   * @param local_mr The registered local buffer.
+   * @param length The number of leading bytes of the buffer to write.
+   * @return completion<uint32_t> The completion.
+   */
+  completion<uint32_t> write(remote_mr const &remote_mr,
+                             local_mr const &local_mr, size_t length);
+  completion<uint32_t> write(remote_mr const &remote_mr,
+                             local_mr const &local_mr);
+
+  /**
+   * @brief Read the remote buffer into the local buffer and wait until the
+   * read completes.
+   *
+   * @param remote_mr The remote buffer.
+   * @param local_mr The registered local buffer.
+   * @return completion<uint32_t> The completion.
+   */
+  completion<uint32_t> read(remote_mr const &remote_mr,
+                            local_mr const &local_mr);
+
+  /**
+   * @brief Post a receive without waiting for it, typically right before
+   * sending the request it receives the response to.
+   *
+   * @param local_mr The registered buffer to receive into.
+   * @return recv_ticket The ticket to wait for the receive with.
+   */
+  recv_ticket post_recv(local_mr const &local_mr);
+
+  /**
+   * @brief Wait for a posted receive. Each ticket must be waited for once.
+   *
+   * @param ticket The ticket returned by `post_recv`.
+   * @return completion<std::pair<uint32_t, std::optional<uint32_t>>> The
+   * number of bytes received and the immediate data.
+   */
+  completion<std::pair<uint32_t, std::optional<uint32_t>>>
+  wait_recv(recv_ticket ticket);
+
+  /**
+   * @brief Post a receive and wait for it.
+   *
+   * @param local_mr The registered buffer to receive into.
+   * @return completion<std::pair<uint32_t, std::optional<uint32_t>>> The
+   * number of bytes received and the immediate data.
+   */
+  completion<std::pair<uint32_t, std::optional<uint32_t>>>
+  recv(local_mr const &local_mr);
+
+  /**
+   * @brief Get the wrapped Queue Pair.
+   *
+   * @return std::shared_ptr<qp> The Queue Pair.
+   */
+  std::shared_ptr<qp> qp_ptr() const;
+};
+
+} // namespace rdmapp
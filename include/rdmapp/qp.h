@@ -1,12 +1,20 @@
 #pragma once
 
 #include <atomic>
+#include <cassert>
+#include <chrono>
 #include <coroutine>
 #include <cstdint>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <stop_token>
 #include <utility>
+#include <type_traits>
 #include <vector>
 
 #include <infiniband/verbs.h>
@@ -14,32 +22,166 @@
 #include "rdmapp/cq.h"
 #include "rdmapp/device.h"
 #include "rdmapp/pd.h"
+#include "rdmapp/result.h"
 #include "rdmapp/srq.h"
+#include "rdmapp/stats.h"
 
 #include "rdmapp/detail/noncopyable.h"
 #include "rdmapp/detail/serdes.h"
 
 namespace rdmapp {
 
+class message_stream;
+
+/**
+ * @brief The limits of one side of a connection, exchanged in the Queue Pair
+ * handshake so that both sides can agree on the best common configuration.
+ *
+ */
+struct qp_capabilities {
+  static constexpr size_t kSerializedSize =
+      3 * sizeof(uint16_t) + 3 * sizeof(uint32_t);
+  static_assert(kSerializedSize ==
+                    detail::packed_size<uint16_t, uint16_t, uint16_t, uint32_t,
+                                        uint32_t, uint32_t>,
+                "qp capabilities layout mismatch");
+
+  /**
+   * @brief Set if the device supports RDMA atomics.
+   *
+   */
+  static constexpr uint32_t kFeatureAtomic = 1 << 0;
+
+  /**
+   * @brief The path MTU, as an `enum ibv_mtu` value.
+   *
+   */
+  uint16_t path_mtu;
+
+  /**
+   * @brief The number of outstanding RDMA reads and atomics as initiator.
+   *
+   */
+  uint16_t max_rd_atomic;
+
+  /**
+   * @brief The number of outstanding RDMA reads and atomics as responder.
+   *
+   */
+  uint16_t max_dest_rd_atomic;
+
+  /**
+   * @brief The maximum size of inline data in send work requests.
+   *
+   */
+  uint32_t max_inline_data;
+
+  /**
+   * @brief The depth of the receive queue, or 0 if receives are taken from a
+   * shared receive queue. It is informational and does not pace sends, as the
+   * receives actually posted are not tracked.
+   *
+   */
+  uint32_t max_recv_wr;
+
+  /**
+   * @brief A bitmask of `kFeature*` flags.
+   *
+   */
+  uint32_t features;
+
+  /**
+   * @brief Pick the configuration to use towards a peer. Both sides arrive at
+   * matching settings: the smaller MTU, read/atomic depths limited by the
+   * opposite side's responder or initiator resources, and the common features.
+   * The inline size stays local, while the receive depth becomes the peer's.
+   *
+   * @param remote The capabilities advertised by the peer.
+   * @return qp_capabilities The negotiated configuration.
+   */
+  qp_capabilities negotiate(qp_capabilities const &remote) const;
+
+  template <class It> void serialize(It &it) const {
+    detail::serialize(path_mtu, it);
+    detail::serialize(max_rd_atomic, it);
+    detail::serialize(max_dest_rd_atomic, it);
+    detail::serialize(max_inline_data, it);
+    detail::serialize(max_recv_wr, it);
+    detail::serialize(features, it);
+  }
+
+  template <class It> static qp_capabilities deserialize(It it) {
+    qp_capabilities caps;
+    detail::deserialize(it, caps.path_mtu);
+    detail::deserialize(it, caps.max_rd_atomic);
+    detail::deserialize(it, caps.max_dest_rd_atomic);
+    detail::deserialize(it, caps.max_inline_data);
+    detail::deserialize(it, caps.max_recv_wr);
+    detail::deserialize(it, caps.features);
+    return caps;
+  }
+};
+
 struct deserialized_qp {
+  /**
+   * @brief The version of the handshake format. Fields appended to the
+   * capabilities block keep the version, as readers skip what they do not
+   * know. Any other change bumps it, and readers reject versions other than
+   * their own.
+   *
+   */
+  static constexpr uint16_t kWireVersion = 1;
+
   struct qp_header {
     static constexpr size_t kSerializedSize =
-        sizeof(uint16_t) + 3 * sizeof(uint32_t) + sizeof(union ibv_gid);
+        3 * sizeof(uint16_t) + 3 * sizeof(uint32_t) + sizeof(union ibv_gid);
+    static_assert(kSerializedSize ==
+                      detail::packed_size<uint16_t, uint16_t, uint32_t,
+                                          uint32_t, uint32_t, uint16_t,
+                                          union ibv_gid>,
+                  "qp header layout mismatch");
+    uint16_t version;
     uint16_t lid;
     uint32_t qp_num;
     uint32_t sq_psn;
     uint32_t user_data_size;
+    uint16_t capabilities_size;
     union ibv_gid gid;
   } header;
-  template <class It> static deserialized_qp deserialize(It it) {
+  template <class It>
+  static typename std::enable_if<
+      !std::is_convertible<
+          It, std::span<uint8_t const, qp_header::kSerializedSize>>::value,
+      deserialized_qp>::type
+  deserialize(It it) {
     deserialized_qp des_qp;
+    detail::deserialize(it, des_qp.header.version);
     detail::deserialize(it, des_qp.header.lid);
     detail::deserialize(it, des_qp.header.qp_num);
     detail::deserialize(it, des_qp.header.sq_psn);
     detail::deserialize(it, des_qp.header.user_data_size);
+    detail::deserialize(it, des_qp.header.capabilities_size);
     detail::deserialize(it, des_qp.header.gid);
     return des_qp;
   }
+
+  /**
+   * @brief Deserialize the header from a fixed-size buffer.
+   *
+   * @param in The buffer to read from.
+   * @return deserialized_qp The Queue Pair with only its header filled in.
+   */
+  static deserialized_qp
+  deserialize(std::span<uint8_t const, qp_header::kSerializedSize> in) {
+    deserialized_qp des_qp;
+    detail::unpack(in, des_qp.header.version, des_qp.header.lid,
+                   des_qp.header.qp_num, des_qp.header.sq_psn,
+                   des_qp.header.user_data_size,
+                   des_qp.header.capabilities_size, des_qp.header.gid);
+    return des_qp;
+  }
+
+  qp_capabilities capabilities;
   std::vector<uint8_t> user_data;
 };
 
@@ -48,10 +190,13 @@ struct deserialized_qp {
  *
  */
 class qp : public noncopyable, public std::enable_shared_from_this<qp> {
+  friend class polled_qp;
   static std::atomic<uint32_t> next_sq_psn;
   struct ibv_qp *qp_;
   struct ibv_srq *raw_srq_;
   uint32_t sq_psn_;
+  uint32_t max_inline_data_;
+  qp_capabilities capabilities_;
   void (qp::*post_recv_fn)(struct ibv_recv_wr const &recv_wr,
                            struct ibv_recv_wr *&bad_recv_wr) const;
 
@@ -61,6 +206,46 @@ class qp : public noncopyable, public std::enable_shared_from_this<qp> {
   std::shared_ptr<srq> srq_;
   std::vector<uint8_t> user_data_;
 
+  using send_error_fn = std::function<void(std::exception_ptr)>;
+
+  /**
+   * @brief A chain of send work requests waiting for send queue slots. The
+   * work requests and scatter/gather lists are owned copies.
+   *
+   */
+  struct deferred_send {
+    std::vector<struct ibv_send_wr> send_wrs;
+    std::vector<struct ibv_sge> sges;
+    send_error_fn on_error;
+  };
+
+  std::mutex sq_mutex_;
+  uint32_t sq_outstanding_;
+  std::deque<deferred_send> sq_deferred_;
+  qp_stats sq_stats_;
+  mutable std::atomic<uint64_t> recvs_posted_;
+  mutable std::atomic<uint64_t> recv_post_errors_;
+
+  static deferred_send make_deferred_send(struct ibv_send_wr const &send_wr,
+                                          uint32_t nr_wrs,
+                                          send_error_fn &&on_error);
+
+  /**
+   * @brief Posts a chain whose send queue slots are already reserved. The
+   * slots are returned if posting fails.
+   *
+   */
+  void post_reserved_send(struct ibv_send_wr const &send_wr, uint32_t nr_wrs);
+
+  /**
+   * @brief Counts the work requests of a chain that were posted, i.e. those
+   * before `bad_send_wr`, or all of them if it is null. Called with
+   * `sq_mutex_` held.
+   *
+   */
+  void count_posted_sends(struct ibv_send_wr const &send_wr, uint32_t nr_wrs,
+                          struct ibv_send_wr const *bad_send_wr = nullptr);
+
   /**
    * @brief Creates a new Queue Pair. The Queue Pair will be in the RESET state.
    *
@@ -77,16 +262,70 @@ class qp : public noncopyable, public std::enable_shared_from_this<qp> {
   void destroy();
 
 public:
+  /**
+   * @brief The deadline and stop token of an awaitable. They are armed before
+   * the operation is posted. If either fires before the completion arrives,
+   * the Queue Pair is moved to the error state. That flushes the operation,
+   * together with every other outstanding one, so its callback and buffers
+   * are reclaimed through the normal completion path, and the awaitable
+   * reports `operation_timed_out` or `operation_cancelled` instead of the
+   * flush error.
+   *
+   */
+  class cancellation {
+    enum class reason { pending, completed, cancelled, timed_out };
+    struct state {
+      std::weak_ptr<qp> qp_;
+      std::atomic<reason> reason_ = reason::pending;
+      void fire(reason why) noexcept;
+    };
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+    std::stop_token stop_token_;
+    std::shared_ptr<state> state_;
+    std::unique_ptr<std::stop_callback<std::function<void()>>> stop_callback_;
+    uint64_t timer_id_ = 0;
+
+  public:
+    void set_deadline(std::chrono::steady_clock::time_point deadline);
+    void set_stop_token(std::stop_token stop_token);
+
+    /**
+     * @brief Start watching the deadline and the stop token.
+     *
+     * @param qp The Queue Pair to move to the error state when either fires.
+     */
+    void arm(std::shared_ptr<qp> const &qp);
+
+    /**
+     * @brief Stop watching. Called from the completion callback, before the
+     * awaiting coroutine is resumed.
+     *
+     */
+    void disarm() noexcept;
+
+    /**
+     * @brief Check whether a failed completion was caused by the cancellation.
+     *
+     * @param status The status of the completion.
+     * @return std::optional<op_error> The timeout or cancellation that caused
+     * the failure, if any.
+     */
+    std::optional<op_error> check(enum ibv_wc_status status) const noexcept;
+
+    bool enabled() const noexcept;
+  };
+
   class send_awaitable {
     std::shared_ptr<qp> qp_;
     std::shared_ptr<local_mr> local_mr_;
-    std::exception_ptr exception_;
+    std::optional<op_error> error_;
     remote_mr remote_mr_;
     uint64_t compare_add_;
     uint64_t swap_;
     uint32_t imm_;
     struct ibv_wc wc_;
     const enum ibv_wr_opcode opcode_;
+    cancellation cancellation_;
 
   public:
     send_awaitable(std::shared_ptr<qp> qp, void *buffer, size_t length,
@@ -118,16 +357,71 @@ public:
     bool await_ready() const noexcept;
     bool await_suspend(std::coroutine_handle<> h) noexcept;
     uint32_t await_resume() const;
+
+    /**
+     * @brief Get the outcome of the operation without throwing.
+     *
+     * @return result<uint32_t> The number of bytes transferred, or why the
+     * operation failed.
+     */
+    result<uint32_t> try_resume() const noexcept;
+
+    /**
+     * @brief Await the operation without throwing, e.g. to drain the flushed
+     * completions of a Queue Pair in the error state cheaply.
+     *
+     * @return result_awaitable<send_awaitable> An awaitable that yields the
+     * result of `try_resume`. It must be awaited in the same expression.
+     */
+    result_awaitable<send_awaitable> as_result() & noexcept;
+    result_awaitable<send_awaitable> as_result() && noexcept;
     constexpr bool is_rdma() const;
+
+    /**
+     * @brief Fail with `operation_timed_out` if the operation has not
+     * completed by the deadline. Timing out moves the Queue Pair to the error
+     * state.
+     *
+     * @param deadline The deadline.
+     * @return send_awaitable& This awaitable.
+     */
+    send_awaitable &
+    with_deadline(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief Fail with `operation_timed_out` if the operation has not
+     * completed within the timeout, counted from this call.
+     *
+     * @param timeout The timeout.
+     * @return send_awaitable& This awaitable.
+     */
+    template <class Rep, class Period>
+    send_awaitable &with_timeout(std::chrono::duration<Rep, Period> timeout) {
+      return with_deadline(
+          std::chrono::steady_clock::now() +
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              timeout));
+    }
+
+    /**
+     * @brief Fail with `operation_cancelled` if the stop token is signaled
+     * before the operation completes. Cancelling moves the Queue Pair to the
+     * error state.
+     *
+     * @param stop_token The stop token, e.g. of a `task_group`.
+     * @return send_awaitable& This awaitable.
+     */
+    send_awaitable &with_stop_token(std::stop_token stop_token);
     constexpr bool is_atomic() const;
   };
 
   class recv_awaitable {
     std::shared_ptr<qp> qp_;
     std::shared_ptr<local_mr> local_mr_;
-    std::exception_ptr exception_;
+    std::optional<op_error> error_;
     struct ibv_wc wc_;
     enum ibv_wr_opcode opcode_;
+    cancellation cancellation_;
 
   public:
     recv_awaitable(std::shared_ptr<qp> qp, std::shared_ptr<local_mr> local_mr);
@@ -135,8 +429,220 @@ public:
     bool await_ready() const noexcept;
     bool await_suspend(std::coroutine_handle<> h) noexcept;
     std::pair<uint32_t, std::optional<uint32_t>> await_resume() const;
+
+    /**
+     * @brief Get the outcome of the receive without throwing.
+     *
+     * @return result<std::pair<uint32_t, std::optional<uint32_t>>> The number
+     * of bytes received and the immediate data, or why the receive failed.
+     */
+    result<std::pair<uint32_t, std::optional<uint32_t>>>
+    try_resume() const noexcept;
+
+    /**
+     * @brief Await the receive without throwing.
+     *
+     * @return result_awaitable<recv_awaitable> An awaitable that yields the
+     * result of `try_resume`. It must be awaited in the same expression.
+     */
+    result_awaitable<recv_awaitable> as_result() & noexcept;
+    result_awaitable<recv_awaitable> as_result() && noexcept;
+
+    /**
+     * @brief Fail with `operation_timed_out` if no message has arrived by the
+     * deadline. Timing out moves the Queue Pair to the error state. Receives
+     * posted to a shared receive queue are not flushed by that, so they cannot
+     * time out.
+     *
+     * @param deadline The deadline.
+     * @return recv_awaitable& This awaitable.
+     */
+    recv_awaitable &
+    with_deadline(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief Fail with `operation_timed_out` if no message has arrived within
+     * the timeout, counted from this call.
+     *
+     * @param timeout The timeout.
+     * @return recv_awaitable& This awaitable.
+     */
+    template <class Rep, class Period>
+    recv_awaitable &with_timeout(std::chrono::duration<Rep, Period> timeout) {
+      return with_deadline(
+          std::chrono::steady_clock::now() +
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              timeout));
+    }
+
+    /**
+     * @brief Fail with `operation_cancelled` if the stop token is signaled
+     * before a message arrives. Cancelling moves the Queue Pair to the error
+     * state.
+     *
+     * @param stop_token The stop token.
+     * @return recv_awaitable& This awaitable.
+     */
+    recv_awaitable &with_stop_token(std::stop_token stop_token);
   };
 
+  /**
+   * @brief This awaitable splits a large RDMA read or write into MTU-aligned
+   * chunks and keeps a window of them in flight on each of its lanes until the
+   * whole range is transferred. A lane is a Queue Pair with the memory regions
+   * it uses; a lane with spare window takes the next chunk, so faster paths
+   * carry more of the transfer. Every chunk lands at its final offset.
+   *
+   */
+  class bulk_awaitable {
+    struct lane {
+      std::shared_ptr<qp> qp_;
+      std::shared_ptr<local_mr> local_mr_;
+      remote_mr remote_mr_;
+      size_t inflight_;
+    };
+    std::vector<lane> lanes_;
+    std::exception_ptr exception_;
+    const enum ibv_wr_opcode opcode_;
+    const size_t length_;
+    const size_t chunk_size_;
+    const size_t window_;
+    std::mutex mutex_;
+    std::coroutine_handle<> h_;
+    size_t next_offset_;
+    size_t inflight_;
+    size_t transferred_;
+    enum ibv_wc_status status_;
+
+    void post_chunk(size_t lane_id);
+    void on_chunk_complete(size_t lane_id, struct ibv_wc const &wc,
+                           size_t chunk_length);
+    void on_chunk_failed(size_t lane_id, std::exception_ptr exception);
+
+  public:
+    bulk_awaitable(std::shared_ptr<qp> qp, std::shared_ptr<local_mr> local_mr,
+                   enum ibv_wr_opcode opcode, remote_mr const &remote_mr,
+                   size_t chunk_size, size_t window);
+    bulk_awaitable(std::shared_ptr<qp> qp, void *buffer, size_t length,
+                   enum ibv_wr_opcode opcode, remote_mr const &remote_mr,
+                   size_t chunk_size, size_t window);
+
+    /**
+     * @brief Construct a bulk transfer striped over several lanes. The i-th
+     * memory regions are used by the i-th Queue Pair and must all describe
+     * the same buffers.
+     *
+     */
+    bulk_awaitable(std::vector<std::shared_ptr<qp>> const &qps,
+                   std::vector<std::shared_ptr<local_mr>> const &local_mrs,
+                   enum ibv_wr_opcode opcode,
+                   std::vector<remote_mr> const &remote_mrs, size_t chunk_size,
+                   size_t window);
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<> h) noexcept;
+    size_t await_resume() const;
+  };
+
+  /**
+   * @brief A single read of a gather operation. The remote slice is copied to
+   * the local memory region at the given offset.
+   *
+   */
+  struct gather_entry {
+    remote_mr remote;
+    std::shared_ptr<local_mr> local;
+    size_t local_offset = 0;
+  };
+
+  /**
+   * @brief This awaitable posts many RDMA reads as linked work request chains
+   * with only the last request of each chain signaled, and resumes once all of
+   * them have landed.
+   *
+   */
+  class gather_awaitable {
+    std::shared_ptr<qp> qp_;
+    std::vector<gather_entry> entries_;
+    std::exception_ptr exception_;
+    std::coroutine_handle<> h_;
+    size_t next_entry_;
+    size_t transferred_;
+    struct ibv_wc wc_;
+    enum ibv_wc_status chain_status_;
+
+    void post_batch();
+    void on_batch_complete(struct ibv_wc const &wc, size_t batch_length);
+
+  public:
+    gather_awaitable(std::shared_ptr<qp> qp, std::vector<gather_entry> entries);
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<> h) noexcept;
+    size_t await_resume() const;
+  };
+
+  /**
+   * @brief The maximum number of outstanding send work requests of a Queue
+   * Pair.
+   *
+   */
+  static constexpr uint32_t kMaxSendWr = 128;
+
+  /**
+   * @brief The maximum number of outstanding recv work requests of a Queue
+   * Pair.
+   *
+   */
+  static constexpr uint32_t kMaxRecvWr = 128;
+
+  /**
+   * @brief The largest path MTU in bytes. It is the default buffer size of
+   * message streams.
+   *
+   */
+  static constexpr size_t kPathMtuBytes = 4096;
+
+  /**
+   * @brief The largest chunk size of bulk transfers. Larger chunk sizes are
+   * clamped to it, as a work request carries a 32-bit length and devices
+   * commonly limit messages to 2 GiB.
+   *
+   */
+  static constexpr size_t kMaxBulkChunkSize = size_t(1) << 31;
+
+  /**
+   * @brief The default chunk size of bulk transfers.
+   *
+   */
+  static constexpr size_t kDefaultBulkChunkSize = 64 * 1024;
+
+  /**
+   * @brief The default number of chunks kept in flight by bulk transfers.
+   *
+   */
+  static constexpr size_t kDefaultBulkWindow = 16;
+
+  /**
+   * @brief The default number of receive buffers of a message stream.
+   *
+   */
+  static constexpr size_t kDefaultStreamBuffers = 32;
+
+  /**
+   * @brief Get the path MTU the Queue Pair is moved to RTR with: the active
+   * MTU of the port, lowered to the peer's when capabilities were negotiated.
+   *
+   * @return size_t The path MTU in bytes.
+   */
+  size_t path_mtu_bytes() const;
+
+  /**
+   * @brief Round a transfer length up to a multiple of the path MTU.
+   *
+   * @param length The length to round up.
+   * @return size_t The MTU-aligned length, at least one MTU.
+   */
+  size_t align_to_mtu(size_t length) const;
+
   /**
    * @brief Construct a new qp object. The Queue Pair will be created with the
    * given remote Queue Pair parameters. Once constructed, the Queue Pair will
@@ -209,6 +715,65 @@ public:
   void post_send(struct ibv_send_wr const &send_wr,
                  struct ibv_send_wr *&bad_send_wr);
 
+  /**
+   * @brief This function posts a chain of send work requests once the send
+   * queue has room for all of them. If the send queue is full, or earlier
+   * chains are already waiting, the chain is copied and posted in FIFO order
+   * as completions release slots. Every posted chain must eventually be
+   * followed by a `release_send_slots` call for the same number of work
+   * requests, normally from the completion callback of its signaled tail.
+   *
+   * @param send_wr The head of the work request chain.
+   * @param nr_wrs The number of work requests in the chain. It must not exceed
+   * `kMaxSendWr`.
+   * @param on_error Called with the exception if a deferred post fails. It is
+   * not called if the chain is posted immediately; errors are thrown instead.
+   * @return true The chain was posted immediately.
+   * @return false The chain was queued.
+   */
+  template <class OnError>
+  bool post_send_when_ready(struct ibv_send_wr const &send_wr, uint32_t nr_wrs,
+                            OnError &&on_error) {
+    assert(nr_wrs > 0 && nr_wrs <= kMaxSendWr);
+    std::unique_lock lock(sq_mutex_);
+    if (sq_deferred_.empty() && sq_outstanding_ + nr_wrs <= kMaxSendWr)
+        [[likely]] {
+      sq_outstanding_ += nr_wrs;
+      lock.unlock();
+      post_reserved_send(send_wr, nr_wrs);
+      return true;
+    }
+    ++sq_stats_.sends_deferred;
+    sq_deferred_.push_back(make_deferred_send(
+        send_wr, nr_wrs, send_error_fn(std::forward<OnError>(on_error))));
+    return false;
+  }
+
+  /**
+   * @brief This function returns send queue slots after their work requests
+   * completed, and posts waiting chains that now fit. All chains that fit are
+   * linked and posted with a single doorbell.
+   *
+   * @param nr_wrs The number of completed work requests.
+   */
+  void release_send_slots(uint32_t nr_wrs);
+
+  /**
+   * @brief Get the number of send work requests posted and not yet released.
+   *
+   * @return uint32_t The number of outstanding send work requests.
+   */
+  uint32_t outstanding_sends();
+
+  /**
+   * @brief Take a snapshot of the counters of the Queue Pair. Sends posted
+   * through `polled_qp`, and work requests posted directly to the underlying
+   * `ibv_qp`, are not counted.
+   *
+   * @return qp_stats The counters.
+   */
+  qp_stats stats();
+
   /**
    * @brief This function is used to post a recv work request to the Queue Pair.
    * It will be posted to either RQ or SRQ depending on whether or not SRQ is
@@ -403,6 +968,109 @@ public:
    */
   [[nodiscard]] recv_awaitable recv(std::shared_ptr<local_mr> local_mr);
 
+  /**
+   * @brief This function creates a stream of incoming messages backed by a
+   * ring of receive buffers that are kept posted.
+   *
+   * @param nr_buffers The number of receive buffers.
+   * @param buffer_size The size of each buffer, i.e. the largest message.
+   * @return message_stream The stream. Include `rdmapp/message_stream.h` to
+   * use it.
+   */
+  [[nodiscard]] message_stream
+  messages(size_t nr_buffers = kDefaultStreamBuffers,
+           size_t buffer_size = kPathMtuBytes);
+
+  /**
+   * @brief This function writes a large registered local memory region to
+   * remote. The range is split into MTU-aligned chunks and up to `window`
+   * chunks are kept in flight at a time.
+   *
+   * @param remote_mr Remote memory region handle. It should be at least as
+   * large as the local memory region.
+   * @param local_mr Registered local memory region, whose lifetime is
+   * controlled by a smart pointer.
+   * @param chunk_size The size of each chunk. It is rounded up to a multiple of
+   * the path MTU.
+   * @param window The maximum number of chunks in flight. It is capped by the
+   * send queue depth.
+   * @return bulk_awaitable A coroutine returning length of the data written.
+   */
+  [[nodiscard]] bulk_awaitable
+  write_bulk(remote_mr const &remote_mr, std::shared_ptr<local_mr> local_mr,
+             size_t chunk_size = kDefaultBulkChunkSize,
+             size_t window = kDefaultBulkWindow);
+
+  /**
+   * @brief This function reads a large remote memory region to a registered
+   * local memory region. The range is split into MTU-aligned chunks and up to
+   * `window` chunks are kept in flight at a time.
+   *
+   * @param remote_mr Remote memory region handle. It should be at least as
+   * large as the local memory region.
+   * @param local_mr Registered local memory region, whose lifetime is
+   * controlled by a smart pointer.
+   * @param chunk_size The size of each chunk. It is rounded up to a multiple of
+   * the path MTU.
+   * @param window The maximum number of chunks in flight. It is capped by the
+   * send queue depth.
+   * @return bulk_awaitable A coroutine returning length of the data read.
+   */
+  [[nodiscard]] bulk_awaitable
+  read_bulk(remote_mr const &remote_mr, std::shared_ptr<local_mr> local_mr,
+            size_t chunk_size = kDefaultBulkChunkSize,
+            size_t window = kDefaultBulkWindow);
+
+  /**
+   * @brief This method writes a large local buffer to a remote memory region in
+   * pipelined chunks. The local buffer will be registered as a memory region
+   * first and then deregistered upon completion.
+   *
+   * @param remote_mr Remote memory region handle.
+   * @param buffer Pointer to local buffer. It should be valid until completion.
+   * @param length The length of the local buffer.
+   * @param chunk_size The size of each chunk. It is rounded up to a multiple of
+   * the path MTU.
+   * @param window The maximum number of chunks in flight.
+   * @return bulk_awaitable A coroutine returning length of the data written.
+   */
+  [[nodiscard]] bulk_awaitable
+  write_bulk(remote_mr const &remote_mr, void *buffer, size_t length,
+             size_t chunk_size = kDefaultBulkChunkSize,
+             size_t window = kDefaultBulkWindow);
+
+  /**
+   * @brief This method reads a large remote memory region to a local buffer in
+   * pipelined chunks. The local buffer will be registered as a memory region
+   * first and then deregistered upon completion.
+   *
+   * @param remote_mr Remote memory region handle.
+   * @param buffer Pointer to local buffer. It should be valid until completion.
+   * @param length The length of the local buffer.
+   * @param chunk_size The size of each chunk. It is rounded up to a multiple of
+   * the path MTU.
+   * @param window The maximum number of chunks in flight.
+   * @return bulk_awaitable A coroutine returning length of the data read.
+   */
+  [[nodiscard]] bulk_awaitable
+  read_bulk(remote_mr const &remote_mr, void *buffer, size_t length,
+            size_t chunk_size = kDefaultBulkChunkSize,
+            size_t window = kDefaultBulkWindow);
+
+  /**
+   * @brief This function reads many remote memory slices into registered local
+   * memory regions. The reads are posted as linked work request chains with
+   * only the last one signaled, so the whole gather costs one post and one
+   * completion per send queue's worth of reads.
+   *
+   * @param entries The reads to perform. Each remote slice is copied to the
+   * local memory region at the given offset.
+   * @return gather_awaitable A coroutine returning the total length of the data
+   * read.
+   */
+  [[nodiscard]] gather_awaitable
+  read_gather(std::vector<gather_entry> entries);
+
   /**
    * @brief This function serializes a Queue Pair prepared to be sent to a
    * buffer.
@@ -411,6 +1079,24 @@ public:
    */
   std::vector<uint8_t> serialize() const;
 
+  /**
+   * @brief The size of the serialized header and capabilities, which precede
+   * the user data.
+   *
+   */
+  static constexpr size_t kSerializedHeaderSize =
+      deserialized_qp::qp_header::kSerializedSize +
+      qp_capabilities::kSerializedSize;
+
+  /**
+   * @brief This function serializes the header and capabilities of the Queue
+   * Pair into a caller-provided buffer without allocating. The user data, if
+   * any, should follow it.
+   *
+   * @param out The buffer to write to.
+   */
+  void serialize_header(std::span<uint8_t, kSerializedHeaderSize> out) const;
+
   /**
    * @brief This function provides access to the extra user data of the Queue
    * Pair.
@@ -426,6 +1112,15 @@ public:
    * @return std::shared_ptr<pd> Pointer to the PD.
    */
   std::shared_ptr<pd> pd_ptr() const;
+
+  /**
+   * @brief This function provides access to the Shared Receive Queue of the
+   * Queue Pair.
+   *
+   * @return std::shared_ptr<srq> Pointer to the SRQ, or nullptr if recv work
+   * requests are posted to the Queue Pair itself.
+   */
+  std::shared_ptr<srq> srq_ptr() const;
   ~qp();
 
   /**
@@ -445,6 +1140,56 @@ public:
    */
   void rts();
 
+  /**
+   * @brief This function transitions the Queue Pair with attributes supplied
+   * by an external connection manager such as rdma_cm, which resolves the path
+   * and PSNs itself.
+   *
+   * @param attr The Queue Pair attributes.
+   * @param attr_mask The mask of valid attributes.
+   */
+  void modify(struct ibv_qp_attr &attr, int attr_mask);
+
+  /**
+   * @brief This function transitions the Queue Pair to the error state. All
+   * outstanding work requests complete with `IBV_WC_WR_FLUSH_ERR`, and so do
+   * those posted afterwards. The connection has to be re-established.
+   *
+   */
+  void flush();
+
+  /**
+   * @brief Get the number of the Queue Pair.
+   *
+   * @return uint32_t The QPN.
+   */
+  uint32_t qp_num() const;
+
+  /**
+   * @brief Get the limits of this side of the connection, as advertised to the
+   * peer in the handshake.
+   *
+   * @return qp_capabilities The local capabilities.
+   */
+  qp_capabilities local_capabilities() const;
+
+  /**
+   * @brief Agree on the configuration to use with the peer. It should be
+   * called before `rtr`, which applies the negotiated MTU and read/atomic
+   * depths along with `rts`.
+   *
+   * @param remote The capabilities advertised by the peer.
+   */
+  void negotiate(qp_capabilities const &remote);
+
+  /**
+   * @brief Get the configuration in use. It is the local capabilities until
+   * `negotiate` is called.
+   *
+   * @return qp_capabilities const& The configuration.
+   */
+  qp_capabilities const &capabilities() const;
+
 private:
   /**
    * @brief This function posts a recv request on the Queue Pair's own RQ.
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "rdmapp/cq.h"
+#include "rdmapp/pd.h"
+#include "rdmapp/qp.h"
+#include "rdmapp/srq.h"
+
+#include "rdmapp/detail/noncopyable.h"
+
+namespace rdmapp {
+
+/**
+ * @brief This class keeps Queue Pairs that are already created and in the INIT
+ * state, so that establishing a connection only needs the RTR and RTS
+ * transitions. There is one pool per (pd, recv cq, send cq, srq) combination,
+ * and a background thread refills every pool up to its target size. When
+ * creating Queue Pairs fails, e.g. as device resources run out, the thread
+ * keeps what it created and retries with exponential backoff.
+ *
+ */
+class qp_pool : public noncopyable {
+  struct key {
+    pd *pd_;
+    cq *recv_cq_;
+    cq *send_cq_;
+    srq *srq_;
+    bool operator==(key const &other) const;
+  };
+  struct key_hash {
+    size_t operator()(key const &k) const;
+  };
+  struct entry {
+    std::shared_ptr<pd> pd_;
+    std::shared_ptr<cq> recv_cq_;
+    std::shared_ptr<cq> send_cq_;
+    std::shared_ptr<srq> srq_;
+    std::deque<std::shared_ptr<qp>> qps_;
+  };
+
+  size_t const target_size_;
+  std::mutex mutex_;
+  std::condition_variable refill_cv_;
+  std::unordered_map<key, entry, key_hash> pools_;
+  std::atomic<bool> stopped_;
+  std::thread refiller_thread_;
+
+  bool needs_refill() const;
+  void refiller();
+
+public:
+  /**
+   * @brief Construct a new qp pool object and start its refiller thread.
+   *
+   * @param target_size The number of ready Queue Pairs to keep in each pool.
+   */
+  qp_pool(size_t target_size = 64);
+
+  /**
+   * @brief Start keeping Queue Pairs for a combination of resources. Pools are
+   * also created on the first `acquire`, but reserving them up front avoids
+   * creating the first Queue Pairs on the connection path.
+   *
+   * @param pd The protection domain of the Queue Pairs.
+   * @param recv_cq The completion queue of recv work completions.
+   * @param send_cq The completion queue of send work completions.
+   * @param srq (Optional) The SRQ of the Queue Pairs.
+   */
+  void reserve(std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+               std::shared_ptr<cq> send_cq, std::shared_ptr<srq> srq = nullptr);
+
+  /**
+   * @brief Take a Queue Pair in the INIT state. If the pool is empty, one is
+   * created in the calling thread.
+   *
+   * @param pd The protection domain of the Queue Pair.
+   * @param recv_cq The completion queue of recv work completions.
+   * @param send_cq The completion queue of send work completions.
+   * @param srq (Optional) The SRQ of the Queue Pair.
+   * @return std::shared_ptr<qp> The Queue Pair, ready for `rtr` and `rts`.
+   */
+  std::shared_ptr<qp> acquire(std::shared_ptr<pd> pd,
+                              std::shared_ptr<cq> recv_cq,
+                              std::shared_ptr<cq> send_cq,
+                              std::shared_ptr<srq> srq = nullptr);
+
+  /**
+   * @brief Get the number of ready Queue Pairs for a combination of resources.
+   *
+   * @param pd The protection domain of the Queue Pairs.
+   * @param recv_cq The completion queue of recv work completions.
+   * @param send_cq The completion queue of send work completions.
+   * @param srq (Optional) The SRQ of the Queue Pairs.
+   * @return size_t The number of ready Queue Pairs.
+   */
+  size_t available(std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+                   std::shared_ptr<cq> send_cq,
+                   std::shared_ptr<srq> srq = nullptr);
+
+  /**
+   * @brief Stop the refiller thread and destroy all pooled Queue Pairs.
+   *
+   */
+  ~qp_pool();
+};
+
+} // namespace rdmapp
@@ -4,7 +4,21 @@
 #include "rdmapp/cq_poller.h"
 #include "rdmapp/device.h"
 #include "rdmapp/error.h"
+#include "rdmapp/frame_allocator.h"
+#include "rdmapp/lazy_task.h"
+#include "rdmapp/message_stream.h"
 #include "rdmapp/pd.h"
+#include "rdmapp/polled_qp.h"
 #include "rdmapp/qp.h"
+#include "rdmapp/qp_pool.h"
+#include "rdmapp/remote_sync.h"
+#include "rdmapp/result.h"
 #include "rdmapp/srq.h"
-#include "rdmapp/task.h"
\ No newline at end of file
+#include "rdmapp/stats.h"
+#include "rdmapp/striped_qp.h"
+#include "rdmapp/task.h"
+#include "rdmapp/task_group.h"
+#include "rdmapp/trace.h"
+#include "rdmapp/ud_qp.h"
+#include "rdmapp/when_all.h"
+#include "rdmapp/when_any.h"
\ No newline at end of file
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+
+#include "rdmapp/lazy_task.h"
+#include "rdmapp/mr.h"
+#include "rdmapp/qp.h"
+
+#include "rdmapp/detail/noncopyable.h"
+
+namespace rdmapp {
+
+/**
+ * @brief This class issues atomic operations on 64-bit words of a remote
+ * memory region. The local 8-byte buffer that receives the old values is
+ * registered once and reused, so an object should only be used by one
+ * coroutine at a time.
+ *
+ */
+class remote_atomic : public noncopyable {
+  std::shared_ptr<qp> qp_;
+  remote_mr remote_mr_;
+  std::unique_ptr<uint64_t> scratch_;
+  std::shared_ptr<local_mr> scratch_mr_;
+
+  remote_mr word(size_t offset);
+
+public:
+  /**
+   * @brief Construct a new remote atomic object.
+   *
+   * @param qp The connected Queue Pair to issue operations on.
+   * @param remote_mr The remote memory region holding the words. It should be
+   * 8-byte aligned.
+   */
+  remote_atomic(std::shared_ptr<qp> qp, remote_mr const &remote_mr);
+
+  /**
+   * @brief Atomically add to a remote word.
+   *
+   * @param offset The byte offset of the word in the remote memory region.
+   * @param add The delta.
+   * @return lazy_task<uint64_t> A coroutine returning the old value.
+   */
+  lazy_task<uint64_t> fetch_and_add(size_t offset, uint64_t add);
+
+  /**
+   * @brief Atomically compare and swap a remote word.
+   *
+   * @param offset The byte offset of the word in the remote memory region.
+   * @param compare The expected old value.
+   * @param swap The desired new value.
+   * @return lazy_task<uint64_t> A coroutine returning the old value. The swap
+   * took place if it equals `compare`.
+   */
+  lazy_task<uint64_t> compare_and_swap(size_t offset, uint64_t compare,
+                                       uint64_t swap);
+
+  /**
+   * @brief Read a remote word.
+   *
+   * @param offset The byte offset of the word in the remote memory region.
+   * @return lazy_task<uint64_t> A coroutine returning the value.
+   */
+  lazy_task<uint64_t> load(size_t offset);
+};
+
+/**
+ * @brief Exponential backoff between retries of remote operations. Pausing
+ * suspends the coroutine instead of blocking its thread, which is usually an
+ * executor worker that other completions are waiting for.
+ *
+ */
+class backoff {
+  std::chrono::nanoseconds const min_;
+  std::chrono::nanoseconds const max_;
+  std::chrono::nanoseconds current_;
+
+public:
+  /**
+   * @brief This awaitable resumes the awaiting coroutine after a delay, on the
+   * executor it was running on, or on the timer thread if there is none.
+   *
+   */
+  class pause_awaitable {
+    std::chrono::nanoseconds const delay_;
+
+  public:
+    explicit pause_awaitable(std::chrono::nanoseconds delay);
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() const noexcept;
+  };
+
+  /**
+   * @brief Construct a new backoff object.
+   *
+   * @param min The first delay.
+   * @param max The delay cap.
+   */
+  backoff(std::chrono::nanoseconds min = std::chrono::microseconds(1),
+          std::chrono::nanoseconds max = std::chrono::microseconds(256));
+
+  /**
+   * @brief Wait for the current delay and double it.
+   *
+   * @return pause_awaitable An awaitable to be `co_await`ed.
+   */
+  [[nodiscard]] pause_awaitable pause();
+
+  /**
+   * @brief Wait for the given multiple of the first delay, capped.
+   *
+   * @param factor The multiple of the first delay.
+   * @return pause_awaitable An awaitable to be `co_await`ed.
+   */
+  [[nodiscard]] pause_awaitable pause(uint64_t factor);
+
+  /**
+   * @brief Reset the delay to the minimum.
+   *
+   */
+  void reset();
+};
+
+/**
+ * @brief A test-and-set spinlock on a remote 64-bit word, which is 0 when
+ * unlocked and holds the owner id when locked.
+ *
+ */
+class remote_spinlock {
+  remote_atomic atomic_;
+  size_t const offset_;
+  uint64_t const owner_id_;
+
+public:
+  /**
+   * @brief Construct a new remote spinlock object.
+   *
+   * @param qp The connected Queue Pair to issue operations on.
+   * @param remote_mr The remote memory region holding the lock word.
+   * @param offset The byte offset of the lock word.
+   * @param owner_id A non-zero id of this client.
+   */
+  remote_spinlock(std::shared_ptr<qp> qp, remote_mr const &remote_mr,
+                  size_t offset, uint64_t owner_id);
+
+  /**
+   * @brief Acquire the lock, retrying with exponential backoff.
+   *
+   * @return lazy_task<void> A coroutine completing once the lock is held.
+   */
+  lazy_task<void> lock();
+
+  /**
+   * @brief Try to acquire the lock once.
+   *
+   * @return lazy_task<bool> A coroutine returning whether the lock is now held.
+   */
+  lazy_task<bool> try_lock();
+
+  /**
+   * @brief Release the lock.
+   *
+   * @return lazy_task<void> A coroutine completing once the lock is released.
+   */
+  lazy_task<void> unlock();
+};
+
+/**
+ * @brief A fair ticket lock on two remote 64-bit words: the next ticket at
+ * `offset` and the ticket being served at `offset + 8`. Waiters back off in
+ * proportion to their distance from the head of the queue.
+ *
+ */
+class remote_ticket_lock {
+  remote_atomic atomic_;
+  size_t const offset_;
+  uint64_t ticket_;
+
+public:
+  /**
+   * @brief Construct a new remote ticket lock object.
+   *
+   * @param qp The connected Queue Pair to issue operations on.
+   * @param remote_mr The remote memory region holding the lock words.
+   * @param offset The byte offset of the first lock word.
+   */
+  remote_ticket_lock(std::shared_ptr<qp> qp, remote_mr const &remote_mr,
+                     size_t offset);
+
+  /**
+   * @brief Take a ticket and wait until it is served.
+   *
+   * @return lazy_task<void> A coroutine completing once the lock is held.
+   */
+  lazy_task<void> lock();
+
+  /**
+   * @brief Serve the next ticket.
+   *
+   * @return lazy_task<void> A coroutine completing once the lock is released.
+   */
+  lazy_task<void> unlock();
+};
+
+/**
+ * @brief A reader-writer lock on a remote 64-bit word. The top bit marks a
+ * writer and the remaining bits count readers.
+ *
+ */
+class remote_rw_lock {
+  remote_atomic atomic_;
+  size_t const offset_;
+
+public:
+  /**
+   * @brief The bit set in the lock word while a writer holds the lock.
+   *
+   */
+  static constexpr uint64_t kWriterBit = uint64_t(1) << 63;
+
+  /**
+   * @brief Construct a new remote reader-writer lock object.
+   *
+   * @param qp The connected Queue Pair to issue operations on.
+   * @param remote_mr The remote memory region holding the lock word.
+   * @param offset The byte offset of the lock word.
+   */
+  remote_rw_lock(std::shared_ptr<qp> qp, remote_mr const &remote_mr,
+                 size_t offset);
+
+  /**
+   * @brief Acquire the lock for reading.
+   *
+   * @return lazy_task<void> A coroutine completing once the lock is held
+   * shared.
+   */
+  lazy_task<void> lock_shared();
+
+  /**
+   * @brief Release a shared hold of the lock.
+   *
+   * @return lazy_task<void> A coroutine completing once the lock is released.
+   */
+  lazy_task<void> unlock_shared();
+
+  /**
+   * @brief Acquire the lock for writing.
+   *
+   * @return lazy_task<void> A coroutine completing once the lock is held
+   * exclusively.
+   */
+  lazy_task<void> lock();
+
+  /**
+   * @brief Release an exclusive hold of the lock.
+   *
+   * @return lazy_task<void> A coroutine completing once the lock is released.
+   */
+  lazy_task<void> unlock();
+};
+
+/**
+ * @brief A monotonic sequence allocator on a remote 64-bit word. Ids are
+ * reserved from the remote word in blocks and handed out locally, so most
+ * calls do not touch the network. Ids are unique and increasing per client,
+ * but interleave between clients.
+ *
+ */
+class remote_sequence {
+  remote_atomic atomic_;
+  size_t const offset_;
+  uint64_t const block_size_;
+  uint64_t next_;
+  uint64_t end_;
+
+public:
+  /**
+   * @brief Construct a new remote sequence object.
+   *
+   * @param qp The connected Queue Pair to issue operations on.
+   * @param remote_mr The remote memory region holding the sequence word.
+   * @param offset The byte offset of the sequence word.
+   * @param block_size The number of ids reserved per remote operation.
+   */
+  remote_sequence(std::shared_ptr<qp> qp, remote_mr const &remote_mr,
+                  size_t offset, uint64_t block_size = 1);
+
+  /**
+   * @brief Allocate the next id.
+   *
+   * @return lazy_task<uint64_t> A coroutine returning the id.
+   */
+  lazy_task<uint64_t> next();
+};
+
+/**
+ * @brief A counter on a remote 64-bit word. Local increments are accumulated
+ * and applied with a single fetch-and-add once they reach a threshold or when
+ * flushed explicitly. `add` may be called from any thread.
+ *
+ */
+class remote_counter {
+  remote_atomic atomic_;
+  size_t const offset_;
+  uint64_t const flush_threshold_;
+  std::atomic<uint64_t> pending_;
+  std::atomic<bool> flushing_;
+  std::atomic<uint64_t> last_value_;
+
+public:
+  /**
+   * @brief Construct a new remote counter object.
+   *
+   * @param qp The connected Queue Pair to issue operations on.
+   * @param remote_mr The remote memory region holding the counter word.
+   * @param offset The byte offset of the counter word.
+   * @param flush_threshold The accumulated delta that triggers a flush.
+   */
+  remote_counter(std::shared_ptr<qp> qp, remote_mr const &remote_mr,
+                 size_t offset, uint64_t flush_threshold = 64);
+
+  /**
+   * @brief Add to the counter locally.
+   *
+   * @param delta The delta.
+   * @return true The threshold is reached and the caller should flush.
+   * @return false The delta was only accumulated.
+   */
+  bool add(uint64_t delta = 1);
+
+  /**
+   * @brief Apply all accumulated increments to the remote word with one
+   * fetch-and-add. A flush that overlaps another one returns immediately and
+   * leaves its increments to the next flush.
+   *
+   * @return lazy_task<uint64_t> A coroutine returning the last known remote
+   * value.
+   */
+  lazy_task<uint64_t> flush();
+};
+
+} // namespace rdmapp
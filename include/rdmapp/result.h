@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/error.h"
+
+namespace rdmapp {
+
+/**
+ * @brief Why an operation failed, as reported by the non-throwing awaitables.
+ *
+ */
+struct op_error {
+  enum class kind : uint8_t {
+    /**
+     * @brief The work completion carried an error status.
+     *
+     */
+    completion,
+    /**
+     * @brief The work request could not be posted; `code` is the errno.
+     *
+     */
+    post,
+    /**
+     * @brief The operation was rejected before posting because of its
+     * arguments; `code` is EINVAL.
+     *
+     */
+    invalid_argument,
+    /**
+     * @brief The operation was cancelled through its stop token.
+     *
+     */
+    cancelled,
+    /**
+     * @brief The operation did not complete before its deadline.
+     *
+     */
+    timed_out,
+  };
+
+  enum kind kind = kind::completion;
+  enum ibv_wc_status status = IBV_WC_GENERAL_ERR;
+  int code = 0;
+
+  static op_error from_status(enum ibv_wc_status status) noexcept {
+    return op_error{kind::completion, status, 0};
+  }
+
+  static op_error from_code(int code) noexcept {
+    return op_error{kind::post, IBV_WC_GENERAL_ERR, code};
+  }
+
+  static op_error from_invalid_argument() noexcept {
+    return op_error{kind::invalid_argument, IBV_WC_GENERAL_ERR, EINVAL};
+  }
+
+  /**
+   * @brief Convert an exception thrown while posting. Only used on the rare
+   * paths where posting is reported through an exception.
+   *
+   */
+  static op_error from_exception(std::exception_ptr exception) noexcept {
+    try {
+      std::rethrow_exception(exception);
+    } catch (verbs_error &e) {
+      return from_code(e.code());
+    } catch (std::invalid_argument &) {
+      return from_invalid_argument();
+    } catch (...) {
+      return from_code(EIO);
+    }
+  }
+
+  /**
+   * @brief Throw the exception that the throwing awaitables report for this
+   * error.
+   *
+   * @param message The prefix of the exception message.
+   */
+  [[noreturn]] void raise(const char *message) const {
+    switch (kind) {
+    case kind::completion:
+      check_wc_status(status, message);
+      break;
+    case kind::post:
+      throw_verbs_error(code, "%s: %s (errno=%d)", message, ::strerror(code),
+                        code);
+      break;
+    case kind::invalid_argument: {
+      char buffer[kErrorStringBufferSize];
+      ::snprintf(buffer, sizeof(buffer), "%s: invalid argument", message);
+      throw std::invalid_argument(buffer);
+    }
+    case kind::cancelled:
+      throw operation_cancelled("operation cancelled");
+    case kind::timed_out:
+      throw operation_timed_out("operation timed out");
+    }
+    throw_with("%s: unknown error", message);
+    std::terminate();
+  }
+};
+
+/**
+ * @brief The value of an operation or the reason it failed. Inspecting it
+ * never throws; `value` throws the same exception as the throwing awaitable.
+ *
+ * @tparam T The value type.
+ */
+template <class T> class [[nodiscard]] result {
+  std::variant<T, op_error> value_;
+
+public:
+  result(T value) : value_(std::in_place_index<0>, std::move(value)) {}
+  result(op_error error) : value_(std::in_place_index<1>, error) {}
+
+  bool has_value() const noexcept { return value_.index() == 0; }
+  explicit operator bool() const noexcept { return has_value(); }
+
+  op_error const &error() const noexcept {
+    assert(!has_value());
+    return std::get<1>(value_);
+  }
+
+  T &operator*() noexcept { return std::get<0>(value_); }
+  T const &operator*() const noexcept { return std::get<0>(value_); }
+  T *operator->() noexcept { return &std::get<0>(value_); }
+  T const *operator->() const noexcept { return &std::get<0>(value_); }
+
+  /**
+   * @brief Get the value, or throw if the operation failed.
+   *
+   * @param message The prefix of the exception message.
+   * @return T The value.
+   */
+  T value(const char *message = "operation failed") && {
+    if (!has_value()) [[unlikely]] {
+      error().raise(message);
+    }
+    return std::move(std::get<0>(value_));
+  }
+};
+
+template <> class [[nodiscard]] result<void> {
+  std::optional<op_error> error_;
+
+public:
+  result() = default;
+  result(op_error error) : error_(error) {}
+
+  bool has_value() const noexcept { return !error_.has_value(); }
+  explicit operator bool() const noexcept { return has_value(); }
+
+  op_error const &error() const noexcept {
+    assert(!has_value());
+    return *error_;
+  }
+
+  void value(const char *message = "operation failed") && {
+    if (!has_value()) [[unlikely]] {
+      error().raise(message);
+    }
+  }
+};
+
+/**
+ * @brief Adapts an awaitable with a non-throwing `try_resume` so that
+ * `co_await` yields its `result` instead of throwing. It refers to the
+ * adapted awaitable, which is normally a temporary of the same expression.
+ *
+ * @tparam Awaitable The adapted awaitable type.
+ */
+template <class Awaitable> class result_awaitable {
+  Awaitable &awaitable_;
+
+public:
+  explicit result_awaitable(Awaitable &awaitable) : awaitable_(awaitable) {}
+  bool await_ready() const noexcept { return awaitable_.await_ready(); }
+  template <class Handle> auto await_suspend(Handle h) noexcept {
+    return awaitable_.await_suspend(h);
+  }
+  auto await_resume() const noexcept { return awaitable_.try_resume(); }
+};
+
+} // namespace rdmapp
@@ -16,6 +16,7 @@ class srq {
   struct ibv_srq *srq_;
   std::shared_ptr<pd> pd_;
   friend class qp;
+  friend class ud_qp;
 
 public:
   /**
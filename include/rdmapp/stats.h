@@ -0,0 +1,177 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <infiniband/verbs.h>
+
+namespace rdmapp {
+
+class qp;
+class cq_poller;
+
+/**
+ * @brief The number of work requests and bytes of one opcode.
+ *
+ */
+struct opcode_stats {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+/**
+ * @brief A snapshot of the counters of a Queue Pair, taken by `qp::stats`.
+ * Completions, their sizes and their errors are counted by the `cq_poller` of
+ * the Completion Queue, see `cq_stats`.
+ *
+ */
+struct qp_stats {
+  static constexpr size_t kNrOpcodes = IBV_WR_ATOMIC_FETCH_AND_ADD + 2;
+
+  uint32_t qp_num = 0;
+
+  /**
+   * @brief Send work requests posted to the send queue and their payload bytes,
+   * indexed by `opcode_index`.
+   *
+   */
+  std::array<opcode_stats, kNrOpcodes> sends_posted = {};
+
+  /**
+   * @brief Send work requests whose send queue slots were returned, i.e.
+   * that completed or failed.
+   *
+   */
+  uint64_t sends_completed = 0;
+
+  /**
+   * @brief Send chains that had to wait for send queue slots. A high rate
+   * means the send queue depth limits the throughput.
+   *
+   */
+  uint64_t sends_deferred = 0;
+
+  /**
+   * @brief Send chains that could not be posted.
+   *
+   */
+  uint64_t send_post_errors = 0;
+
+  uint64_t recvs_posted = 0;
+  uint64_t recv_post_errors = 0;
+
+  /**
+   * @brief Send work requests posted and not yet completed.
+   *
+   */
+  uint32_t outstanding_sends = 0;
+
+  static size_t opcode_index(enum ibv_wr_opcode opcode);
+  static char const *opcode_name(size_t index);
+};
+
+/**
+ * @brief A snapshot of the counters of a `cq_poller`, taken by
+ * `cq_poller::stats`.
+ *
+ */
+struct cq_stats {
+  static constexpr size_t kNrOpcodes = 11;
+  static constexpr size_t kNrStatuses = IBV_WC_TM_RNDV_INCOMPLETE + 1;
+
+  /**
+   * @brief The name the poller was registered with, if any.
+   *
+   */
+  std::string name;
+
+  size_t batch_size = 0;
+  uint64_t polls = 0;
+  uint64_t empty_polls = 0;
+  uint64_t completions = 0;
+
+  /**
+   * @brief Successful completions and the bytes they report, indexed by
+   * `opcode_index`.
+   *
+   */
+  std::array<opcode_stats, kNrOpcodes> by_opcode = {};
+
+  /**
+   * @brief Failed completions, indexed by `enum ibv_wc_status`. The entry of
+   * `IBV_WC_SUCCESS` is unused.
+   *
+   */
+  std::array<uint64_t, kNrStatuses> errors = {};
+
+  /**
+   * @brief The average share of the batch filled by the polls that returned
+   * completions. A ratio close to 1 means the batch size should be raised.
+   *
+   * @return double The ratio, or 0 if no poll returned completions.
+   */
+  double batch_fill_ratio() const;
+
+  static size_t opcode_index(enum ibv_wc_opcode opcode);
+  static char const *opcode_name(size_t index);
+};
+
+/**
+ * @brief The counters of a set of Queue Pairs and pollers at one point in
+ * time.
+ *
+ */
+struct stats_snapshot {
+  std::vector<qp_stats> qps;
+  std::vector<cq_stats> cqs;
+
+  /**
+   * @brief Format the snapshot in the Prometheus text exposition format.
+   *
+   * @return std::string The metrics, ready to be served on `/metrics`.
+   */
+  std::string to_prometheus() const;
+};
+
+/**
+ * @brief Keeps track of the Queue Pairs and pollers to export counters for.
+ * It only holds weak references, so registered objects that are destroyed
+ * silently drop out of the snapshots.
+ *
+ */
+class stats_registry {
+  std::mutex mutex_;
+  std::vector<std::weak_ptr<qp>> qps_;
+  std::vector<std::pair<std::string, std::weak_ptr<cq_poller>>> pollers_;
+
+public:
+  /**
+   * @brief Register a Queue Pair.
+   *
+   * @param qp The Queue Pair.
+   */
+  void add(std::shared_ptr<qp> qp);
+
+  /**
+   * @brief Register a poller.
+   *
+   * @param name The value of the `cq` label of its metrics.
+   * @param poller The poller.
+   */
+  void add(std::string name, std::shared_ptr<cq_poller> poller);
+
+  /**
+   * @brief Take a snapshot of all live registered objects.
+   *
+   * @return stats_snapshot The snapshot.
+   */
+  stats_snapshot snapshot();
+};
+
+} // namespace rdmapp
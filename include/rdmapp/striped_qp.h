@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/mr.h"
+#include "rdmapp/qp.h"
+
+#include "rdmapp/detail/noncopyable.h"
+
+namespace rdmapp {
+
+/**
+ * @brief This class groups several Queue Pairs connected to the same peer and
+ * stripes large transfers across them. The Queue Pairs may belong to different
+ * ports or devices, in which case each of them needs its own memory regions.
+ *
+ */
+class striped_qp : public noncopyable {
+  std::vector<std::shared_ptr<qp>> qps_;
+
+public:
+  /**
+   * @brief Striped transfers run on the bulk transfer engine of the Queue
+   * Pair, with one lane per Queue Pair of the group.
+   *
+   */
+  using bulk_awaitable = qp::bulk_awaitable;
+
+  /**
+   * @brief Construct a new striped qp object.
+   *
+   * @param qps The connected Queue Pairs to stripe over. They should all be in
+   * the RTS state and connected to the same peer.
+   */
+  striped_qp(std::vector<std::shared_ptr<qp>> qps);
+
+  /**
+   * @brief Get the number of Queue Pairs in the group.
+   *
+   * @return size_t The number of Queue Pairs.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Get a Queue Pair of the group.
+   *
+   * @param i The index of the Queue Pair.
+   * @return std::shared_ptr<qp> The Queue Pair.
+   */
+  std::shared_ptr<qp> at(size_t i) const;
+
+  /**
+   * @brief This function writes a large registered local memory region to
+   * remote, striped across all Queue Pairs. All Queue Pairs must share the
+   * Protection Domain of the memory region.
+   *
+   * @param remote_mr Remote memory region handle.
+   * @param local_mr Registered local memory region, whose lifetime is
+   * controlled by a smart pointer.
+   * @param chunk_size The size of each chunk. It is rounded up to a multiple of
+   * the path MTU.
+   * @param window The maximum number of chunks in flight per Queue Pair.
+   * @return bulk_awaitable A coroutine returning length of the data written.
+   */
+  [[nodiscard]] bulk_awaitable
+  write_bulk(remote_mr const &remote_mr, std::shared_ptr<local_mr> local_mr,
+             size_t chunk_size = qp::kDefaultBulkChunkSize,
+             size_t window = qp::kDefaultBulkWindow);
+
+  /**
+   * @brief This function reads a large remote memory region to a registered
+   * local memory region, striped across all Queue Pairs. All Queue Pairs must
+   * share the Protection Domain of the memory region.
+   *
+   * @param remote_mr Remote memory region handle.
+   * @param local_mr Registered local memory region, whose lifetime is
+   * controlled by a smart pointer.
+   * @param chunk_size The size of each chunk. It is rounded up to a multiple of
+   * the path MTU.
+   * @param window The maximum number of chunks in flight per Queue Pair.
+   * @return bulk_awaitable A coroutine returning length of the data read.
+   */
+  [[nodiscard]] bulk_awaitable
+  read_bulk(remote_mr const &remote_mr, std::shared_ptr<local_mr> local_mr,
+            size_t chunk_size = qp::kDefaultBulkChunkSize,
+            size_t window = qp::kDefaultBulkWindow);
+
+  /**
+   * @brief This function writes a large local buffer to remote, striped across
+   * Queue Pairs on different ports or devices. The i-th memory regions are used
+   * by the i-th Queue Pair and must all describe the same buffers.
+   *
+   * @param remote_mrs Remote memory region handles, one per Queue Pair.
+   * @param local_mrs Registered local memory regions, one per Queue Pair.
+   * @param chunk_size The size of each chunk. It is rounded up to a multiple of
+   * the path MTU.
+   * @param window The maximum number of chunks in flight per Queue Pair.
+   * @return bulk_awaitable A coroutine returning length of the data written.
+   */
+  [[nodiscard]] bulk_awaitable
+  write_bulk(std::vector<remote_mr> const &remote_mrs,
+             std::vector<std::shared_ptr<local_mr>> const &local_mrs,
+             size_t chunk_size = qp::kDefaultBulkChunkSize,
+             size_t window = qp::kDefaultBulkWindow);
+
+  /**
+   * @brief This function reads a large remote buffer to local, striped across
+   * Queue Pairs on different ports or devices. The i-th memory regions are used
+   * by the i-th Queue Pair and must all describe the same buffers.
+   *
+   * @param remote_mrs Remote memory region handles, one per Queue Pair.
+   * @param local_mrs Registered local memory regions, one per Queue Pair.
+   * @param chunk_size The size of each chunk. It is rounded up to a multiple of
+   * the path MTU.
+   * @param window The maximum number of chunks in flight per Queue Pair.
+   * @return bulk_awaitable A coroutine returning length of the data read.
+   */
+  [[nodiscard]] bulk_awaitable
+  read_bulk(std::vector<remote_mr> const &remote_mrs,
+            std::vector<std::shared_ptr<local_mr>> const &local_mrs,
+            size_t chunk_size = qp::kDefaultBulkChunkSize,
+            size_t window = qp::kDefaultBulkWindow);
+};
+
+} // namespace rdmapp
@@ -6,6 +6,8 @@
 #include <future>
 #include <utility>
 
+#include "rdmapp/frame_allocator.h"
+
 namespace rdmapp {
 
 template <class T> class value_returner {
@@ -21,7 +23,8 @@ public:
 };
 
 template <class T, class CoroutineHandle>
-struct promise_base : public value_returner<T> {
+struct promise_base : public value_returner<T>,
+                      public detail::pooled_frame {
   std::suspend_never initial_suspend() { return {}; }
   auto final_suspend() noexcept {
     struct awaiter {
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+
+#include "rdmapp/frame_allocator.h"
+
+#include "rdmapp/detail/noncopyable.h"
+
+namespace rdmapp {
+
+class task_group;
+
+namespace detail {
+
+/**
+ * @brief A child of a `task_group`. Once started, it owns its frame and
+ * destroys it when it completes.
+ *
+ */
+class group_task {
+public:
+  struct promise_type : public pooled_frame {
+    task_group *group_ = nullptr;
+
+    group_task get_return_object() noexcept {
+      return group_task(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    struct final_awaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+      void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    final_awaiter final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept;
+  };
+
+private:
+  std::coroutine_handle<promise_type> h_;
+
+public:
+  explicit group_task(std::coroutine_handle<promise_type> h) noexcept
+      : h_(h) {}
+  group_task(group_task &&other) noexcept : h_(std::exchange(other.h_, {})) {}
+  group_task(group_task const &) = delete;
+  ~group_task() {
+    if (h_) {
+      h_.destroy();
+    }
+  }
+
+  void start(task_group *group) noexcept {
+    auto h = std::exchange(h_, {});
+    h.promise().group_ = group;
+    h.resume();
+  }
+};
+
+template <class Awaitable> group_task make_group_task(Awaitable awaitable) {
+  co_await awaitable;
+}
+
+} // namespace detail
+
+/**
+ * @brief A scope for child tasks that runs at most a fixed number of them at
+ * once. Spawning suspends the spawner while the group is full, so a producer
+ * of many transfers cannot overrun queue depths or memory. The first child to
+ * fail stops the group: children that have not been started yet are dropped,
+ * and running children can observe the stop token. The group must be joined
+ * before it is destroyed.
+ *
+ */
+class task_group : public noncopyable {
+  friend class detail::group_task;
+
+public:
+  class spawn_awaitable {
+    friend class task_group;
+    task_group &group_;
+    detail::group_task child_;
+    std::coroutine_handle<> h_;
+    bool admitted_;
+
+  public:
+    spawn_awaitable(task_group &group, detail::group_task child);
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<> h) noexcept;
+    void await_resume();
+  };
+
+  class join_awaitable {
+    task_group &group_;
+
+  public:
+    explicit join_awaitable(task_group &group);
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<> h) noexcept;
+    void await_resume() const;
+  };
+
+private:
+  mutable std::mutex mutex_;
+  const size_t max_concurrency_;
+  size_t active_;
+  std::deque<spawn_awaitable *> waiters_;
+  std::coroutine_handle<> joiner_;
+  std::exception_ptr exception_;
+  std::stop_source stop_source_;
+
+  std::coroutine_handle<> on_child_done() noexcept;
+  void on_child_failed(std::exception_ptr exception) noexcept;
+
+public:
+  /**
+   * @brief Construct a new task group object.
+   *
+   * @param max_concurrency The maximum number of children running at once.
+   */
+  explicit task_group(size_t max_concurrency);
+
+  /**
+   * @brief Spawn a child. The returned awaitable completes once the child has
+   * been started, which waits for a running child to finish if the group is
+   * full. The child is dropped without being started if the group has been
+   * stopped.
+   *
+   * @param awaitable The child, e.g. a `lazy_task<void>`. It is moved into the
+   * group and its result is discarded.
+   * @return spawn_awaitable An awaitable to be `co_await`ed by the spawner.
+   */
+  template <class Awaitable> spawn_awaitable spawn(Awaitable &&awaitable) {
+    return spawn_awaitable(
+        *this, detail::make_group_task<std::remove_cvref_t<Awaitable>>(
+                   std::forward<Awaitable>(awaitable)));
+  }
+
+  /**
+   * @brief Wait for all children to finish.
+   *
+   * @return join_awaitable An awaitable that rethrows the exception of the
+   * first failed child, if any.
+   */
+  join_awaitable join();
+
+  /**
+   * @brief Stop the group. Children not started yet are dropped.
+   *
+   */
+  void request_stop() noexcept;
+
+  /**
+   * @brief Get the stop token of the group. It is signaled when the group is
+   * stopped, either explicitly or because a child failed.
+   *
+   * @return std::stop_token The stop token.
+   */
+  std::stop_token get_stop_token() const noexcept;
+
+  /**
+   * @brief Get the number of running children.
+   *
+   * @return size_t The number of running children.
+   */
+  size_t active() const;
+
+  ~task_group();
+};
+
+} // namespace rdmapp
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+
+namespace rdmapp {
+
+/**
+ * @brief The points of the data path that emit trace events.
+ *
+ */
+enum class trace_event : uint8_t {
+  /**
+   * @brief A send work request is handed to the device.
+   *
+   */
+  post_send,
+  /**
+   * @brief A receive work request is handed to the device.
+   *
+   */
+  post_recv,
+  /**
+   * @brief A work completion is polled from a Completion Queue.
+   *
+   */
+  poll,
+  /**
+   * @brief A work completion is queued to an executor.
+   *
+   */
+  enqueue,
+  /**
+   * @brief An executor worker takes a work completion off its queue.
+   *
+   */
+  dequeue,
+  /**
+   * @brief The coroutine waiting for a work completion is resumed.
+   *
+   */
+  resume,
+};
+
+/**
+ * @brief One trace event. Fields that do not apply to the event are 0: work
+ * requests have no status, and completions queued by `executor::post` belong
+ * to no Queue Pair.
+ *
+ */
+struct trace_record {
+  trace_event event;
+  uint64_t wr_id;
+  uint32_t qp_num;
+  /**
+   * @brief The `enum ibv_wr_opcode` of posted sends, the
+   * `enum ibv_wc_opcode` of completions, and 0 for posted receives.
+   *
+   */
+  uint32_t opcode;
+  uint32_t status;
+  /**
+   * @brief `std::chrono::steady_clock` time of the event in nanoseconds.
+   *
+   */
+  uint64_t timestamp_ns;
+};
+
+/**
+ * @brief A function called synchronously for every trace event, on the thread
+ * that emits it. It must be thread-safe and should be cheap, e.g. append to a
+ * per-thread buffer.
+ *
+ */
+using trace_hook = void (*)(trace_record const &record);
+
+/**
+ * @brief Install the trace hook, or remove it with nullptr. Trace events are
+ * compiled in with `-DRDMAPP_TRACE=hooks`; with `-DRDMAPP_TRACE=usdt` they are
+ * USDT probes of provider `rdmapp` for tools such as bpftrace instead, and by
+ * default there are none.
+ *
+ * @param hook The hook.
+ * @return true If the hook was installed.
+ * @return false If the library was built without trace hooks.
+ */
+bool set_trace_hook(trace_hook hook) noexcept;
+
+} // namespace rdmapp
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/cq.h"
+#include "rdmapp/mr.h"
+#include "rdmapp/pd.h"
+#include "rdmapp/srq.h"
+
+#include "rdmapp/detail/noncopyable.h"
+#include "rdmapp/detail/serdes.h"
+
+namespace rdmapp {
+
+/**
+ * @brief This class is an abstraction of an Address Handle, which describes
+ * the path to a remote port for Unreliable Datagram sends.
+ *
+ */
+class address_handle : public noncopyable {
+  struct ibv_ah *ah_;
+  std::shared_ptr<pd> pd_;
+  friend class ud_qp;
+
+public:
+  /**
+   * @brief Construct a new address handle object.
+   *
+   * @param pd The protection domain to use.
+   * @param lid The remote LID.
+   * @param gid The remote GID.
+   */
+  address_handle(std::shared_ptr<pd> pd, uint16_t lid, union ibv_gid gid);
+
+  /**
+   * @brief Destroy the address handle object.
+   *
+   */
+  ~address_handle();
+};
+
+/**
+ * @brief This class is an abstraction of an Unreliable Datagram Queue Pair. A
+ * single UD Queue Pair can exchange messages up to the path MTU with any
+ * number of peers without per-peer connection state. Address Handles of
+ * recently used peers are kept in an LRU cache.
+ *
+ */
+class ud_qp : public noncopyable, public std::enable_shared_from_this<ud_qp> {
+public:
+  /**
+   * @brief The size of the Global Routing Header that precedes every received
+   * datagram in the receive buffer.
+   *
+   */
+  static constexpr size_t kGrhBytes = 40;
+
+  /**
+   * @brief The default Q_Key of UD Queue Pairs.
+   *
+   */
+  static constexpr uint32_t kDefaultQkey = 0x11111111;
+
+  /**
+   * @brief The address of a UD Queue Pair. It is exchanged out of band before
+   * peers can talk to each other.
+   *
+   */
+  struct endpoint {
+    static constexpr size_t kSerializedSize =
+        sizeof(uint16_t) + 2 * sizeof(uint32_t) + sizeof(union ibv_gid);
+    uint16_t lid;
+    uint32_t qp_num;
+    uint32_t qkey;
+    union ibv_gid gid;
+
+    /**
+     * @brief Serialize the endpoint to be sent to a remote peer.
+     *
+     * @return std::vector<uint8_t> The serialized endpoint.
+     */
+    std::vector<uint8_t> serialize() const;
+
+    /**
+     * @brief Deserialize an endpoint.
+     *
+     * @tparam It The iterator type.
+     * @param it The iterator to deserialize from.
+     * @return endpoint The deserialized endpoint.
+     */
+    template <class It> static endpoint deserialize(It it) {
+      endpoint ep;
+      detail::deserialize(it, ep.lid);
+      detail::deserialize(it, ep.qp_num);
+      detail::deserialize(it, ep.qkey);
+      detail::deserialize(it, ep.gid);
+      return ep;
+    }
+  };
+
+  /**
+   * @brief The outcome of a datagram receive.
+   *
+   */
+  struct recv_result {
+    uint32_t length;
+    uint32_t src_qp;
+    uint16_t slid;
+    std::optional<union ibv_gid> sgid;
+    std::optional<uint32_t> imm;
+  };
+
+  class send_awaitable {
+    std::shared_ptr<ud_qp> qp_;
+    std::shared_ptr<local_mr> local_mr_;
+    std::shared_ptr<address_handle> ah_;
+    std::exception_ptr exception_;
+    uint32_t remote_qpn_;
+    uint32_t remote_qkey_;
+    std::optional<uint32_t> imm_;
+    struct ibv_wc wc_;
+
+  public:
+    send_awaitable(std::shared_ptr<ud_qp> qp,
+                   std::shared_ptr<local_mr> local_mr,
+                   endpoint const &remote, std::optional<uint32_t> imm);
+    send_awaitable(std::shared_ptr<ud_qp> qp, void *buffer, size_t length,
+                   endpoint const &remote, std::optional<uint32_t> imm);
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<> h) noexcept;
+    uint32_t await_resume() const;
+  };
+
+  class recv_awaitable {
+    std::shared_ptr<ud_qp> qp_;
+    std::shared_ptr<local_mr> local_mr_;
+    std::exception_ptr exception_;
+    struct ibv_wc wc_;
+
+  public:
+    recv_awaitable(std::shared_ptr<ud_qp> qp,
+                   std::shared_ptr<local_mr> local_mr);
+    recv_awaitable(std::shared_ptr<ud_qp> qp, void *buffer, size_t length);
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<> h) noexcept;
+    recv_result await_resume() const;
+  };
+
+private:
+  struct ah_key {
+    uint16_t lid;
+    uint32_t qp_num;
+    union ibv_gid gid;
+    bool operator==(ah_key const &other) const;
+  };
+  struct ah_key_hash {
+    size_t operator()(ah_key const &key) const;
+  };
+  using ah_lru_list =
+      std::list<std::pair<ah_key, std::shared_ptr<address_handle>>>;
+
+  static std::atomic<uint32_t> next_sq_psn;
+  struct ibv_qp *qp_;
+  struct ibv_srq *raw_srq_;
+  uint32_t sq_psn_;
+  uint32_t qkey_;
+
+  std::shared_ptr<pd> pd_;
+  std::shared_ptr<cq> recv_cq_;
+  std::shared_ptr<cq> send_cq_;
+  std::shared_ptr<srq> srq_;
+
+  std::mutex ah_mutex_;
+  size_t const ah_cache_capacity_;
+  ah_lru_list ah_lru_;
+  std::unordered_map<ah_key, ah_lru_list::iterator, ah_key_hash> ah_cache_;
+
+  void create();
+  void init();
+  void rtr();
+  void rts();
+  void destroy();
+  std::optional<union ibv_gid> source_gid(struct ibv_wc const &wc,
+                                          void *grh) const;
+
+public:
+  /**
+   * @brief Construct a new UD qp object. Once constructed, the Queue Pair will
+   * be in the RTS state and ready to exchange datagrams.
+   *
+   * @param pd The protection domain of the new Queue Pair.
+   * @param cq The completion queue of both send and recv work completions.
+   * @param srq (Optional) If set, all recv work requests will be posted to this
+   * SRQ.
+   * @param ah_cache_capacity The maximum number of cached Address Handles.
+   * @param qkey The Q_Key of the new Queue Pair.
+   */
+  ud_qp(std::shared_ptr<pd> pd, std::shared_ptr<cq> cq,
+        std::shared_ptr<srq> srq = nullptr, size_t ah_cache_capacity = 1024,
+        uint32_t qkey = kDefaultQkey);
+
+  /**
+   * @brief Construct a new UD qp object. Once constructed, the Queue Pair will
+   * be in the RTS state and ready to exchange datagrams.
+   *
+   * @param pd The protection domain of the new Queue Pair.
+   * @param recv_cq The completion queue of recv work completions.
+   * @param send_cq The completion queue of send work completions.
+   * @param srq (Optional) If set, all recv work requests will be posted to this
+   * SRQ.
+   * @param ah_cache_capacity The maximum number of cached Address Handles.
+   * @param qkey The Q_Key of the new Queue Pair.
+   */
+  ud_qp(std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+        std::shared_ptr<cq> send_cq, std::shared_ptr<srq> srq = nullptr,
+        size_t ah_cache_capacity = 1024, uint32_t qkey = kDefaultQkey);
+
+  /**
+   * @brief Get the address of this Queue Pair to hand out to peers.
+   *
+   * @return endpoint The local endpoint.
+   */
+  endpoint local_endpoint() const;
+
+  /**
+   * @brief Get the Address Handle of a peer, creating and caching it if
+   * needed. The least recently used handle is evicted when the cache is full.
+   *
+   * @param remote The remote endpoint.
+   * @return std::shared_ptr<address_handle> The Address Handle.
+   */
+  std::shared_ptr<address_handle> get_ah(endpoint const &remote);
+
+  /**
+   * @brief This function is used to post a send work request to the Queue Pair.
+   *
+   * @param send_wr The work request to post.
+   * @param bad_send_wr A pointer to a work request that will be set to the
+   * first work request that failed to post.
+   */
+  void post_send(struct ibv_send_wr const &send_wr,
+                 struct ibv_send_wr *&bad_send_wr);
+
+  /**
+   * @brief This function is used to post a recv work request to the Queue Pair
+   * or its SRQ.
+   *
+   * @param recv_wr The work request to post.
+   * @param bad_recv_wr A pointer to a work request that will be set to the
+   * first work request that failed to post.
+   */
+  void post_recv(struct ibv_recv_wr const &recv_wr,
+                 struct ibv_recv_wr *&bad_recv_wr) const;
+
+  /**
+   * @brief This function sends a registered local memory region as a datagram
+   * to a peer.
+   *
+   * @param remote The remote endpoint.
+   * @param local_mr Registered local memory region no larger than the path
+   * MTU, whose lifetime is controlled by a smart pointer.
+   * @return send_awaitable A coroutine returning length of the data sent.
+   */
+  [[nodiscard]] send_awaitable send(endpoint const &remote,
+                                    std::shared_ptr<local_mr> local_mr);
+
+  /**
+   * @brief This function sends a registered local memory region as a datagram
+   * with an immediate value to a peer.
+   *
+   * @param remote The remote endpoint.
+   * @param local_mr Registered local memory region no larger than the path
+   * MTU, whose lifetime is controlled by a smart pointer.
+   * @param imm The immediate value.
+   * @return send_awaitable A coroutine returning length of the data sent.
+   */
+  [[nodiscard]] send_awaitable send_with_imm(endpoint const &remote,
+                                             std::shared_ptr<local_mr> local_mr,
+                                             uint32_t imm);
+
+  /**
+   * @brief This method sends a local buffer as a datagram to a peer. The
+   * buffer will be registered as a memory region first and then deregistered
+   * upon completion.
+   *
+   * @param remote The remote endpoint.
+   * @param buffer Pointer to local buffer. It should be valid until completion.
+   * @param length The length of the local buffer.
+   * @return send_awaitable A coroutine returning length of the data sent.
+   */
+  [[nodiscard]] send_awaitable send(endpoint const &remote, void *buffer,
+                                    size_t length);
+
+  /**
+   * @brief This function posts a datagram receive. The first `kGrhBytes` bytes
+   * of the memory region receive the Global Routing Header and the payload
+   * follows.
+   *
+   * @param local_mr Registered local memory region, whose lifetime is
+   * controlled by a smart pointer.
+   * @return recv_awaitable A coroutine returning the payload length and the
+   * sender.
+   */
+  [[nodiscard]] recv_awaitable recv(std::shared_ptr<local_mr> local_mr);
+
+  /**
+   * @brief This method posts a datagram receive. The buffer will be registered
+   * as a memory region first and then deregistered upon completion. The first
+   * `kGrhBytes` bytes of the buffer receive the Global Routing Header and the
+   * payload follows.
+   *
+   * @param buffer Pointer to local buffer. It should be valid until completion.
+   * @param length The length of the local buffer including the GRH.
+   * @return recv_awaitable A coroutine returning the payload length and the
+   * sender.
+   */
+  [[nodiscard]] recv_awaitable recv(void *buffer, size_t length);
+
+  /**
+   * @brief This function provides access to the Protection Domain of the Queue
+   * Pair.
+   *
+   * @return std::shared_ptr<pd> Pointer to the PD.
+   */
+  std::shared_ptr<pd> pd_ptr() const;
+
+  ~ud_qp();
+};
+
+} // namespace rdmapp
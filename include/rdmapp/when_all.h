@@ -0,0 +1,233 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "rdmapp/lazy_task.h"
+
+namespace rdmapp {
+
+namespace detail {
+
+/**
+ * @brief Counts the children of a `when_all` that are still running. It
+ * starts at one more than the number of children; the extra count belongs to
+ * the awaiting coroutine, so whichever of them finishes last resumes it.
+ *
+ */
+class when_all_counter {
+  std::atomic<size_t> count_;
+  std::coroutine_handle<> awaiting_;
+
+public:
+  explicit when_all_counter(size_t children) noexcept
+      : count_(children + 1) {}
+
+  bool try_suspend(std::coroutine_handle<> awaiting) noexcept {
+    awaiting_ = awaiting;
+    return count_.fetch_sub(1, std::memory_order_acq_rel) > 1;
+  }
+
+  std::coroutine_handle<> notify() noexcept {
+    if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      return awaiting_;
+    }
+    return std::noop_coroutine();
+  }
+};
+
+template <class T> class when_all_task {
+public:
+  struct promise_type : public pooled_frame {
+    when_all_counter *counter_ = nullptr;
+    std::variant<std::monostate, T, std::exception_ptr> result_;
+
+    when_all_task get_return_object() noexcept {
+      return when_all_task(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+      struct awaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+          return h.promise().counter_->notify();
+        }
+        void await_resume() noexcept {}
+      };
+      return awaiter{};
+    }
+    template <class U> void return_value(U &&value) {
+      result_.template emplace<1>(std::forward<U>(value));
+    }
+    void unhandled_exception() noexcept {
+      result_.template emplace<2>(std::current_exception());
+    }
+  };
+
+private:
+  std::coroutine_handle<promise_type> h_;
+
+public:
+  explicit when_all_task(std::coroutine_handle<promise_type> h) noexcept
+      : h_(h) {}
+  when_all_task(when_all_task &&other) noexcept
+      : h_(std::exchange(other.h_, {})) {}
+  when_all_task(when_all_task const &) = delete;
+  ~when_all_task() {
+    if (h_) {
+      h_.destroy();
+    }
+  }
+
+  void start(when_all_counter &counter) noexcept {
+    h_.promise().counter_ = &counter;
+    h_.resume();
+  }
+
+  void rethrow_if_failed() const {
+    if (h_.promise().result_.index() == 2) [[unlikely]] {
+      std::rethrow_exception(std::get<2>(h_.promise().result_));
+    }
+  }
+
+  T result() { return std::move(std::get<1>(h_.promise().result_)); }
+};
+
+/**
+ * @brief Await a single child of a `when_all`. `Awaitable` is either a value
+ * type, in which case the child owns the awaitable, or a reference to an
+ * awaitable that outlives the `when_all`.
+ *
+ */
+template <class Awaitable>
+when_all_task<non_void_result_t<Awaitable>>
+make_when_all_task(Awaitable awaitable) {
+  if constexpr (std::is_void_v<await_result_t<Awaitable>>) {
+    co_await awaitable;
+    co_return std::monostate{};
+  } else {
+    co_return co_await awaitable;
+  }
+}
+
+/**
+ * @brief Arguments that are lvalues or cannot be moved are held by
+ * reference. The latter are temporaries, which live until the end of the full
+ * expression containing the `co_await`.
+ *
+ */
+template <class Awaitable>
+using when_all_stored_t = std::conditional_t<
+    std::is_lvalue_reference_v<Awaitable> ||
+        !std::is_move_constructible_v<std::remove_cvref_t<Awaitable>>,
+    Awaitable &&, std::remove_cvref_t<Awaitable>>;
+
+template <class... Ts> class when_all_awaitable {
+  when_all_counter counter_;
+  std::tuple<when_all_task<Ts>...> tasks_;
+
+public:
+  explicit when_all_awaitable(when_all_task<Ts>... tasks)
+      : counter_(sizeof...(Ts)), tasks_(std::move(tasks)...) {}
+
+  bool await_ready() const noexcept { return sizeof...(Ts) == 0; }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    std::apply([this](auto &...tasks) { (tasks.start(counter_), ...); },
+               tasks_);
+    return counter_.try_suspend(h);
+  }
+
+  std::tuple<Ts...> await_resume() {
+    std::apply([](auto &...tasks) { (tasks.rethrow_if_failed(), ...); },
+               tasks_);
+    return std::apply(
+        [](auto &...tasks) { return std::tuple<Ts...>(tasks.result()...); },
+        tasks_);
+  }
+};
+
+template <class Awaitable> class when_all_vector_awaitable {
+  using result_type = non_void_result_t<Awaitable &>;
+  std::vector<Awaitable> awaitables_;
+  std::vector<when_all_task<result_type>> tasks_;
+  when_all_counter counter_;
+
+public:
+  explicit when_all_vector_awaitable(std::vector<Awaitable> awaitables)
+      : awaitables_(std::move(awaitables)), counter_(awaitables_.size()) {
+    tasks_.reserve(awaitables_.size());
+    for (auto &awaitable : awaitables_) {
+      tasks_.emplace_back(make_when_all_task<Awaitable &>(awaitable));
+    }
+  }
+
+  bool await_ready() const noexcept { return tasks_.empty(); }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    for (auto &task : tasks_) {
+      task.start(counter_);
+    }
+    return counter_.try_suspend(h);
+  }
+
+  std::vector<result_type> await_resume() {
+    for (auto &task : tasks_) {
+      task.rethrow_if_failed();
+    }
+    std::vector<result_type> results;
+    results.reserve(tasks_.size());
+    for (auto &task : tasks_) {
+      results.emplace_back(task.result());
+    }
+    return results;
+  }
+};
+
+} // namespace detail
+
+/**
+ * @brief Await several awaitables at once. All of them are started, so every
+ * operation is posted, before the awaiting coroutine suspends, and it is
+ * resumed once, after the last one completes.
+ *
+ * @param awaitables The awaitables, e.g. `send_awaitable`, `recv_awaitable`,
+ * `task` or `lazy_task`. Lvalues and awaitables that cannot be moved are
+ * held by reference and must outlive the `co_await`.
+ * @return An awaitable that yields a tuple of the results in argument order,
+ * with `void` results as `std::monostate`. If any of them failed, the
+ * exception of the first failed one in argument order is rethrown after all
+ * of them have completed.
+ */
+template <class... Awaitables> auto when_all(Awaitables &&...awaitables) {
+  return detail::when_all_awaitable<detail::non_void_result_t<
+      detail::when_all_stored_t<Awaitables>>...>(
+      detail::make_when_all_task<detail::when_all_stored_t<Awaitables>>(
+          std::forward<Awaitables>(awaitables))...);
+}
+
+/**
+ * @brief Await a vector of awaitables at once. All of them are started before
+ * the awaiting coroutine suspends.
+ *
+ * @param awaitables The awaitables. The returned awaitable owns them.
+ * @return An awaitable that yields a vector of the results in order. If any
+ * of them failed, the exception of the first failed one is rethrown after all
+ * of them have completed.
+ */
+template <class Awaitable>
+detail::when_all_vector_awaitable<Awaitable>
+when_all(std::vector<Awaitable> awaitables) {
+  return detail::when_all_vector_awaitable<Awaitable>(std::move(awaitables));
+}
+
+} // namespace rdmapp
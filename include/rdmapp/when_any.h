@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "rdmapp/lazy_task.h"
+
+namespace rdmapp {
+
+namespace detail {
+
+/**
+ * @brief The state shared by the children of a `when_any` and the awaiting
+ * coroutine. It outlives the `when_any` awaitable, because the children that
+ * lose keep running until their operations complete.
+ *
+ */
+class when_any_state_base {
+  std::atomic<bool> decided_ = false;
+  std::atomic<bool> ready_ = false;
+  std::coroutine_handle<> awaiting_;
+
+public:
+  std::exception_ptr exception_;
+
+  bool decided() const noexcept {
+    return decided_.load(std::memory_order_acquire);
+  }
+
+  bool try_win() noexcept {
+    return !decided_.exchange(true, std::memory_order_acq_rel);
+  }
+
+  /**
+   * @brief Both the winner and the awaiting coroutine call into this state
+   * once; whichever comes second resumes the awaiting coroutine.
+   *
+   */
+  bool try_suspend(std::coroutine_handle<> awaiting) noexcept {
+    awaiting_ = awaiting;
+    return !ready_.exchange(true, std::memory_order_acq_rel);
+  }
+
+  std::coroutine_handle<> notify() noexcept {
+    if (ready_.exchange(true, std::memory_order_acq_rel)) {
+      return awaiting_;
+    }
+    return std::noop_coroutine();
+  }
+};
+
+template <class Result> class when_any_state : public when_any_state_base {
+public:
+  std::optional<Result> result_;
+};
+
+/**
+ * @brief A child of a `when_any`. Once started, it owns its frame and
+ * destroys it when it completes.
+ *
+ */
+class when_any_task {
+public:
+  struct promise_type : public pooled_frame {
+    std::shared_ptr<when_any_state_base> state_;
+    bool won_ = false;
+
+    when_any_task get_return_object() noexcept {
+      return when_any_task(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+      struct awaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+          auto state = std::move(h.promise().state_);
+          bool won = h.promise().won_;
+          h.destroy();
+          return won ? state->notify() : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+      };
+      return awaiter{};
+    }
+    void return_value(bool won) noexcept { won_ = won; }
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+
+private:
+  std::coroutine_handle<promise_type> h_;
+
+public:
+  explicit when_any_task(std::coroutine_handle<promise_type> h) noexcept
+      : h_(h) {}
+  when_any_task(when_any_task &&other) noexcept
+      : h_(std::exchange(other.h_, {})) {}
+  when_any_task(when_any_task const &) = delete;
+  ~when_any_task() {
+    if (h_) {
+      h_.destroy();
+    }
+  }
+
+  void start(std::shared_ptr<when_any_state_base> state) noexcept {
+    auto h = std::exchange(h_, {});
+    h.promise().state_ = std::move(state);
+    h.resume();
+  }
+};
+
+/**
+ * @brief Await a single child of a `when_any`. Only the first child to
+ * complete, successfully or not, stores its outcome through `emplace`.
+ *
+ */
+template <class Result, class Awaitable, class Emplace>
+when_any_task make_when_any_task(std::shared_ptr<when_any_state<Result>> state,
+                                 Awaitable awaitable, Emplace emplace) {
+  bool won = false;
+  try {
+    if constexpr (std::is_void_v<await_result_t<Awaitable>>) {
+      co_await awaitable;
+      if ((won = state->try_win())) {
+        emplace(state->result_, std::monostate{});
+      }
+    } else {
+      auto value = co_await awaitable;
+      if ((won = state->try_win())) {
+        emplace(state->result_, std::move(value));
+      }
+    }
+  } catch (...) {
+    if ((won = state->try_win())) {
+      state->exception_ = std::current_exception();
+    }
+  }
+  co_return won;
+}
+
+template <class Result> class when_any_awaitable {
+  std::shared_ptr<when_any_state<Result>> state_;
+  std::vector<when_any_task> tasks_;
+
+public:
+  when_any_awaitable(std::shared_ptr<when_any_state<Result>> state,
+                     std::vector<when_any_task> tasks)
+      : state_(std::move(state)), tasks_(std::move(tasks)) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept {
+    for (auto &task : tasks_) {
+      if (state_->decided()) {
+        break;
+      }
+      task.start(state_);
+    }
+    tasks_.clear();
+    return state_->try_suspend(h);
+  }
+
+  Result await_resume() {
+    if (state_->exception_) {
+      std::rethrow_exception(state_->exception_);
+    }
+    return std::move(*state_->result_);
+  }
+};
+
+template <class Result, class... Awaitables, size_t... Is>
+when_any_awaitable<Result> make_when_any_awaitable(std::index_sequence<Is...>,
+                                                   Awaitables &&...awaitables) {
+  auto state = std::make_shared<when_any_state<Result>>();
+  std::vector<when_any_task> tasks;
+  tasks.reserve(sizeof...(Awaitables));
+  (tasks.emplace_back(make_when_any_task<Result,
+                                         std::remove_cvref_t<Awaitables>>(
+       state, std::forward<Awaitables>(awaitables),
+       [](std::optional<Result> &result, auto &&value) {
+         result.emplace(std::in_place_index<Is>,
+                        std::forward<decltype(value)>(value));
+       })),
+   ...);
+  return when_any_awaitable<Result>(std::move(state), std::move(tasks));
+}
+
+} // namespace detail
+
+/**
+ * @brief Await the first of several awaitables to complete. All of them are
+ * started before the awaiting coroutine suspends, except that once one has
+ * completed the remaining ones are not started at all. Operations already
+ * posted cannot be withdrawn from the Queue Pair; they keep running in the
+ * background and their results are discarded.
+ *
+ * @param awaitables The awaitables. They are moved into the children, which
+ * outlive the `co_await`, so any buffer they refer to must stay valid until
+ * they complete.
+ * @return An awaitable that yields a variant whose index is the position of
+ * the first completed awaitable, with `void` results as `std::monostate`. If
+ * that one failed, its exception is rethrown.
+ */
+template <class... Awaitables> auto when_any(Awaitables &&...awaitables) {
+  static_assert(sizeof...(Awaitables) > 0,
+                "when_any needs at least one awaitable");
+  static_assert(
+      (std::is_move_constructible_v<std::remove_cvref_t<Awaitables>> && ...),
+      "when_any moves its awaitables into children that may outlive it");
+  using result_type = std::variant<
+      detail::non_void_result_t<std::remove_cvref_t<Awaitables>>...>;
+  return detail::make_when_any_awaitable<result_type>(
+      std::index_sequence_for<Awaitables...>{},
+      std::forward<Awaitables>(awaitables)...);
+}
+
+/**
+ * @brief Await the first of a vector of awaitables to complete.
+ *
+ * @param awaitables The awaitables. It must not be empty.
+ * @return An awaitable that yields the index of the first completed awaitable
+ * and its result. If that one failed, its exception is rethrown.
+ */
+template <class Awaitable>
+detail::when_any_awaitable<
+    std::pair<size_t, detail::non_void_result_t<Awaitable>>>
+when_any(std::vector<Awaitable> awaitables) {
+  using result_type = std::pair<size_t, detail::non_void_result_t<Awaitable>>;
+  if (awaitables.empty()) {
+    throw std::invalid_argument("when_any needs at least one awaitable");
+  }
+  auto state = std::make_shared<detail::when_any_state<result_type>>();
+  std::vector<detail::when_any_task> tasks;
+  tasks.reserve(awaitables.size());
+  for (size_t i = 0; i < awaitables.size(); ++i) {
+    tasks.emplace_back(detail::make_when_any_task<result_type, Awaitable>(
+        state, std::move(awaitables[i]),
+        [i](std::optional<result_type> &result, auto &&value) {
+          result.emplace(i, std::forward<decltype(value)>(value));
+        }));
+  }
+  return detail::when_any_awaitable<result_type>(std::move(state),
+                                                 std::move(tasks));
+}
+
+} // namespace rdmapp
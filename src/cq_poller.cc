@@ -1,13 +1,20 @@
 #include "rdmapp/cq_poller.h"
 
+#include <coroutine>
+#include <exception>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include <infiniband/verbs.h>
 
 #include "rdmapp/executor.h"
 
 #include "rdmapp/detail/debug.h"
+#include "rdmapp/detail/trace.h"
 
 namespace rdmapp {
 
@@ -16,33 +23,123 @@ cq_poller::cq_poller(std::shared_ptr<cq> cq, size_t batch_size)
 
 cq_poller::cq_poller(std::shared_ptr<cq> cq, std::shared_ptr<executor> executor,
                      size_t batch_size)
-    : cq_(cq), stopped_(false), poller_thread_(&cq_poller::worker, this),
-      executor_(executor), wc_vec_(batch_size) {}
+    : cq_(cq), stopped_(false), executor_(executor), wc_vec_(batch_size),
+      has_posted_(false), posted_closed_(false),
+      poller_thread_(&cq_poller::worker, this) {}
 
 cq_poller::~cq_poller() {
   stopped_ = true;
   poller_thread_.join();
 }
 
+void cq_poller::count(struct ibv_wc const &wc) {
+  // The opcode of a failed completion is undefined, so only its status is
+  // counted.
+  if (wc.status != IBV_WC_SUCCESS) [[unlikely]] {
+    if (static_cast<size_t>(wc.status) < errors_.size()) {
+      errors_[wc.status].add();
+    }
+    return;
+  }
+  auto index = cq_stats::opcode_index(wc.opcode);
+  completions_[index].add();
+  completion_bytes_[index].add(wc.byte_len);
+}
+
+cq_stats cq_poller::stats() const {
+  cq_stats stats;
+  stats.batch_size = wc_vec_.size();
+  stats.polls = polls_.load();
+  stats.empty_polls = empty_polls_.load();
+  for (size_t i = 0; i < cq_stats::kNrOpcodes; ++i) {
+    stats.by_opcode[i].count = completions_[i].load();
+    stats.by_opcode[i].bytes = completion_bytes_[i].load();
+    stats.completions += stats.by_opcode[i].count;
+  }
+  for (size_t i = 0; i < cq_stats::kNrStatuses; ++i) {
+    stats.errors[i] = errors_[i].load();
+    stats.completions += stats.errors[i];
+  }
+  return stats;
+}
+
+void cq_poller::post(std::function<void()> fn) {
+  std::lock_guard lock(posted_mutex_);
+  if (posted_closed_) {
+    throw executor::queue_closed_error();
+  }
+  posted_.push_back(std::move(fn));
+  has_posted_.store(true, std::memory_order_release);
+}
+
+void cq_poller::run_posted(bool close) {
+  std::vector<std::function<void()>> posted;
+  {
+    std::lock_guard lock(posted_mutex_);
+    posted.swap(posted_);
+    has_posted_.store(false, std::memory_order_relaxed);
+    posted_closed_ = close;
+  }
+  for (auto &fn : posted) {
+    try {
+      fn();
+    } catch (std::exception &e) {
+      RDMAPP_LOG_ERROR("posted function failed: %s", e.what());
+    }
+  }
+}
+
+cq_poller::schedule_awaitable::schedule_awaitable(cq_poller &poller)
+    : poller_(poller) {}
+
+bool cq_poller::schedule_awaitable::await_ready() const noexcept {
+  return false;
+}
+
+void cq_poller::schedule_awaitable::await_suspend(std::coroutine_handle<> h) {
+  poller_.post([h]() { h.resume(); });
+}
+
+void cq_poller::schedule_awaitable::await_resume() const noexcept {}
+
+cq_poller::schedule_awaitable cq_poller::schedule() {
+  return schedule_awaitable(*this);
+}
+
+cq_poller::schedule_awaitable schedule_on(cq_poller &poller) {
+  return poller.schedule();
+}
+
 void cq_poller::worker() {
   while (!stopped_) {
     try {
       auto nr_wc = cq_->poll(wc_vec_);
+      polls_.add();
+      if (nr_wc == 0) {
+        empty_polls_.add();
+      }
       for (size_t i = 0; i < nr_wc; ++i) {
         auto &wc = wc_vec_[i];
         RDMAPP_LOG_TRACE("polled cqe wr_id=%p status=%d",
                          reinterpret_cast<void *>(wc.wr_id), wc.status);
+        RDMAPP_TRACE_WC(poll, wc);
+        count(wc);
         executor_->process_wc(wc);
       }
+      if (has_posted_.load(std::memory_order_acquire)) [[unlikely]] {
+        run_posted(false);
+      }
     } catch (std::runtime_error &e) {
       RDMAPP_LOG_ERROR("%s", e.what());
       stopped_ = true;
-      return;
+      break;
     } catch (executor::queue_closed_error &) {
       stopped_ = true;
-      return;
+      break;
     }
   }
+  // Coroutines already moved here are resumed once more rather than lost.
+  run_posted(true);
 }
 
 } // namespace rdmapp
\ No newline at end of file
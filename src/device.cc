@@ -5,6 +5,7 @@
 #include <cstdio>
 #include <cstring>
 #include <stdexcept>
+#include <string>
 
 #include <infiniband/verbs.h>
 
@@ -17,11 +18,11 @@ namespace rdmapp {
 device_list::device_list() : devices_(nullptr), nr_devices_(0) {
   int32_t nr_devices = -1;
   devices_ = ::ibv_get_device_list(&nr_devices);
+  check_ptr(devices_, "failed to get Infiniband devices");
   if (nr_devices == 0) {
     ::ibv_free_device_list(devices_);
     throw std::runtime_error("no Infiniband devices found");
   }
-  check_ptr(devices_, "failed to get Infiniband devices");
   nr_devices_ = nr_devices;
 }
 
@@ -130,6 +131,8 @@ device::device(uint16_t device_num, uint16_t port_num)
   open_device(devices.at(device_num), port_num);
 }
 
+std::string device::name() const { return ::ibv_get_device_name(device_); }
+
 uint16_t device::port_num() const { return port_num_; }
 
 uint16_t device::lid() const { return port_attr_.lid; }
@@ -1,10 +1,27 @@
 #include "rdmapp/executor.h"
 
+#include <coroutine>
+#include <functional>
+#include <utility>
+
+#include <infiniband/verbs.h>
+
 #include "rdmapp/detail/blocking_queue.h"
 #include "rdmapp/detail/debug.h"
+#include "rdmapp/detail/trace.h"
 
 namespace rdmapp {
 
+namespace {
+
+thread_local executor *current_executor = nullptr;
+
+// Callbacks and status slots are at least 4-byte aligned, so the low bit of a
+// wr_id tells status slots apart.
+constexpr uint64_t kStatusWrIdTag = 1;
+
+} // namespace
+
 executor::executor(size_t nr_worker) {
   for (size_t i = 0; i < nr_worker; ++i) {
     workers_.emplace_back(&executor::worker_fn, this, i);
@@ -12,9 +29,17 @@ executor::executor(size_t nr_worker) {
 }
 
 void executor::worker_fn(size_t worker_id) {
+  current_executor = this;
   try {
     while (true) {
       auto wc = work_queue_.pop();
+      RDMAPP_TRACE_WC(dequeue, wc);
+      if (wc.wr_id == 0) [[unlikely]] {
+        // Unsignaled work requests only complete when they fail.
+        RDMAPP_LOG_ERROR("unsignaled work request failed: status=%d",
+                         wc.status);
+        continue;
+      }
       auto cb = reinterpret_cast<callback_ptr>(wc.wr_id);
       (*cb)(wc);
       destroy_callback(cb);
@@ -24,10 +49,80 @@ void executor::worker_fn(size_t worker_id) {
   }
 }
 
-void executor::process_wc(struct ibv_wc const &wc) { work_queue_.push(wc); }
+void executor::process_wc(struct ibv_wc const &wc) {
+  if (wc.wr_id & kStatusWrIdTag) [[unlikely]] {
+    auto slot =
+        reinterpret_cast<enum ibv_wc_status *>(wc.wr_id & ~kStatusWrIdTag);
+    if (*slot == IBV_WC_SUCCESS ||
+        (*slot == IBV_WC_WR_FLUSH_ERR && wc.status != IBV_WC_WR_FLUSH_ERR)) {
+      *slot = wc.status;
+    }
+    return;
+  }
+  RDMAPP_TRACE_WC(enqueue, wc);
+  work_queue_.push(wc);
+}
+
+void executor::post(std::function<void()> fn) {
+  // Posted work rides the completion queue as a successful completion whose
+  // callback ignores the entry.
+  auto cb = make_callback(
+      [fn = std::move(fn)](struct ibv_wc const &) mutable { fn(); });
+  struct ibv_wc wc = {};
+  wc.wr_id = reinterpret_cast<uint64_t>(cb);
+  wc.status = IBV_WC_SUCCESS;
+  try {
+    RDMAPP_TRACE_WC(enqueue, wc);
+    work_queue_.push(wc);
+  } catch (...) {
+    destroy_callback(cb);
+    throw;
+  }
+}
+
+executor::schedule_awaitable::schedule_awaitable(executor &executor)
+    : executor_(executor) {}
+
+bool executor::schedule_awaitable::await_ready() const noexcept {
+  return false;
+}
+
+void executor::schedule_awaitable::await_suspend(std::coroutine_handle<> h) {
+  executor_.post([h]() { h.resume(); });
+}
+
+void executor::schedule_awaitable::await_resume() const noexcept {}
+
+executor::schedule_awaitable executor::schedule() {
+  return schedule_awaitable(*this);
+}
+
+executor *executor::current() { return current_executor; }
+
+executor::schedule_awaitable schedule_on(executor &executor) {
+  return executor.schedule();
+}
+
+yield_awaitable::yield_awaitable() : executor_(executor::current()) {}
+
+bool yield_awaitable::await_ready() const noexcept {
+  return executor_ == nullptr;
+}
+
+void yield_awaitable::await_suspend(std::coroutine_handle<> h) {
+  executor_->post([h]() { h.resume(); });
+}
+
+void yield_awaitable::await_resume() const noexcept {}
+
+yield_awaitable yield() { return yield_awaitable(); }
 
 void executor::shutdown() { work_queue_.close(); }
 
+uint64_t executor::make_status_wr_id(enum ibv_wc_status *slot) {
+  return reinterpret_cast<uint64_t>(slot) | kStatusWrIdTag;
+}
+
 void executor::destroy_callback(callback_ptr cb) { delete cb; }
 
 executor::~executor() {
@@ -0,0 +1,169 @@
+#include "rdmapp/frame_allocator.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "rdmapp/detail/counter.h"
+
+namespace rdmapp {
+
+namespace {
+
+constexpr size_t kMaxCachedFramesPerClass = 256;
+
+struct free_frame {
+  free_frame *next;
+};
+
+// Written only by the owning thread.
+struct thread_counters {
+  detail::counter allocations;
+  detail::counter deallocations;
+  detail::counter pool_hits;
+  detail::counter oversized;
+  std::atomic<size_t> max_frame_size = 0;
+  std::array<detail::counter, frame_stats::kSizeClasses>
+      size_class_allocations;
+
+  void add_to(frame_stats &stats) const {
+    stats.allocations += allocations.load();
+    stats.deallocations += deallocations.load();
+    stats.pool_hits += pool_hits.load();
+    stats.oversized += oversized.load();
+    stats.max_frame_size = std::max(
+        stats.max_frame_size, max_frame_size.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < frame_stats::kSizeClasses; ++i) {
+      stats.size_class_allocations[i] += size_class_allocations[i].load();
+    }
+  }
+};
+
+class thread_cache;
+
+/**
+ * @brief Frames may still be freed by destructors that run after the cache of
+ * the thread is gone. This flag is trivially destructible, so it stays usable.
+ *
+ */
+thread_local bool cache_destroyed = false;
+
+struct registry {
+  std::mutex mutex;
+  std::vector<thread_cache *> caches;
+  frame_stats exited;
+};
+
+registry &get_registry() {
+  static registry instance;
+  return instance;
+}
+
+class thread_cache {
+  std::array<free_frame *, frame_stats::kSizeClasses> free_lists_{};
+  std::array<size_t, frame_stats::kSizeClasses> cached_{};
+
+public:
+  thread_counters counters;
+
+  thread_cache() {
+    auto &r = get_registry();
+    std::lock_guard lock(r.mutex);
+    r.caches.push_back(this);
+  }
+
+  ~thread_cache() {
+    cache_destroyed = true;
+    for (auto head : free_lists_) {
+      while (head != nullptr) {
+        auto next = head->next;
+        ::operator delete(head);
+        head = next;
+      }
+    }
+    auto &r = get_registry();
+    std::lock_guard lock(r.mutex);
+    counters.add_to(r.exited);
+    r.caches.erase(std::find(r.caches.begin(), r.caches.end(), this));
+  }
+
+  void *pop(size_t size_class) noexcept {
+    auto head = free_lists_[size_class];
+    if (head != nullptr) {
+      free_lists_[size_class] = head->next;
+      --cached_[size_class];
+    }
+    return head;
+  }
+
+  bool push(void *frame, size_t size_class) noexcept {
+    if (cached_[size_class] >= kMaxCachedFramesPerClass) {
+      return false;
+    }
+    auto node = static_cast<free_frame *>(frame);
+    node->next = free_lists_[size_class];
+    free_lists_[size_class] = node;
+    ++cached_[size_class];
+    return true;
+  }
+};
+
+thread_local thread_cache cache;
+
+} // namespace
+
+frame_stats get_frame_stats() {
+  auto &r = get_registry();
+  std::lock_guard lock(r.mutex);
+  frame_stats stats = r.exited;
+  for (auto c : r.caches) {
+    c->counters.add_to(stats);
+  }
+  return stats;
+}
+
+namespace detail {
+
+void *allocate_frame(size_t size) {
+  if (cache_destroyed) [[unlikely]] {
+    return ::operator new(size);
+  }
+  auto &counters = cache.counters;
+  counters.allocations.add();
+  if (size > counters.max_frame_size.load(std::memory_order_relaxed)) {
+    counters.max_frame_size.store(size, std::memory_order_relaxed);
+  }
+  size_t const size_class = (size - 1) / frame_stats::kSizeClassBytes;
+  if (size == 0 || size_class >= frame_stats::kSizeClasses) [[unlikely]] {
+    counters.oversized.add();
+    return ::operator new(size);
+  }
+  counters.size_class_allocations[size_class].add();
+  if (auto frame = cache.pop(size_class)) {
+    counters.pool_hits.add();
+    return frame;
+  }
+  return ::operator new((size_class + 1) * frame_stats::kSizeClassBytes);
+}
+
+void deallocate_frame(void *frame, size_t size) noexcept {
+  if (cache_destroyed) [[unlikely]] {
+    ::operator delete(frame);
+    return;
+  }
+  cache.counters.deallocations.add();
+  size_t const size_class = (size - 1) / frame_stats::kSizeClassBytes;
+  if (size == 0 || size_class >= frame_stats::kSizeClasses ||
+      !cache.push(frame, size_class)) {
+    ::operator delete(frame);
+  }
+}
+
+} // namespace detail
+
+} // namespace rdmapp
@@ -0,0 +1,231 @@
+#include "rdmapp/message_stream.h"
+
+#include <cassert>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/error.h"
+#include "rdmapp/executor.h"
+
+#include "rdmapp/detail/debug.h"
+#include "rdmapp/detail/trace.h"
+
+namespace rdmapp {
+
+message_stream::state::state(std::shared_ptr<qp> qp, size_t nr_buffers,
+                             size_t buffer_size)
+    : qp_(qp), buffer_size_(buffer_size), buffers_(nr_buffers * buffer_size),
+      local_mr_(qp->pd_ptr()->reg_mr(buffers_.data(), buffers_.size())),
+      next_post_seq_(0), next_deliver_seq_(0), ended_(false) {}
+
+void message_stream::state::post_locked(qp &qp, size_t buffer) {
+  auto seq = next_post_seq_++;
+  auto callback = executor::make_callback(
+      [self = shared_from_this(), seq, buffer](struct ibv_wc const &wc) {
+        self->on_complete(seq, buffer, wc);
+      });
+
+  struct ibv_sge recv_sge = {};
+  recv_sge.addr = reinterpret_cast<uint64_t>(&buffers_[buffer * buffer_size_]);
+  recv_sge.length = buffer_size_;
+  recv_sge.lkey = local_mr_.lkey();
+
+  struct ibv_recv_wr recv_wr = {};
+  struct ibv_recv_wr *bad_recv_wr = nullptr;
+  recv_wr.wr_id = reinterpret_cast<uint64_t>(callback);
+  recv_wr.num_sge = 1;
+  recv_wr.sg_list = &recv_sge;
+  try {
+    qp.post_recv(recv_wr, bad_recv_wr);
+  } catch (...) {
+    executor::destroy_callback(callback);
+    --next_post_seq_;
+    throw;
+  }
+}
+
+void message_stream::state::repost(size_t buffer) noexcept {
+  auto qp = qp_.lock();
+  std::lock_guard lock(mutex_);
+  if (ended_ || qp == nullptr) {
+    return;
+  }
+  try {
+    post_locked(*qp, buffer);
+  } catch (std::runtime_error &e) {
+    RDMAPP_LOG_ERROR("failed to repost stream buffer %lu: %s", buffer,
+                     e.what());
+  }
+}
+
+void message_stream::state::on_complete(uint64_t seq, size_t buffer,
+                                        struct ibv_wc const &wc) {
+  std::unique_lock lock(mutex_);
+  if (!ended_) {
+    completed_.emplace(seq, completion{buffer, wc});
+  }
+  if (waiter_ && ready_locked()) {
+    auto h = std::exchange(waiter_, {});
+    lock.unlock();
+    RDMAPP_TRACE_WC(resume, wc);
+    h.resume();
+  }
+}
+
+void message_stream::state::end() noexcept {
+  std::unique_lock lock(mutex_);
+  ended_ = true;
+  completed_.clear();
+  if (auto h = std::exchange(waiter_, {})) {
+    lock.unlock();
+    h.resume();
+  }
+}
+
+bool message_stream::state::ready_locked() const {
+  return ended_ || (!completed_.empty() &&
+                    completed_.begin()->first == next_deliver_seq_);
+}
+
+message_stream::message::message(std::shared_ptr<state> state, size_t buffer,
+                                 std::span<uint8_t> data,
+                                 std::optional<uint32_t> imm)
+    : state_(std::move(state)), buffer_(buffer), data_(data), imm_(imm) {}
+
+message_stream::message::message(message &&other) noexcept
+    : state_(std::move(other.state_)), buffer_(other.buffer_),
+      data_(other.data_), imm_(other.imm_) {}
+
+message_stream::message &
+message_stream::message::operator=(message &&other) noexcept {
+  if (this != &other) {
+    if (state_) {
+      state_->repost(buffer_);
+    }
+    state_ = std::move(other.state_);
+    buffer_ = other.buffer_;
+    data_ = other.data_;
+    imm_ = other.imm_;
+  }
+  return *this;
+}
+
+message_stream::message::~message() {
+  if (state_) {
+    state_->repost(buffer_);
+  }
+}
+
+std::span<uint8_t> message_stream::message::data() const { return data_; }
+
+std::optional<uint32_t> message_stream::message::imm() const { return imm_; }
+
+message_stream::next_awaitable::next_awaitable(std::shared_ptr<state> state)
+    : state_(std::move(state)) {}
+
+bool message_stream::next_awaitable::await_ready() const {
+  std::lock_guard lock(state_->mutex_);
+  return state_->ready_locked();
+}
+
+bool message_stream::next_awaitable::await_suspend(std::coroutine_handle<> h) {
+  std::lock_guard lock(state_->mutex_);
+  if (state_->ready_locked()) {
+    return false;
+  }
+  assert(!state_->waiter_);
+  state_->waiter_ = h;
+  return true;
+}
+
+std::optional<message_stream::message>
+message_stream::next_awaitable::await_resume() {
+  std::unique_lock lock(state_->mutex_);
+  if (state_->ended_) {
+    return std::nullopt;
+  }
+  auto node = state_->completed_.extract(state_->completed_.begin());
+  ++state_->next_deliver_seq_;
+  auto const &wc = node.mapped().wc;
+  if (wc.status != IBV_WC_SUCCESS) [[unlikely]] {
+    state_->ended_ = true;
+    state_->completed_.clear();
+    lock.unlock();
+    if (wc.status == IBV_WC_WR_FLUSH_ERR) {
+      return std::nullopt;
+    }
+    check_wc_status(wc.status, "failed to recv stream message");
+  }
+  auto buffer = node.mapped().buffer;
+  auto data = std::span<uint8_t>(
+      &state_->buffers_[buffer * state_->buffer_size_], wc.byte_len);
+  std::optional<uint32_t> imm;
+  if (wc.wc_flags & IBV_WC_WITH_IMM) {
+    imm = wc.imm_data;
+  }
+  return message(state_, buffer, data, imm);
+}
+
+message_stream::message_stream(std::shared_ptr<qp> qp, size_t nr_buffers,
+                               size_t buffer_size) {
+  if (qp->srq_ptr() != nullptr) {
+    throw std::invalid_argument(
+        "message streams cannot receive from a shared receive queue");
+  }
+  if (nr_buffers == 0 || buffer_size == 0) {
+    throw std::invalid_argument("message stream needs at least one buffer");
+  }
+  state_ = std::make_shared<state>(qp, nr_buffers, buffer_size);
+  try {
+    std::lock_guard lock(state_->mutex_);
+    for (size_t i = 0; i < nr_buffers; ++i) {
+      state_->post_locked(*qp, i);
+    }
+  } catch (...) {
+    state_->end();
+    throw;
+  }
+}
+
+message_stream::message_stream(message_stream &&other) noexcept = default;
+
+message_stream &message_stream::operator=(message_stream &&other) noexcept {
+  if (this != &other) {
+    if (state_) {
+      state_->end();
+    }
+    state_ = std::move(other.state_);
+  }
+  return *this;
+}
+
+message_stream::~message_stream() {
+  if (state_) {
+    state_->end();
+  }
+}
+
+void message_stream::close() {
+  if (state_ == nullptr) {
+    return;
+  }
+  state_->end();
+  if (auto qp = state_->qp_.lock()) {
+    qp->flush();
+  }
+}
+
+message_stream::next_awaitable message_stream::next() {
+  return next_awaitable(state_);
+}
+
+} // namespace rdmapp
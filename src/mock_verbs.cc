@@ -0,0 +1,770 @@
+/*
+ * An in-process replacement for libibverbs, linked instead of it when the
+ * library is configured with RDMAPP_MOCK_VERBS. It exposes one device whose
+ * Queue Pairs can only reach other Queue Pairs of the same process. Work
+ * requests are executed by a fabric thread with plain memory copies, and
+ * their completions are delivered to the emulated Completion Queues, so the
+ * pollers, executors, flow control and handshakes of the library run
+ * unchanged without RDMA hardware.
+ *
+ * The emulation follows the verbs semantics the library relies on: reliable
+ * connected sends wait for a posted receive as if retrying RNR forever,
+ * remote accesses are checked against the registered regions, atomics are
+ * serialized, and moving a Queue Pair to the error state flushes its
+ * outstanding work requests.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <endian.h>
+#include <errno.h>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/detail/debug.h"
+
+#undef ibv_query_port
+#undef ibv_reg_mr
+
+namespace rdmapp {
+namespace mock {
+
+constexpr size_t kGrhBytes = 40;
+constexpr uint32_t kMaxInlineData = 256;
+
+struct cq {
+  struct ibv_cq base;
+  std::mutex mutex;
+  std::deque<struct ibv_wc> wcs;
+
+  void push(struct ibv_wc const &wc) {
+    std::lock_guard lock(mutex);
+    wcs.push_back(wc);
+  }
+};
+
+struct recv_entry {
+  uint64_t wr_id;
+  std::vector<struct ibv_sge> sges;
+};
+
+struct send_entry {
+  struct ibv_send_wr wr;
+  std::vector<struct ibv_sge> sges;
+  std::vector<uint8_t> inline_data;
+};
+
+struct srq {
+  struct ibv_srq base;
+  uint32_t max_wr;
+  std::deque<recv_entry> recvs;
+};
+
+struct qp {
+  struct ibv_qp base;
+  cq *send_cq;
+  cq *recv_cq;
+  srq *shared_rq;
+  bool sq_sig_all;
+  uint32_t dest_qp_num;
+  uint32_t max_send_wr;
+  uint32_t max_recv_wr;
+  std::deque<recv_entry> recvs;
+  std::deque<send_entry> sends;
+};
+
+struct region {
+  uintptr_t addr;
+  size_t length;
+  int access;
+};
+
+static std::vector<struct ibv_sge> copy_sges(struct ibv_sge const *sg_list,
+                                             int num_sge) {
+  return std::vector<struct ibv_sge>(sg_list, sg_list + num_sge);
+}
+
+static size_t total_length(std::vector<struct ibv_sge> const &sges) {
+  size_t length = 0;
+  for (auto const &sge : sges) {
+    length += sge.length;
+  }
+  return length;
+}
+
+static std::vector<uint8_t> gather(std::vector<struct ibv_sge> const &sges) {
+  std::vector<uint8_t> data;
+  data.reserve(total_length(sges));
+  for (auto const &sge : sges) {
+    auto begin = reinterpret_cast<uint8_t const *>(sge.addr);
+    data.insert(data.end(), begin, begin + sge.length);
+  }
+  return data;
+}
+
+static void scatter(std::vector<struct ibv_sge> const &sges,
+                    uint8_t const *data, size_t length) {
+  for (auto const &sge : sges) {
+    if (length == 0) {
+      break;
+    }
+    auto n = std::min<size_t>(sge.length, length);
+    ::memcpy(reinterpret_cast<void *>(sge.addr), data, n);
+    data += n;
+    length -= n;
+  }
+}
+
+static enum ibv_wc_opcode send_wc_opcode(enum ibv_wr_opcode opcode) {
+  switch (opcode) {
+  case IBV_WR_RDMA_WRITE:
+  case IBV_WR_RDMA_WRITE_WITH_IMM:
+    return IBV_WC_RDMA_WRITE;
+  case IBV_WR_RDMA_READ:
+    return IBV_WC_RDMA_READ;
+  case IBV_WR_ATOMIC_FETCH_AND_ADD:
+    return IBV_WC_FETCH_ADD;
+  case IBV_WR_ATOMIC_CMP_AND_SWP:
+    return IBV_WC_COMP_SWAP;
+  default:
+    return IBV_WC_SEND;
+  }
+}
+
+/*
+ * The emulated network. One mutex guards every Queue Pair, receive queue and
+ * memory region; Completion Queues have their own so that polling does not
+ * contend with the fabric thread.
+ */
+class fabric {
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::map<uint32_t, qp *> qps_;
+  std::map<uint32_t, region> regions_;
+  uint32_t next_qp_num_ = 1;
+  uint32_t next_key_ = 1;
+  bool stopped_ = false;
+  std::thread thread_;
+
+  void complete_send(qp *local, send_entry const &entry,
+                     enum ibv_wc_status status, uint32_t byte_len) {
+    bool signaled =
+        local->sq_sig_all || entry.wr.send_flags & IBV_SEND_SIGNALED;
+    if (!signaled && status == IBV_WC_SUCCESS) {
+      return;
+    }
+    struct ibv_wc wc = {};
+    wc.wr_id = entry.wr.wr_id;
+    wc.status = status;
+    wc.opcode = send_wc_opcode(entry.wr.opcode);
+    wc.byte_len = byte_len;
+    wc.qp_num = local->base.qp_num;
+    local->send_cq->push(wc);
+  }
+
+  void complete_recv(qp *remote, recv_entry const &entry,
+                     enum ibv_wc_status status, enum ibv_wc_opcode opcode,
+                     uint32_t byte_len, qp const *source,
+                     struct ibv_send_wr const *wr) {
+    struct ibv_wc wc = {};
+    wc.wr_id = entry.wr_id;
+    wc.status = status;
+    wc.opcode = opcode;
+    wc.byte_len = byte_len;
+    wc.qp_num = remote->base.qp_num;
+    if (source != nullptr) {
+      wc.src_qp = source->base.qp_num;
+      wc.slid = 1;
+    }
+    if (wr != nullptr && (wr->opcode == IBV_WR_SEND_WITH_IMM ||
+                          wr->opcode == IBV_WR_RDMA_WRITE_WITH_IMM)) {
+      wc.wc_flags |= IBV_WC_WITH_IMM;
+      wc.imm_data = wr->imm_data;
+    }
+    if (remote->base.qp_type == IBV_QPT_UD) {
+      wc.wc_flags |= IBV_WC_GRH;
+    }
+    remote->recv_cq->push(wc);
+  }
+
+  void flush_locked(qp *target) {
+    target->base.state = IBV_QPS_ERR;
+    for (auto const &entry : target->recvs) {
+      complete_recv(target, entry, IBV_WC_WR_FLUSH_ERR, IBV_WC_RECV, 0,
+                    nullptr, nullptr);
+    }
+    target->recvs.clear();
+    cv_.notify_one();
+  }
+
+  std::deque<recv_entry> *recv_queue(qp *target) {
+    return target->shared_rq != nullptr ? &target->shared_rq->recvs
+                                        : &target->recvs;
+  }
+
+  region *find_region(uint32_t rkey, uint64_t addr, size_t length,
+                      int access) {
+    auto it = regions_.find(rkey);
+    if (it == regions_.end()) {
+      return nullptr;
+    }
+    auto &r = it->second;
+    if (addr < r.addr || addr + length > r.addr + r.length ||
+        (r.access & access) != access) {
+      return nullptr;
+    }
+    return &r;
+  }
+
+  void fail(qp *local, qp *remote, send_entry const &entry,
+            enum ibv_wc_status status) {
+    complete_send(local, entry, status, 0);
+    flush_locked(local);
+    if (remote != nullptr && remote->base.qp_type != IBV_QPT_UD) {
+      flush_locked(remote);
+    }
+  }
+
+  /*
+   * Execute the oldest send work request of a Queue Pair. Returns false if it
+   * has to wait for the peer to post a receive.
+   */
+  bool execute(qp *local, send_entry &entry) {
+    auto const &wr = entry.wr;
+    if (local->base.state == IBV_QPS_ERR) {
+      complete_send(local, entry, IBV_WC_WR_FLUSH_ERR, 0);
+      return true;
+    }
+    bool const ud = local->base.qp_type == IBV_QPT_UD;
+    auto peer_it = qps_.find(ud ? wr.wr.ud.remote_qpn : local->dest_qp_num);
+    qp *remote = peer_it == qps_.end() ? nullptr : peer_it->second;
+    if (remote == nullptr || remote->base.state < IBV_QPS_RTR ||
+        remote->base.state == IBV_QPS_ERR) {
+      if (ud) {
+        complete_send(local, entry, IBV_WC_SUCCESS, 0);
+        return true;
+      }
+      fail(local, nullptr, entry, IBV_WC_RETRY_EXC_ERR);
+      return true;
+    }
+
+    auto const length = entry.inline_data.empty()
+                            ? total_length(entry.sges)
+                            : entry.inline_data.size();
+    bool const consumes_recv = wr.opcode == IBV_WR_SEND ||
+                               wr.opcode == IBV_WR_SEND_WITH_IMM ||
+                               wr.opcode == IBV_WR_RDMA_WRITE_WITH_IMM;
+    auto *recvs = recv_queue(remote);
+    if (consumes_recv && recvs->empty()) {
+      if (ud) {
+        complete_send(local, entry, IBV_WC_SUCCESS, length);
+        return true;
+      }
+      return false;
+    }
+
+    switch (wr.opcode) {
+    case IBV_WR_SEND:
+    case IBV_WR_SEND_WITH_IMM: {
+      auto data = entry.inline_data.empty() ? gather(entry.sges)
+                                            : entry.inline_data;
+      if (ud) {
+        // Every Queue Pair shares the device's only GID.
+        struct ibv_grh grh = {};
+        grh.version_tclass_flow = htobe32(uint32_t(6) << 28);
+        grh.paylen = htobe16(static_cast<uint16_t>(data.size()));
+        grh.hop_limit = 16;
+        grh.sgid.raw[15] = 1;
+        grh.dgid.raw[15] = 1;
+        auto const bytes = reinterpret_cast<uint8_t const *>(&grh);
+        data.insert(data.begin(), bytes, bytes + kGrhBytes);
+      }
+      auto recv = std::move(recvs->front());
+      recvs->pop_front();
+      if (data.size() > total_length(recv.sges)) {
+        complete_recv(remote, recv, IBV_WC_LOC_LEN_ERR, IBV_WC_RECV, 0, local,
+                      &wr);
+        fail(local, remote, entry, IBV_WC_REM_INV_REQ_ERR);
+        return true;
+      }
+      scatter(recv.sges, data.data(), data.size());
+      complete_recv(remote, recv, IBV_WC_SUCCESS, IBV_WC_RECV, data.size(),
+                    local, &wr);
+      break;
+    }
+    case IBV_WR_RDMA_WRITE:
+    case IBV_WR_RDMA_WRITE_WITH_IMM: {
+      if (!find_region(wr.wr.rdma.rkey, wr.wr.rdma.remote_addr, length,
+                       IBV_ACCESS_REMOTE_WRITE)) {
+        fail(local, remote, entry, IBV_WC_REM_ACCESS_ERR);
+        return true;
+      }
+      auto data = entry.inline_data.empty() ? gather(entry.sges)
+                                            : entry.inline_data;
+      ::memcpy(reinterpret_cast<void *>(wr.wr.rdma.remote_addr), data.data(),
+               data.size());
+      if (wr.opcode == IBV_WR_RDMA_WRITE_WITH_IMM) {
+        auto recv = std::move(recvs->front());
+        recvs->pop_front();
+        complete_recv(remote, recv, IBV_WC_SUCCESS,
+                      IBV_WC_RECV_RDMA_WITH_IMM, length, local, &wr);
+      }
+      break;
+    }
+    case IBV_WR_RDMA_READ: {
+      if (!find_region(wr.wr.rdma.rkey, wr.wr.rdma.remote_addr, length,
+                       IBV_ACCESS_REMOTE_READ)) {
+        fail(local, remote, entry, IBV_WC_REM_ACCESS_ERR);
+        return true;
+      }
+      scatter(entry.sges,
+              reinterpret_cast<uint8_t const *>(wr.wr.rdma.remote_addr),
+              length);
+      break;
+    }
+    case IBV_WR_ATOMIC_FETCH_AND_ADD:
+    case IBV_WR_ATOMIC_CMP_AND_SWP: {
+      if (length != sizeof(uint64_t) || wr.wr.atomic.remote_addr % 8 != 0 ||
+          !find_region(wr.wr.atomic.rkey, wr.wr.atomic.remote_addr,
+                       sizeof(uint64_t), IBV_ACCESS_REMOTE_ATOMIC)) {
+        fail(local, remote, entry, IBV_WC_REM_ACCESS_ERR);
+        return true;
+      }
+      auto target = reinterpret_cast<uint64_t *>(wr.wr.atomic.remote_addr);
+      auto const original = *target;
+      if (wr.opcode == IBV_WR_ATOMIC_FETCH_AND_ADD) {
+        *target = original + wr.wr.atomic.compare_add;
+      } else if (original == wr.wr.atomic.compare_add) {
+        *target = wr.wr.atomic.swap;
+      }
+      scatter(entry.sges, reinterpret_cast<uint8_t const *>(&original),
+              sizeof(original));
+      break;
+    }
+    default:
+      fail(local, remote, entry, IBV_WC_LOC_QP_OP_ERR);
+      return true;
+    }
+    complete_send(local, entry, IBV_WC_SUCCESS, length);
+    return true;
+  }
+
+  void worker() {
+    std::unique_lock lock(mutex_);
+    while (!stopped_) {
+      bool progressed = false;
+      for (auto &[qp_num, local] : qps_) {
+        while (!local->sends.empty() && execute(local, local->sends.front())) {
+          local->sends.pop_front();
+          progressed = true;
+        }
+      }
+      if (!progressed) {
+        cv_.wait(lock);
+      }
+    }
+  }
+
+public:
+  fabric() : thread_(&fabric::worker, this) {}
+
+  static fabric &instance() {
+    static fabric fabric;
+    return fabric;
+  }
+
+  uint32_t add_qp(qp *target) {
+    std::lock_guard lock(mutex_);
+    auto qp_num = next_qp_num_++;
+    target->base.qp_num = qp_num;
+    qps_.emplace(qp_num, target);
+    return qp_num;
+  }
+
+  void remove_qp(qp *target) {
+    std::lock_guard lock(mutex_);
+    qps_.erase(target->base.qp_num);
+  }
+
+  uint32_t add_region(region r) {
+    std::lock_guard lock(mutex_);
+    auto key = next_key_++;
+    regions_.emplace(key, r);
+    return key;
+  }
+
+  void remove_region(uint32_t key) {
+    std::lock_guard lock(mutex_);
+    regions_.erase(key);
+  }
+
+  int modify(qp *target, struct ibv_qp_attr const &attr, int attr_mask) {
+    std::lock_guard lock(mutex_);
+    if (attr_mask & IBV_QP_DEST_QPN) {
+      target->dest_qp_num = attr.dest_qp_num;
+    }
+    if (attr_mask & IBV_QP_STATE) {
+      if (attr.qp_state == IBV_QPS_ERR) {
+        flush_locked(target);
+      } else {
+        target->base.state = attr.qp_state;
+        cv_.notify_one();
+      }
+    }
+    return 0;
+  }
+
+  int post_send(qp *local, struct ibv_send_wr *wr,
+                struct ibv_send_wr **bad_wr) {
+    std::lock_guard lock(mutex_);
+    for (; wr != nullptr; wr = wr->next) {
+      if (local->base.state != IBV_QPS_RTS &&
+          local->base.state != IBV_QPS_ERR) {
+        *bad_wr = wr;
+        return EINVAL;
+      }
+      // Like a real send queue, there is no room beyond the depth it was
+      // created with until the oldest requests have executed.
+      if (local->sends.size() >= local->max_send_wr) {
+        *bad_wr = wr;
+        return ENOMEM;
+      }
+      send_entry entry;
+      entry.wr = *wr;
+      entry.wr.next = nullptr;
+      entry.sges = copy_sges(wr->sg_list, wr->num_sge);
+      if (wr->send_flags & IBV_SEND_INLINE) {
+        entry.inline_data = gather(entry.sges);
+        if (entry.inline_data.size() > kMaxInlineData) {
+          *bad_wr = wr;
+          return EINVAL;
+        }
+      }
+      local->sends.push_back(std::move(entry));
+    }
+    cv_.notify_one();
+    return 0;
+  }
+
+  int post_recv(qp *local, srq *shared_rq, struct ibv_recv_wr *wr,
+                struct ibv_recv_wr **bad_wr) {
+    std::lock_guard lock(mutex_);
+    for (; wr != nullptr; wr = wr->next) {
+      recv_entry entry{wr->wr_id, copy_sges(wr->sg_list, wr->num_sge)};
+      if (shared_rq != nullptr) {
+        if (shared_rq->recvs.size() >= shared_rq->max_wr) {
+          *bad_wr = wr;
+          return ENOMEM;
+        }
+        shared_rq->recvs.push_back(std::move(entry));
+      } else if (local->base.state == IBV_QPS_RESET) {
+        *bad_wr = wr;
+        return EINVAL;
+      } else if (local->base.state == IBV_QPS_ERR) {
+        complete_recv(local, entry, IBV_WC_WR_FLUSH_ERR, IBV_WC_RECV, 0,
+                      nullptr, nullptr);
+      } else if (local->recvs.size() >= local->max_recv_wr) {
+        *bad_wr = wr;
+        return ENOMEM;
+      } else {
+        local->recvs.push_back(std::move(entry));
+      }
+    }
+    cv_.notify_one();
+    return 0;
+  }
+
+  ~fabric() {
+    {
+      std::lock_guard lock(mutex_);
+      stopped_ = true;
+      cv_.notify_one();
+    }
+    thread_.join();
+  }
+};
+
+static int poll_cq(struct ibv_cq *base, int num_entries, struct ibv_wc *wc) {
+  auto target = reinterpret_cast<cq *>(base);
+  std::lock_guard lock(target->mutex);
+  int n = 0;
+  while (n < num_entries && !target->wcs.empty()) {
+    wc[n++] = target->wcs.front();
+    target->wcs.pop_front();
+  }
+  return n;
+}
+
+static int post_send(struct ibv_qp *base, struct ibv_send_wr *wr,
+                     struct ibv_send_wr **bad_wr) {
+  return fabric::instance().post_send(reinterpret_cast<qp *>(base), wr,
+                                      bad_wr);
+}
+
+static int post_recv(struct ibv_qp *base, struct ibv_recv_wr *wr,
+                     struct ibv_recv_wr **bad_wr) {
+  return fabric::instance().post_recv(reinterpret_cast<qp *>(base), nullptr,
+                                      wr, bad_wr);
+}
+
+static int post_srq_recv(struct ibv_srq *base, struct ibv_recv_wr *wr,
+                         struct ibv_recv_wr **bad_wr) {
+  return fabric::instance().post_recv(nullptr, reinterpret_cast<srq *>(base),
+                                      wr, bad_wr);
+}
+
+static struct ibv_device *mock_device() {
+  static struct ibv_device device = [] {
+    struct ibv_device device = {};
+    device.node_type = IBV_NODE_CA;
+    device.transport_type = IBV_TRANSPORT_IB;
+    ::strncpy(device.name, "mock0", sizeof(device.name) - 1);
+    ::strncpy(device.dev_name, "uverbs0", sizeof(device.dev_name) - 1);
+    return device;
+  }();
+  return &device;
+}
+
+} // namespace mock
+} // namespace rdmapp
+
+using namespace rdmapp;
+
+struct ibv_device **ibv_get_device_list(int *num_devices) {
+  auto devices = new struct ibv_device *[2];
+  devices[0] = mock::mock_device();
+  devices[1] = nullptr;
+  if (num_devices != nullptr) {
+    *num_devices = 1;
+  }
+  return devices;
+}
+
+void ibv_free_device_list(struct ibv_device **list) { delete[] list; }
+
+const char *ibv_get_device_name(struct ibv_device *device) {
+  return device->name;
+}
+
+struct ibv_context *ibv_open_device(struct ibv_device *device) {
+  auto context = new struct ibv_context();
+  context->device = device;
+  context->cmd_fd = -1;
+  context->async_fd = -1;
+  context->num_comp_vectors = 1;
+  context->ops.poll_cq = mock::poll_cq;
+  context->ops.post_send = mock::post_send;
+  context->ops.post_recv = mock::post_recv;
+  context->ops.post_srq_recv = mock::post_srq_recv;
+  RDMAPP_LOG_DEBUG("opened mock verbs device %s", device->name);
+  return context;
+}
+
+int ibv_close_device(struct ibv_context *context) {
+  delete context;
+  return 0;
+}
+
+const char *ibv_wc_status_str(enum ibv_wc_status status) {
+  switch (status) {
+  case IBV_WC_SUCCESS:
+    return "success";
+  case IBV_WC_LOC_LEN_ERR:
+    return "local length error";
+  case IBV_WC_LOC_QP_OP_ERR:
+    return "local QP operation error";
+  case IBV_WC_WR_FLUSH_ERR:
+    return "Work Request Flushed Error";
+  case IBV_WC_REM_ACCESS_ERR:
+    return "remote access error";
+  case IBV_WC_REM_INV_REQ_ERR:
+    return "invalid request error";
+  case IBV_WC_RETRY_EXC_ERR:
+    return "transport retry counter exceeded";
+  default:
+    return "unknown";
+  }
+}
+
+int ibv_query_device(struct ibv_context *, struct ibv_device_attr *attr) {
+  ::memset(attr, 0, sizeof(*attr));
+  ::strncpy(attr->fw_ver, "mock", sizeof(attr->fw_ver) - 1);
+  attr->max_mr_size = UINT64_MAX;
+  attr->page_size_cap = 4096;
+  attr->max_qp = 1 << 16;
+  attr->max_qp_wr = 1 << 14;
+  attr->max_sge = 32;
+  attr->max_cq = 1 << 16;
+  attr->max_cqe = 1 << 22;
+  attr->max_mr = 1 << 20;
+  attr->max_pd = 1 << 16;
+  attr->max_qp_rd_atom = 16;
+  attr->max_qp_init_rd_atom = 16;
+  attr->max_res_rd_atom = 1 << 20;
+  attr->max_srq = 1 << 16;
+  attr->max_srq_wr = 1 << 14;
+  attr->max_srq_sge = 32;
+  attr->atomic_cap = IBV_ATOMIC_HCA;
+  attr->max_pkeys = 1;
+  attr->phys_port_cnt = 1;
+  return 0;
+}
+
+int ibv_query_port(struct ibv_context *, uint8_t,
+                   struct _compat_ibv_port_attr *compat_attr) {
+  auto attr = reinterpret_cast<struct ibv_port_attr *>(compat_attr);
+  attr->state = IBV_PORT_ACTIVE;
+  attr->max_mtu = IBV_MTU_4096;
+  attr->active_mtu = IBV_MTU_4096;
+  attr->gid_tbl_len = 1;
+  attr->max_msg_sz = 1u << 31;
+  attr->pkey_tbl_len = 1;
+  attr->lid = 1;
+  attr->link_layer = IBV_LINK_LAYER_INFINIBAND;
+  return 0;
+}
+
+int ibv_query_gid(struct ibv_context *, uint8_t, int index,
+                  union ibv_gid *gid) {
+  ::memset(gid, 0, sizeof(*gid));
+  gid->raw[15] = static_cast<uint8_t>(index + 1);
+  return 0;
+}
+
+struct ibv_pd *ibv_alloc_pd(struct ibv_context *context) {
+  auto pd = new struct ibv_pd();
+  pd->context = context;
+  return pd;
+}
+
+int ibv_dealloc_pd(struct ibv_pd *pd) {
+  delete pd;
+  return 0;
+}
+
+struct ibv_mr *ibv_reg_mr(struct ibv_pd *pd, void *addr, size_t length,
+                          int access) {
+  auto mr = new struct ibv_mr();
+  mr->context = pd->context;
+  mr->pd = pd;
+  mr->addr = addr;
+  mr->length = length;
+  mr->lkey = mr->rkey = mock::fabric::instance().add_region(
+      mock::region{reinterpret_cast<uintptr_t>(addr), length, access});
+  return mr;
+}
+
+struct ibv_mr *ibv_reg_mr_iova2(struct ibv_pd *pd, void *addr, size_t length,
+                                uint64_t, unsigned int access) {
+  return ibv_reg_mr(pd, addr, length, static_cast<int>(access));
+}
+
+int ibv_dereg_mr(struct ibv_mr *mr) {
+  mock::fabric::instance().remove_region(mr->rkey);
+  delete mr;
+  return 0;
+}
+
+struct ibv_cq *ibv_create_cq(struct ibv_context *context, int cqe,
+                             void *cq_context, struct ibv_comp_channel *channel,
+                             int comp_vector) {
+  (void)comp_vector;
+  auto cq = new mock::cq();
+  cq->base.context = context;
+  cq->base.channel = channel;
+  cq->base.cq_context = cq_context;
+  cq->base.cqe = cqe;
+  return &cq->base;
+}
+
+int ibv_destroy_cq(struct ibv_cq *cq) {
+  delete reinterpret_cast<mock::cq *>(cq);
+  return 0;
+}
+
+struct ibv_srq *ibv_create_srq(struct ibv_pd *pd,
+                               struct ibv_srq_init_attr *srq_init_attr) {
+  auto srq = new mock::srq();
+  srq->base.context = pd->context;
+  srq->base.pd = pd;
+  srq->base.srq_context = srq_init_attr->srq_context;
+  srq->max_wr = srq_init_attr->attr.max_wr;
+  return &srq->base;
+}
+
+int ibv_destroy_srq(struct ibv_srq *srq) {
+  delete reinterpret_cast<mock::srq *>(srq);
+  return 0;
+}
+
+struct ibv_qp *ibv_create_qp(struct ibv_pd *pd,
+                             struct ibv_qp_init_attr *qp_init_attr) {
+  auto qp = new mock::qp();
+  qp->base.context = pd->context;
+  qp->base.pd = pd;
+  qp->base.qp_context = qp_init_attr->qp_context;
+  qp->base.send_cq = qp_init_attr->send_cq;
+  qp->base.recv_cq = qp_init_attr->recv_cq;
+  qp->base.srq = qp_init_attr->srq;
+  qp->base.qp_type = qp_init_attr->qp_type;
+  qp->base.state = IBV_QPS_RESET;
+  qp->send_cq = reinterpret_cast<mock::cq *>(qp_init_attr->send_cq);
+  qp->recv_cq = reinterpret_cast<mock::cq *>(qp_init_attr->recv_cq);
+  qp->shared_rq = reinterpret_cast<mock::srq *>(qp_init_attr->srq);
+  qp->sq_sig_all = qp_init_attr->sq_sig_all != 0;
+  qp->dest_qp_num = 0;
+  qp->max_send_wr = qp_init_attr->cap.max_send_wr;
+  qp->max_recv_wr = qp_init_attr->cap.max_recv_wr;
+  qp_init_attr->cap.max_inline_data =
+      std::min(qp_init_attr->cap.max_inline_data, mock::kMaxInlineData);
+  mock::fabric::instance().add_qp(qp);
+  return &qp->base;
+}
+
+int ibv_modify_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr, int attr_mask) {
+  return mock::fabric::instance().modify(reinterpret_cast<mock::qp *>(qp),
+                                         *attr, attr_mask);
+}
+
+int ibv_destroy_qp(struct ibv_qp *qp) {
+  auto target = reinterpret_cast<mock::qp *>(qp);
+  mock::fabric::instance().remove_qp(target);
+  delete target;
+  return 0;
+}
+
+struct ibv_ah *ibv_create_ah(struct ibv_pd *pd, struct ibv_ah_attr *) {
+  auto ah = new struct ibv_ah();
+  ah->context = pd->context;
+  ah->pd = pd;
+  return ah;
+}
+
+int ibv_init_ah_from_wc(struct ibv_context *, uint8_t port_num,
+                        struct ibv_wc *wc, struct ibv_grh *grh,
+                        struct ibv_ah_attr *ah_attr) {
+  ::memset(ah_attr, 0, sizeof(*ah_attr));
+  ah_attr->dlid = wc->slid;
+  ah_attr->sl = wc->sl;
+  ah_attr->src_path_bits = wc->dlid_path_bits;
+  ah_attr->port_num = port_num;
+  if (wc->wc_flags & IBV_WC_GRH) {
+    ah_attr->is_global = 1;
+    ah_attr->grh.dgid = grh->sgid;
+    ah_attr->grh.flow_label = be32toh(grh->version_tclass_flow) & 0xfffff;
+    ah_attr->grh.hop_limit = 0xff;
+  }
+  return 0;
+}
+
+int ibv_destroy_ah(struct ibv_ah *ah) {
+  delete ah;
+  return 0;
+}
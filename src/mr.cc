@@ -1,6 +1,8 @@
 #include "rdmapp/mr.h"
 
+#include <array>
 #include <cstdint>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -38,15 +40,17 @@ local_mr::~mr() {
   }
 }
 
-std::vector<uint8_t> local_mr::serialize() const {
-  std::vector<uint8_t> buffer;
-  auto it = std::back_inserter(buffer);
-  detail::serialize(reinterpret_cast<uint64_t>(mr_->addr), it);
-  detail::serialize(mr_->length, it);
-  detail::serialize(mr_->rkey, it);
+std::array<uint8_t, local_mr::kSerializedSize> local_mr::serialize() const {
+  std::array<uint8_t, kSerializedSize> buffer;
+  serialize(buffer);
   return buffer;
 }
 
+void local_mr::serialize(std::span<uint8_t, kSerializedSize> out) const {
+  detail::pack(out, reinterpret_cast<uint64_t>(mr_->addr),
+               static_cast<uint64_t>(mr_->length), mr_->rkey);
+}
+
 void *local_mr::addr() const { return mr_->addr; }
 
 size_t local_mr::length() const { return mr_->length; }
@@ -58,6 +62,21 @@ uint32_t local_mr::lkey() const { return mr_->lkey; }
 remote_mr::mr(void *addr, uint32_t length, uint32_t rkey)
     : addr_(addr), length_(length), rkey_(rkey) {}
 
+remote_mr remote_mr::deserialize(std::span<uint8_t const, kSerializedSize> in) {
+  uint64_t addr = 0;
+  uint64_t length = 0;
+  remote_mr remote_mr;
+  detail::unpack(in, addr, length, remote_mr.rkey_);
+  remote_mr.addr_ = reinterpret_cast<void *>(addr);
+  remote_mr.length_ = length;
+  return remote_mr;
+}
+
+void remote_mr::serialize(std::span<uint8_t, kSerializedSize> out) const {
+  detail::pack(out, reinterpret_cast<uint64_t>(addr_),
+               static_cast<uint64_t>(length_), rkey_);
+}
+
 void *remote_mr::addr() { return addr_; }
 
 uint32_t remote_mr::length() { return length_; }
@@ -0,0 +1,164 @@
+#include "rdmapp/polled_qp.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/error.h"
+
+#include "rdmapp/detail/debug.h"
+#include "rdmapp/detail/trace.h"
+
+namespace rdmapp {
+
+static inline struct ibv_sge fill_sge(local_mr const &mr, size_t length) {
+  assert(length <= mr.length());
+  struct ibv_sge sge = {};
+  sge.addr = reinterpret_cast<uint64_t>(mr.addr());
+  sge.length = length;
+  sge.lkey = mr.lkey();
+  return sge;
+}
+
+polled_qp::polled_qp(std::shared_ptr<qp> qp, std::shared_ptr<cq> cq)
+    : qp_(std::move(qp)), cq_(std::move(cq)), next_wr_id_(1) {
+  if (qp_->send_cq_ != cq_ || qp_->recv_cq_ != cq_) {
+    throw std::invalid_argument(
+        "polled qp must own both completion queues of the qp");
+  }
+  if (qp_->srq_ != nullptr) {
+    throw std::invalid_argument(
+        "polled qp cannot receive from a shared receive queue");
+  }
+  max_inline_data_ = qp_->max_inline_data_;
+}
+
+result<uint32_t> polled_qp::execute(struct ibv_sge &sge,
+                                    enum ibv_wr_opcode opcode,
+                                    remote_mr *remote_mr) {
+  struct ibv_send_wr send_wr = {};
+  struct ibv_send_wr *bad_send_wr = nullptr;
+  send_wr.wr_id = next_wr_id_++;
+  send_wr.opcode = opcode;
+  send_wr.num_sge = 1;
+  send_wr.sg_list = &sge;
+  send_wr.send_flags = IBV_SEND_SIGNALED;
+  if (opcode != IBV_WR_RDMA_READ && sge.length <= max_inline_data_) {
+    send_wr.send_flags |= IBV_SEND_INLINE;
+  }
+  if (remote_mr != nullptr) {
+    send_wr.wr.rdma.remote_addr = reinterpret_cast<uint64_t>(remote_mr->addr());
+    send_wr.wr.rdma.rkey = remote_mr->rkey();
+  }
+  try {
+    qp_->post_send(send_wr, bad_send_wr);
+  } catch (std::runtime_error &) {
+    return op_error::from_exception(std::current_exception());
+  }
+  auto const wc = wait(send_wr.wr_id);
+  if (wc.status != IBV_WC_SUCCESS) [[unlikely]] {
+    return op_error::from_status(wc.status);
+  }
+  return wc.byte_len;
+}
+
+struct ibv_wc polled_qp::wait(uint64_t wr_id) {
+  auto stashed = std::find_if(
+      stashed_.begin(), stashed_.end(),
+      [wr_id](struct ibv_wc const &wc) { return wc.wr_id == wr_id; });
+  if (stashed != stashed_.end()) {
+    auto const wc = *stashed;
+    stashed_.erase(stashed);
+    return wc;
+  }
+  std::array<struct ibv_wc, kPollBatch> wcs;
+  while (true) {
+    auto const n = cq_->poll(wcs.data(), kPollBatch);
+    std::optional<struct ibv_wc> found;
+    for (size_t i = 0; i < n; ++i) {
+      RDMAPP_TRACE_WC(poll, wcs[i]);
+      if (wcs[i].wr_id == wr_id) {
+        found = wcs[i];
+      } else {
+        RDMAPP_LOG_TRACE("polled qp stashing wr_id=%lu", wcs[i].wr_id);
+        stashed_.push_back(wcs[i]);
+      }
+    }
+    if (found) {
+      return *found;
+    }
+  }
+}
+
+polled_qp::completion<uint32_t> polled_qp::send(local_mr const &local_mr,
+                                                size_t length) {
+  auto sge = fill_sge(local_mr, length);
+  return execute(sge, IBV_WR_SEND, nullptr);
+}
+
+polled_qp::completion<uint32_t> polled_qp::send(local_mr const &local_mr) {
+  return send(local_mr, local_mr.length());
+}
+
+polled_qp::completion<uint32_t> polled_qp::write(remote_mr const &remote_mr,
+                                                 local_mr const &local_mr,
+                                                 size_t length) {
+  auto sge = fill_sge(local_mr, length);
+  auto remote = remote_mr;
+  return execute(sge, IBV_WR_RDMA_WRITE, &remote);
+}
+
+polled_qp::completion<uint32_t> polled_qp::write(remote_mr const &remote_mr,
+                                                 local_mr const &local_mr) {
+  return write(remote_mr, local_mr, local_mr.length());
+}
+
+polled_qp::completion<uint32_t> polled_qp::read(remote_mr const &remote_mr,
+                                                local_mr const &local_mr) {
+  auto sge = fill_sge(local_mr, local_mr.length());
+  auto remote = remote_mr;
+  return execute(sge, IBV_WR_RDMA_READ, &remote);
+}
+
+polled_qp::recv_ticket polled_qp::post_recv(local_mr const &local_mr) {
+  auto sge = fill_sge(local_mr, local_mr.length());
+  struct ibv_recv_wr recv_wr = {};
+  struct ibv_recv_wr *bad_recv_wr = nullptr;
+  recv_wr.wr_id = next_wr_id_++;
+  recv_wr.num_sge = 1;
+  recv_wr.sg_list = &sge;
+  qp_->post_recv(recv_wr, bad_recv_wr);
+  return recv_ticket{recv_wr.wr_id};
+}
+
+polled_qp::completion<std::pair<uint32_t, std::optional<uint32_t>>>
+polled_qp::wait_recv(recv_ticket ticket) {
+  using value_type = std::pair<uint32_t, std::optional<uint32_t>>;
+  auto const wc = wait(ticket.wr_id);
+  if (wc.status != IBV_WC_SUCCESS) [[unlikely]] {
+    return result<value_type>(op_error::from_status(wc.status));
+  }
+  if (wc.wc_flags & IBV_WC_WITH_IMM) {
+    return result<value_type>(
+        value_type(wc.byte_len, std::optional<uint32_t>(wc.imm_data)));
+  }
+  return result<value_type>(value_type(wc.byte_len, std::nullopt));
+}
+
+polled_qp::completion<std::pair<uint32_t, std::optional<uint32_t>>>
+polled_qp::recv(local_mr const &local_mr) {
+  return wait_recv(post_recv(local_mr));
+}
+
+std::shared_ptr<qp> polled_qp::qp_ptr() const { return qp_; }
+
+} // namespace rdmapp
@@ -4,17 +4,21 @@
 #include <arpa/inet.h>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <endian.h>
 #include <exception>
+#include <functional>
 #include <iterator>
 #include <memory>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <optional>
+#include <span>
 #include <stdexcept>
+#include <stop_token>
 #include <strings.h>
 #include <sys/socket.h>
 #include <utility>
@@ -24,11 +28,14 @@
 
 #include "rdmapp/error.h"
 #include "rdmapp/executor.h"
+#include "rdmapp/message_stream.h"
 #include "rdmapp/pd.h"
 #include "rdmapp/srq.h"
 
 #include "rdmapp/detail/debug.h"
 #include "rdmapp/detail/serdes.h"
+#include "rdmapp/detail/timer_queue.h"
+#include "rdmapp/detail/trace.h"
 
 namespace rdmapp {
 
@@ -52,27 +59,78 @@ qp::qp(std::shared_ptr<rdmapp::pd> pd, std::shared_ptr<cq> cq,
 
 qp::qp(std::shared_ptr<rdmapp::pd> pd, std::shared_ptr<cq> recv_cq,
        std::shared_ptr<cq> send_cq, std::shared_ptr<srq> srq)
-    : qp_(nullptr), pd_(pd), recv_cq_(recv_cq), send_cq_(send_cq), srq_(srq) {
+    : qp_(nullptr), max_inline_data_(0), pd_(pd), recv_cq_(recv_cq),
+      send_cq_(send_cq), srq_(srq), sq_outstanding_(0), recvs_posted_(0),
+      recv_post_errors_(0) {
   create();
   init();
+  capabilities_ = local_capabilities();
 }
 
 std::vector<uint8_t> &qp::user_data() { return user_data_; }
 
 std::shared_ptr<pd> qp::pd_ptr() const { return pd_; }
 
+std::shared_ptr<srq> qp::srq_ptr() const { return srq_; }
+
 std::vector<uint8_t> qp::serialize() const {
-  std::vector<uint8_t> buffer;
-  auto it = std::back_inserter(buffer);
-  detail::serialize(pd_->device_ptr()->lid(), it);
-  detail::serialize(qp_->qp_num, it);
-  detail::serialize(sq_psn_, it);
-  detail::serialize(static_cast<uint32_t>(user_data_.size()), it);
-  detail::serialize(pd_->device_ptr()->gid(), it);
-  std::copy(user_data_.cbegin(), user_data_.cend(), it);
+  std::vector<uint8_t> buffer(kSerializedHeaderSize + user_data_.size());
+  serialize_header(std::span<uint8_t, kSerializedHeaderSize>(
+      buffer.data(), kSerializedHeaderSize));
+  std::copy(user_data_.cbegin(), user_data_.cend(),
+            buffer.begin() + kSerializedHeaderSize);
   return buffer;
 }
 
+void qp::serialize_header(
+    std::span<uint8_t, kSerializedHeaderSize> out) const {
+  auto const caps = local_capabilities();
+  detail::pack(out, deserialized_qp::kWireVersion, pd_->device_ptr()->lid(),
+               qp_->qp_num, sq_psn_, static_cast<uint32_t>(user_data_.size()),
+               static_cast<uint16_t>(qp_capabilities::kSerializedSize),
+               pd_->device_ptr()->gid(), caps.path_mtu, caps.max_rd_atomic,
+               caps.max_dest_rd_atomic, caps.max_inline_data, caps.max_recv_wr,
+               caps.features);
+}
+
+qp_capabilities
+qp_capabilities::negotiate(qp_capabilities const &remote) const {
+  qp_capabilities caps;
+  caps.path_mtu = std::min(path_mtu, remote.path_mtu);
+  caps.max_rd_atomic = std::min(max_rd_atomic, remote.max_dest_rd_atomic);
+  caps.max_dest_rd_atomic = std::min(max_dest_rd_atomic, remote.max_rd_atomic);
+  caps.max_inline_data = max_inline_data;
+  caps.max_recv_wr = remote.max_recv_wr;
+  caps.features = features & remote.features;
+  return caps;
+}
+
+qp_capabilities qp::local_capabilities() const {
+  auto const &device = pd_->device_;
+  qp_capabilities caps;
+  caps.path_mtu = device->port_attr_.active_mtu;
+  caps.max_rd_atomic = device->device_attr_ex_.orig_attr.max_qp_init_rd_atom;
+  caps.max_dest_rd_atomic = device->device_attr_ex_.orig_attr.max_qp_rd_atom;
+  caps.max_inline_data = max_inline_data_;
+  caps.max_recv_wr = srq_ == nullptr ? kMaxRecvWr : 0;
+  caps.features = 0;
+  if (device->is_fetch_and_add_supported()) {
+    caps.features |= qp_capabilities::kFeatureAtomic;
+  }
+  return caps;
+}
+
+void qp::negotiate(qp_capabilities const &remote) {
+  capabilities_ = local_capabilities().negotiate(remote);
+  RDMAPP_LOG_TRACE("negotiated qpn=%u mtu=%u rd_atomic=%u dest_rd_atomic=%u "
+                   "features=%#x",
+                   qp_->qp_num, capabilities_.path_mtu,
+                   capabilities_.max_rd_atomic,
+                   capabilities_.max_dest_rd_atomic, capabilities_.features);
+}
+
+qp_capabilities const &qp::capabilities() const { return capabilities_; }
+
 void qp::create() {
   struct ibv_qp_init_attr qp_init_attr = {};
   ::bzero(&qp_init_attr, sizeof(qp_init_attr));
@@ -81,8 +139,8 @@ void qp::create() {
   qp_init_attr.send_cq = send_cq_->cq_;
   qp_init_attr.cap.max_recv_sge = 1;
   qp_init_attr.cap.max_send_sge = 1;
-  qp_init_attr.cap.max_recv_wr = 128;
-  qp_init_attr.cap.max_send_wr = 128;
+  qp_init_attr.cap.max_recv_wr = kMaxRecvWr;
+  qp_init_attr.cap.max_send_wr = kMaxSendWr;
   qp_init_attr.sq_sig_all = 0;
   qp_init_attr.qp_context = this;
 
@@ -96,6 +154,7 @@ void qp::create() {
 
   qp_ = ::ibv_create_qp(pd_->pd_, &qp_init_attr);
   check_ptr(qp_, "failed to create qp");
+  max_inline_data_ = qp_init_attr.cap.max_inline_data;
   sq_psn_ = next_sq_psn.fetch_add(1);
   RDMAPP_LOG_TRACE("created qp %p lid=%u qpn=%u psn=%u",
                    reinterpret_cast<void *>(qp_), pd_->device_ptr()->lid(),
@@ -128,10 +187,10 @@ void qp::rtr(uint16_t remote_lid, uint32_t remote_qpn, uint32_t remote_psn,
   struct ibv_qp_attr qp_attr = {};
   ::bzero(&qp_attr, sizeof(qp_attr));
   qp_attr.qp_state = IBV_QPS_RTR;
-  qp_attr.path_mtu = IBV_MTU_4096;
+  qp_attr.path_mtu = static_cast<enum ibv_mtu>(capabilities_.path_mtu);
   qp_attr.dest_qp_num = remote_qpn;
   qp_attr.rq_psn = remote_psn;
-  qp_attr.max_dest_rd_atomic = 16;
+  qp_attr.max_dest_rd_atomic = capabilities_.max_dest_rd_atomic;
   qp_attr.min_rnr_timer = 12;
   qp_attr.ah_attr.is_global = 1;
   qp_attr.ah_attr.grh.dgid = remote_gid;
@@ -164,7 +223,7 @@ void qp::rts() {
   qp_attr.timeout = 14;
   qp_attr.retry_cnt = 7;
   qp_attr.rnr_retry = 7;
-  qp_attr.max_rd_atomic = 16;
+  qp_attr.max_rd_atomic = capabilities_.max_rd_atomic;
   qp_attr.sq_psn = sq_psn_;
 
   try {
@@ -181,19 +240,256 @@ void qp::rts() {
   }
 }
 
+void qp::modify(struct ibv_qp_attr &attr, int attr_mask) {
+  check_rc(::ibv_modify_qp(qp_, &attr, attr_mask), "failed to modify qp");
+}
+
+void qp::flush() {
+  struct ibv_qp_attr attr = {};
+  attr.qp_state = IBV_QPS_ERR;
+  modify(attr, IBV_QP_STATE);
+  RDMAPP_LOG_DEBUG("qp %u moved to error state", qp_->qp_num);
+}
+
+uint32_t qp::qp_num() const { return qp_->qp_num; }
+
+void qp::cancellation::state::fire(reason why) noexcept {
+  auto expected = reason::pending;
+  if (!reason_.compare_exchange_strong(expected, why)) {
+    return;
+  }
+  auto qp = qp_.lock();
+  if (!qp) {
+    return;
+  }
+  try {
+    qp->flush();
+  } catch (std::runtime_error &e) {
+    RDMAPP_LOG_ERROR("%s", e.what());
+  }
+}
+
+void qp::cancellation::set_deadline(
+    std::chrono::steady_clock::time_point deadline) {
+  deadline_ = deadline;
+}
+
+void qp::cancellation::set_stop_token(std::stop_token stop_token) {
+  stop_token_ = std::move(stop_token);
+}
+
+bool qp::cancellation::enabled() const noexcept {
+  return deadline_.has_value() || stop_token_.stop_possible();
+}
+
+void qp::cancellation::arm(std::shared_ptr<qp> const &qp) {
+  if (!enabled()) [[likely]] {
+    return;
+  }
+  state_ = std::make_shared<state>();
+  state_->qp_ = qp;
+  if (deadline_.has_value()) {
+    timer_id_ = detail::timer_queue::instance().schedule(
+        *deadline_, [state = state_]() { state->fire(reason::timed_out); });
+  }
+  if (stop_token_.stop_possible()) {
+    stop_callback_ =
+        std::make_unique<std::stop_callback<std::function<void()>>>(
+            stop_token_,
+            [state = state_]() { state->fire(reason::cancelled); });
+  }
+}
+
+void qp::cancellation::disarm() noexcept {
+  if (!state_) [[likely]] {
+    return;
+  }
+  auto expected = reason::pending;
+  state_->reason_.compare_exchange_strong(expected, reason::completed);
+  if (timer_id_ != 0) {
+    detail::timer_queue::instance().cancel(timer_id_);
+  }
+  stop_callback_.reset();
+}
+
+std::optional<op_error>
+qp::cancellation::check(enum ibv_wc_status status) const noexcept {
+  if (!state_ || status != IBV_WC_WR_FLUSH_ERR) [[likely]] {
+    return std::nullopt;
+  }
+  switch (state_->reason_.load()) {
+  case reason::timed_out:
+    return op_error{op_error::kind::timed_out, status, ETIMEDOUT};
+  case reason::cancelled:
+    return op_error{op_error::kind::cancelled, status, ECANCELED};
+  default:
+    return std::nullopt;
+  }
+}
+
 void qp::post_send(struct ibv_send_wr const &send_wr,
                    struct ibv_send_wr *&bad_send_wr) {
   RDMAPP_LOG_TRACE("post send wr_id=%p addr=%p",
                    reinterpret_cast<void *>(send_wr.wr_id),
                    reinterpret_cast<void *>(send_wr.sg_list->addr));
+  detail::trace_post_send(qp_->qp_num, &send_wr);
   check_rc(::ibv_post_send(qp_, const_cast<struct ibv_send_wr *>(&send_wr),
                            &bad_send_wr),
            "failed to post send");
 }
 
+qp::deferred_send qp::make_deferred_send(struct ibv_send_wr const &send_wr,
+                                         uint32_t nr_wrs,
+                                         send_error_fn &&on_error) {
+  deferred_send deferred;
+  deferred.on_error = std::move(on_error);
+  deferred.send_wrs.reserve(nr_wrs);
+  size_t nr_sges = 0;
+  auto wr = &send_wr;
+  for (uint32_t i = 0; i < nr_wrs; ++i, wr = wr->next) {
+    assert(wr != nullptr);
+    deferred.send_wrs.push_back(*wr);
+    nr_sges += wr->num_sge;
+  }
+  // The copies are relinked only after both vectors are fully populated, so
+  // that no reallocation can invalidate the pointers.
+  deferred.sges.reserve(nr_sges);
+  for (auto &copied_wr : deferred.send_wrs) {
+    auto const first_sge = deferred.sges.size();
+    deferred.sges.insert(deferred.sges.end(), copied_wr.sg_list,
+                         copied_wr.sg_list + copied_wr.num_sge);
+    copied_wr.sg_list = deferred.sges.data() + first_sge;
+  }
+  for (size_t i = 0; i + 1 < deferred.send_wrs.size(); ++i) {
+    deferred.send_wrs[i].next = &deferred.send_wrs[i + 1];
+  }
+  deferred.send_wrs.back().next = nullptr;
+  return deferred;
+}
+
+void qp::post_reserved_send(struct ibv_send_wr const &send_wr,
+                            uint32_t nr_wrs) {
+  struct ibv_send_wr *bad_send_wr = nullptr;
+  try {
+    post_send(send_wr, bad_send_wr);
+  } catch (...) {
+    // Deferred sends are not drained here as their error handlers may need
+    // locks held by the caller. The next completion will drain them.
+    std::lock_guard lock(sq_mutex_);
+    count_posted_sends(send_wr, nr_wrs, bad_send_wr);
+    sq_outstanding_ -= nr_wrs;
+    ++sq_stats_.send_post_errors;
+    throw;
+  }
+  std::lock_guard lock(sq_mutex_);
+  count_posted_sends(send_wr, nr_wrs);
+}
+
+void qp::release_send_slots(uint32_t nr_wrs) {
+  std::vector<send_error_fn> failed;
+  std::exception_ptr exception;
+  {
+    std::lock_guard lock(sq_mutex_);
+    assert(sq_outstanding_ >= nr_wrs);
+    sq_outstanding_ -= nr_wrs;
+    sq_stats_.sends_completed += nr_wrs;
+    size_t nr_ready = 0;
+    while (nr_ready < sq_deferred_.size() &&
+           sq_outstanding_ + sq_deferred_[nr_ready].send_wrs.size() <=
+               kMaxSendWr) {
+      sq_outstanding_ += sq_deferred_[nr_ready].send_wrs.size();
+      ++nr_ready;
+    }
+    if (nr_ready == 0) {
+      return;
+    }
+    // All deferred sends that fit are linked and posted with one doorbell.
+    // This is done under the lock so that they keep their FIFO order.
+    for (size_t i = 0; i + 1 < nr_ready; ++i) {
+      sq_deferred_[i].send_wrs.back().next = &sq_deferred_[i + 1].send_wrs[0];
+    }
+    sq_deferred_[nr_ready - 1].send_wrs.back().next = nullptr;
+    struct ibv_send_wr *bad_send_wr = nullptr;
+    try {
+      post_send(sq_deferred_[0].send_wrs[0], bad_send_wr);
+    } catch (std::runtime_error &e) {
+      exception = std::make_exception_ptr(e);
+    }
+    // Sends before the one containing the bad work request were posted.
+    bool posted = !exception || bad_send_wr != nullptr;
+    for (size_t i = 0; i < nr_ready; ++i) {
+      auto &deferred = sq_deferred_.front();
+      if (exception && posted &&
+          bad_send_wr >= &deferred.send_wrs.front() &&
+          bad_send_wr <= &deferred.send_wrs.back()) {
+        count_posted_sends(deferred.send_wrs.front(), deferred.send_wrs.size(),
+                           bad_send_wr);
+        posted = false;
+      } else if (posted) {
+        count_posted_sends(deferred.send_wrs.front(),
+                           deferred.send_wrs.size());
+      }
+      if (!posted) {
+        // The whole send fails even if part of it was posted, since the
+        // signaled work request at its tail never will be.
+        sq_outstanding_ -= deferred.send_wrs.size();
+        ++sq_stats_.send_post_errors;
+        failed.emplace_back(std::move(deferred.on_error));
+      }
+      sq_deferred_.pop_front();
+    }
+  }
+  for (auto &on_error : failed) {
+    on_error(exception);
+  }
+}
+
+void qp::count_posted_sends(struct ibv_send_wr const &send_wr,
+                            uint32_t nr_wrs,
+                            struct ibv_send_wr const *bad_send_wr) {
+  auto wr = &send_wr;
+  for (uint32_t i = 0; i < nr_wrs && wr != bad_send_wr; ++i, wr = wr->next) {
+    auto &stats = sq_stats_.sends_posted[qp_stats::opcode_index(wr->opcode)];
+    ++stats.count;
+    for (int j = 0; j < wr->num_sge; ++j) {
+      stats.bytes += wr->sg_list[j].length;
+    }
+  }
+}
+
+uint32_t qp::outstanding_sends() {
+  std::lock_guard lock(sq_mutex_);
+  return sq_outstanding_;
+}
+
+qp_stats qp::stats() {
+  qp_stats stats;
+  {
+    std::lock_guard lock(sq_mutex_);
+    stats = sq_stats_;
+    stats.outstanding_sends = sq_outstanding_;
+  }
+  stats.qp_num = qp_num();
+  stats.recvs_posted = recvs_posted_.load(std::memory_order_relaxed);
+  stats.recv_post_errors = recv_post_errors_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 void qp::post_recv(struct ibv_recv_wr const &recv_wr,
                    struct ibv_recv_wr *&bad_recv_wr) const {
-  (this->*(post_recv_fn))(recv_wr, bad_recv_wr);
+  // Receives may be posted from any thread without a lock, so this is the
+  // one counter of the Queue Pair that needs an atomic increment.
+  try {
+    (this->*(post_recv_fn))(recv_wr, bad_recv_wr);
+  } catch (...) {
+    recv_post_errors_.fetch_add(1, std::memory_order_relaxed);
+    throw;
+  }
+  uint64_t nr_wrs = 0;
+  for (auto wr = &recv_wr; wr != nullptr; wr = wr->next) {
+    ++nr_wrs;
+  }
+  recvs_posted_.fetch_add(nr_wrs, std::memory_order_relaxed);
 }
 
 void qp::post_recv_rq(struct ibv_recv_wr const &recv_wr,
@@ -201,6 +497,7 @@ void qp::post_recv_rq(struct ibv_recv_wr const &recv_wr,
   RDMAPP_LOG_TRACE("post recv wr_id=%p addr=%p",
                    reinterpret_cast<void *>(recv_wr.wr_id),
                    reinterpret_cast<void *>(recv_wr.sg_list->addr));
+  detail::trace_post_recv(qp_->qp_num, &recv_wr);
   check_rc(::ibv_post_recv(qp_, const_cast<struct ibv_recv_wr *>(&recv_wr),
                            &bad_recv_wr),
            "failed to post recv");
@@ -208,6 +505,7 @@ void qp::post_recv_rq(struct ibv_recv_wr const &recv_wr,
 
 void qp::post_recv_srq(struct ibv_recv_wr const &recv_wr,
                        struct ibv_recv_wr *&bad_recv_wr) const {
+  detail::trace_post_recv(qp_->qp_num, &recv_wr);
   check_rc(::ibv_post_srq_recv(raw_srq_,
                                const_cast<struct ibv_recv_wr *>(&recv_wr),
                                &bad_recv_wr),
@@ -286,20 +584,26 @@ static inline struct ibv_sge fill_local_sge(local_mr const &mr) {
 bool qp::send_awaitable::await_ready() const noexcept { return false; }
 bool qp::send_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
   auto callback = executor::make_callback([h, this](struct ibv_wc const &wc) {
+    qp_->release_send_slots(1);
+    cancellation_.disarm();
     wc_ = wc;
+    RDMAPP_TRACE_WC(resume, wc);
     h.resume();
   });
 
   auto send_sge = fill_local_sge(*local_mr_);
 
   struct ibv_send_wr send_wr = {};
-  struct ibv_send_wr *bad_send_wr = nullptr;
   send_wr.opcode = opcode_;
   send_wr.next = nullptr;
   send_wr.num_sge = 1;
   send_wr.wr_id = reinterpret_cast<uint64_t>(callback);
   send_wr.send_flags = IBV_SEND_SIGNALED;
   send_wr.sg_list = &send_sge;
+  if (opcode_ != IBV_WR_RDMA_READ && !is_atomic() &&
+      send_sge.length <= qp_->capabilities_.max_inline_data) {
+    send_wr.send_flags |= IBV_SEND_INLINE;
+  }
   if (is_rdma()) {
     assert(remote_mr_.addr() != nullptr);
     send_wr.wr.rdma.remote_addr = reinterpret_cast<uint64_t>(remote_mr_.addr());
@@ -319,9 +623,19 @@ bool qp::send_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
   }
 
   try {
-    qp_->post_send(send_wr, bad_send_wr);
-  } catch (std::runtime_error &e) {
-    exception_ = std::make_exception_ptr(e);
+    cancellation_.arm(qp_);
+    qp_->post_send_when_ready(
+        send_wr, 1, [h, this, callback](std::exception_ptr exception) {
+          cancellation_.disarm();
+          if (exception) {
+            error_ = op_error::from_exception(exception);
+          }
+          executor::destroy_callback(callback);
+          h.resume();
+        });
+  } catch (...) {
+    cancellation_.disarm();
+    error_ = op_error::from_exception(std::current_exception());
     executor::destroy_callback(callback);
     return false;
   }
@@ -338,14 +652,45 @@ constexpr bool qp::send_awaitable::is_atomic() const {
          opcode_ == IBV_WR_ATOMIC_FETCH_AND_ADD;
 }
 
-uint32_t qp::send_awaitable::await_resume() const {
-  if (exception_) [[unlikely]] {
-    std::rethrow_exception(exception_);
+result<uint32_t> qp::send_awaitable::try_resume() const noexcept {
+  if (error_) [[unlikely]] {
+    return *error_;
+  }
+  if (wc_.status != IBV_WC_SUCCESS) [[unlikely]] {
+    if (auto error = cancellation_.check(wc_.status)) {
+      return *error;
+    }
+    return op_error::from_status(wc_.status);
   }
-  check_wc_status(wc_.status, "failed to send");
   return wc_.byte_len;
 }
 
+uint32_t qp::send_awaitable::await_resume() const {
+  return try_resume().value("failed to send");
+}
+
+result_awaitable<qp::send_awaitable>
+qp::send_awaitable::as_result() & noexcept {
+  return result_awaitable<send_awaitable>(*this);
+}
+
+result_awaitable<qp::send_awaitable>
+qp::send_awaitable::as_result() && noexcept {
+  return result_awaitable<send_awaitable>(*this);
+}
+
+qp::send_awaitable &qp::send_awaitable::with_deadline(
+    std::chrono::steady_clock::time_point deadline) {
+  cancellation_.set_deadline(deadline);
+  return *this;
+}
+
+qp::send_awaitable &
+qp::send_awaitable::with_stop_token(std::stop_token stop_token) {
+  cancellation_.set_stop_token(std::move(stop_token));
+  return *this;
+}
+
 qp::send_awaitable qp::send(void *buffer, size_t length) {
   return qp::send_awaitable(this->shared_from_this(), buffer, length,
                             IBV_WR_SEND);
@@ -436,8 +781,17 @@ qp::recv_awaitable::recv_awaitable(std::shared_ptr<qp> qp,
 
 bool qp::recv_awaitable::await_ready() const noexcept { return false; }
 bool qp::recv_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
+  if (cancellation_.enabled() && qp_->srq_ != nullptr) [[unlikely]] {
+    RDMAPP_LOG_ERROR(
+        "receives posted to a shared receive queue cannot be cancelled");
+    error_ = op_error::from_invalid_argument();
+    return false;
+  }
+
   auto callback = executor::make_callback([h, this](struct ibv_wc const &wc) {
+    cancellation_.disarm();
     wc_ = wc;
+    RDMAPP_TRACE_WC(resume, wc);
     h.resume();
   });
 
@@ -451,25 +805,59 @@ bool qp::recv_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
   recv_wr.sg_list = &recv_sge;
 
   try {
+    cancellation_.arm(qp_);
     qp_->post_recv(recv_wr, bad_recv_wr);
-  } catch (std::runtime_error &e) {
-    exception_ = std::make_exception_ptr(e);
+  } catch (...) {
+    cancellation_.disarm();
+    error_ = op_error::from_exception(std::current_exception());
     executor::destroy_callback(callback);
     return false;
   }
   return true;
 }
 
-std::pair<uint32_t, std::optional<uint32_t>>
-qp::recv_awaitable::await_resume() const {
-  if (exception_) [[unlikely]] {
-    std::rethrow_exception(exception_);
+result<std::pair<uint32_t, std::optional<uint32_t>>>
+qp::recv_awaitable::try_resume() const noexcept {
+  if (error_) [[unlikely]] {
+    return *error_;
+  }
+  if (wc_.status != IBV_WC_SUCCESS) [[unlikely]] {
+    if (auto error = cancellation_.check(wc_.status)) {
+      return *error;
+    }
+    return op_error::from_status(wc_.status);
   }
-  check_wc_status(wc_.status, "failed to recv");
   if (wc_.wc_flags & IBV_WC_WITH_IMM) {
-    return std::make_pair(wc_.byte_len, wc_.imm_data);
+    return std::make_pair(wc_.byte_len, std::optional<uint32_t>(wc_.imm_data));
   }
-  return std::make_pair(wc_.byte_len, std::nullopt);
+  return std::make_pair(wc_.byte_len, std::optional<uint32_t>());
+}
+
+std::pair<uint32_t, std::optional<uint32_t>>
+qp::recv_awaitable::await_resume() const {
+  return try_resume().value("failed to recv");
+}
+
+result_awaitable<qp::recv_awaitable>
+qp::recv_awaitable::as_result() & noexcept {
+  return result_awaitable<recv_awaitable>(*this);
+}
+
+result_awaitable<qp::recv_awaitable>
+qp::recv_awaitable::as_result() && noexcept {
+  return result_awaitable<recv_awaitable>(*this);
+}
+
+qp::recv_awaitable &qp::recv_awaitable::with_deadline(
+    std::chrono::steady_clock::time_point deadline) {
+  cancellation_.set_deadline(deadline);
+  return *this;
+}
+
+qp::recv_awaitable &
+qp::recv_awaitable::with_stop_token(std::stop_token stop_token) {
+  cancellation_.set_stop_token(std::move(stop_token));
+  return *this;
 }
 
 qp::recv_awaitable qp::recv(void *buffer, size_t length) {
@@ -480,6 +868,330 @@ qp::recv_awaitable qp::recv(std::shared_ptr<local_mr> local_mr) {
   return qp::recv_awaitable(this->shared_from_this(), local_mr);
 }
 
+message_stream qp::messages(size_t nr_buffers, size_t buffer_size) {
+  return message_stream(this->shared_from_this(), nr_buffers, buffer_size);
+}
+
+size_t qp::path_mtu_bytes() const {
+  // IBV_MTU_256 is 1, and each step doubles the size.
+  return size_t(128) << std::clamp<uint16_t>(capabilities_.path_mtu,
+                                             IBV_MTU_256, IBV_MTU_4096);
+}
+
+size_t qp::align_to_mtu(size_t length) const {
+  auto const mtu = path_mtu_bytes();
+  if (length < mtu) {
+    return mtu;
+  }
+  return (length + mtu - 1) / mtu * mtu;
+}
+
+/*
+ * Chunks are striped over all lanes, so they are aligned to the largest path
+ * MTU among them. MTUs are powers of two, so that is a multiple of all.
+ */
+static size_t align_chunk_size(std::vector<std::shared_ptr<qp>> const &qps,
+                               size_t chunk_size) {
+  auto const widest = std::max_element(
+      qps.begin(), qps.end(), [](auto const &a, auto const &b) {
+        return a->path_mtu_bytes() < b->path_mtu_bytes();
+      });
+  return (*widest)->align_to_mtu(
+      std::min(chunk_size, qp::kMaxBulkChunkSize));
+}
+
+qp::bulk_awaitable::bulk_awaitable(std::shared_ptr<qp> qp,
+                                   std::shared_ptr<local_mr> local_mr,
+                                   enum ibv_wr_opcode opcode,
+                                   remote_mr const &remote_mr,
+                                   size_t chunk_size, size_t window)
+    : bulk_awaitable(std::vector<std::shared_ptr<rdmapp::qp>>{qp},
+                     std::vector<std::shared_ptr<rdmapp::local_mr>>{local_mr},
+                     opcode, std::vector<rdmapp::remote_mr>{remote_mr},
+                     chunk_size, window) {}
+
+qp::bulk_awaitable::bulk_awaitable(std::shared_ptr<qp> qp, void *buffer,
+                                   size_t length, enum ibv_wr_opcode opcode,
+                                   remote_mr const &remote_mr,
+                                   size_t chunk_size, size_t window)
+    : bulk_awaitable(
+          qp, std::make_shared<local_mr>(qp->pd_->reg_mr(buffer, length)),
+          opcode, remote_mr, chunk_size, window) {}
+
+qp::bulk_awaitable::bulk_awaitable(
+    std::vector<std::shared_ptr<qp>> const &qps,
+    std::vector<std::shared_ptr<local_mr>> const &local_mrs,
+    enum ibv_wr_opcode opcode, std::vector<remote_mr> const &remote_mrs,
+    size_t chunk_size, size_t window)
+    : opcode_(opcode), length_(local_mrs.front()->length()),
+      chunk_size_(align_chunk_size(qps, chunk_size)),
+      window_(std::clamp<size_t>(window, 1, kMaxSendWr)), next_offset_(0),
+      inflight_(0), transferred_(0), status_(IBV_WC_SUCCESS) {
+  assert(local_mrs.size() == qps.size());
+  assert(remote_mrs.size() == qps.size());
+  lanes_.reserve(qps.size());
+  for (size_t i = 0; i < qps.size(); ++i) {
+    assert(local_mrs[i]->length() == length_);
+    assert(remote_mrs[i].length() >= length_);
+    lanes_.push_back(lane{qps[i], local_mrs[i], remote_mrs[i], 0});
+  }
+}
+
+bool qp::bulk_awaitable::await_ready() const noexcept { return length_ == 0; }
+
+void qp::bulk_awaitable::post_chunk(size_t lane_id) {
+  auto &lane = lanes_[lane_id];
+  auto const offset = next_offset_;
+  auto const chunk_length = std::min(chunk_size_, length_ - offset);
+  auto callback = executor::make_callback(
+      [this, lane_id, chunk_length](struct ibv_wc const &wc) {
+        lanes_[lane_id].qp_->release_send_slots(1);
+        on_chunk_complete(lane_id, wc, chunk_length);
+      });
+
+  struct ibv_sge send_sge = {};
+  send_sge.addr = reinterpret_cast<uint64_t>(lane.local_mr_->addr()) + offset;
+  send_sge.length = chunk_length;
+  send_sge.lkey = lane.local_mr_->lkey();
+
+  struct ibv_send_wr send_wr = {};
+  send_wr.opcode = opcode_;
+  send_wr.next = nullptr;
+  send_wr.num_sge = 1;
+  send_wr.wr_id = reinterpret_cast<uint64_t>(callback);
+  send_wr.send_flags = IBV_SEND_SIGNALED;
+  send_wr.sg_list = &send_sge;
+  send_wr.wr.rdma.remote_addr =
+      reinterpret_cast<uint64_t>(lane.remote_mr_.addr()) + offset;
+  send_wr.wr.rdma.rkey = lane.remote_mr_.rkey();
+
+  try {
+    lane.qp_->post_send_when_ready(
+        send_wr, 1, [this, lane_id, callback](std::exception_ptr exception) {
+          executor::destroy_callback(callback);
+          on_chunk_failed(lane_id, exception);
+        });
+  } catch (...) {
+    executor::destroy_callback(callback);
+    throw;
+  }
+  next_offset_ += chunk_length;
+  ++lane.inflight_;
+  ++inflight_;
+}
+
+void qp::bulk_awaitable::on_chunk_failed(size_t lane_id,
+                                         std::exception_ptr exception) {
+  std::unique_lock lock(mutex_);
+  --lanes_[lane_id].inflight_;
+  --inflight_;
+  if (!exception_) {
+    exception_ = exception;
+  }
+  if (inflight_ == 0) {
+    lock.unlock();
+    h_.resume();
+  }
+}
+
+void qp::bulk_awaitable::on_chunk_complete(size_t lane_id,
+                                           struct ibv_wc const &wc,
+                                           size_t chunk_length) {
+  std::unique_lock lock(mutex_);
+  --lanes_[lane_id].inflight_;
+  --inflight_;
+  if (wc.status != IBV_WC_SUCCESS) [[unlikely]] {
+    if (status_ == IBV_WC_SUCCESS) {
+      status_ = wc.status;
+    }
+  } else {
+    transferred_ += chunk_length;
+  }
+  if (status_ == IBV_WC_SUCCESS && !exception_) {
+    try {
+      while (next_offset_ < length_ && lanes_[lane_id].inflight_ < window_) {
+        post_chunk(lane_id);
+      }
+    } catch (...) {
+      exception_ = std::current_exception();
+    }
+  }
+  if (inflight_ == 0) {
+    lock.unlock();
+    RDMAPP_TRACE_WC(resume, wc);
+    h_.resume();
+  }
+}
+
+bool qp::bulk_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
+  std::lock_guard lock(mutex_);
+  h_ = h;
+  try {
+    // Hand out the first window round-robin so that every lane starts busy
+    // even when the transfer is only a few chunks long.
+    bool posted = true;
+    while (posted && next_offset_ < length_) {
+      posted = false;
+      for (size_t i = 0; i < lanes_.size() && next_offset_ < length_; ++i) {
+        if (lanes_[i].inflight_ < window_) {
+          post_chunk(i);
+          posted = true;
+        }
+      }
+    }
+  } catch (...) {
+    exception_ = std::current_exception();
+  }
+  return inflight_ > 0;
+}
+
+size_t qp::bulk_awaitable::await_resume() const {
+  if (exception_) [[unlikely]] {
+    std::rethrow_exception(exception_);
+  }
+  check_wc_status(status_, opcode_ == IBV_WR_RDMA_READ
+                               ? "failed to read bulk"
+                               : "failed to write bulk");
+  return transferred_;
+}
+
+qp::bulk_awaitable qp::write_bulk(remote_mr const &remote_mr,
+                                  std::shared_ptr<local_mr> local_mr,
+                                  size_t chunk_size, size_t window) {
+  return qp::bulk_awaitable(this->shared_from_this(), local_mr,
+                            IBV_WR_RDMA_WRITE, remote_mr, chunk_size, window);
+}
+
+qp::bulk_awaitable qp::read_bulk(remote_mr const &remote_mr,
+                                 std::shared_ptr<local_mr> local_mr,
+                                 size_t chunk_size, size_t window) {
+  return qp::bulk_awaitable(this->shared_from_this(), local_mr,
+                            IBV_WR_RDMA_READ, remote_mr, chunk_size, window);
+}
+
+qp::bulk_awaitable qp::write_bulk(remote_mr const &remote_mr, void *buffer,
+                                  size_t length, size_t chunk_size,
+                                  size_t window) {
+  return qp::bulk_awaitable(this->shared_from_this(), buffer, length,
+                            IBV_WR_RDMA_WRITE, remote_mr, chunk_size, window);
+}
+
+qp::bulk_awaitable qp::read_bulk(remote_mr const &remote_mr, void *buffer,
+                                 size_t length, size_t chunk_size,
+                                 size_t window) {
+  return qp::bulk_awaitable(this->shared_from_this(), buffer, length,
+                            IBV_WR_RDMA_READ, remote_mr, chunk_size, window);
+}
+
+qp::gather_awaitable::gather_awaitable(std::shared_ptr<qp> qp,
+                                       std::vector<gather_entry> entries)
+    : qp_(qp), entries_(std::move(entries)), next_entry_(0), transferred_(0),
+      wc_(), chain_status_(IBV_WC_SUCCESS) {}
+
+bool qp::gather_awaitable::await_ready() const noexcept {
+  return entries_.empty();
+}
+
+void qp::gather_awaitable::post_batch() {
+  auto const first = next_entry_;
+  auto const last = std::min(entries_.size(), first + kMaxSendWr);
+  auto const batch_size = last - first;
+  std::vector<struct ibv_sge> sges(batch_size);
+  std::vector<struct ibv_send_wr> send_wrs(batch_size);
+  size_t batch_length = 0;
+  for (size_t i = 0; i < batch_size; ++i) {
+    auto &entry = entries_[first + i];
+    assert(entry.local_offset + entry.remote.length() <=
+           entry.local->length());
+    sges[i].addr =
+        reinterpret_cast<uint64_t>(entry.local->addr()) + entry.local_offset;
+    sges[i].length = entry.remote.length();
+    sges[i].lkey = entry.local->lkey();
+    batch_length += entry.remote.length();
+
+    auto &send_wr = send_wrs[i];
+    send_wr.wr_id = executor::make_status_wr_id(&chain_status_);
+    send_wr.opcode = IBV_WR_RDMA_READ;
+    send_wr.next = i + 1 < batch_size ? &send_wrs[i + 1] : nullptr;
+    send_wr.num_sge = 1;
+    send_wr.sg_list = &sges[i];
+    send_wr.wr.rdma.remote_addr =
+        reinterpret_cast<uint64_t>(entry.remote.addr());
+    send_wr.wr.rdma.rkey = entry.remote.rkey();
+  }
+
+  // Only the tail of the chain is signaled. A failed read ahead of it leaves
+  // its status in chain_status_ before the tail completes with a flush error.
+  chain_status_ = IBV_WC_SUCCESS;
+  auto callback =
+      executor::make_callback(
+          [this, batch_length, batch_size](struct ibv_wc const &wc) {
+            qp_->release_send_slots(batch_size);
+            on_batch_complete(wc, batch_length);
+          });
+  send_wrs.back().wr_id = reinterpret_cast<uint64_t>(callback);
+  send_wrs.back().send_flags = IBV_SEND_SIGNALED;
+
+  try {
+    qp_->post_send_when_ready(send_wrs.front(), batch_size,
+                              [this, callback](std::exception_ptr exception) {
+                                executor::destroy_callback(callback);
+                                exception_ = exception;
+                                h_.resume();
+                              });
+  } catch (...) {
+    // A failed post never reaches the signaled tail, so the callback is still
+    // ours to free.
+    executor::destroy_callback(callback);
+    throw;
+  }
+  next_entry_ = last;
+}
+
+void qp::gather_awaitable::on_batch_complete(struct ibv_wc const &wc,
+                                             size_t batch_length) {
+  wc_ = wc;
+  if (wc.status == IBV_WC_WR_FLUSH_ERR && chain_status_ != IBV_WC_SUCCESS) {
+    wc_.status = chain_status_;
+  }
+  if (wc.status == IBV_WC_SUCCESS) [[likely]] {
+    transferred_ += batch_length;
+    if (next_entry_ < entries_.size()) {
+      try {
+        post_batch();
+        return;
+      } catch (...) {
+        exception_ = std::current_exception();
+      }
+    }
+  }
+  RDMAPP_TRACE_WC(resume, wc);
+  h_.resume();
+}
+
+bool qp::gather_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
+  h_ = h;
+  try {
+    post_batch();
+  } catch (...) {
+    exception_ = std::current_exception();
+    return false;
+  }
+  return true;
+}
+
+size_t qp::gather_awaitable::await_resume() const {
+  if (exception_) [[unlikely]] {
+    std::rethrow_exception(exception_);
+  }
+  check_wc_status(wc_.status, "failed to read gather");
+  return transferred_;
+}
+
+qp::gather_awaitable qp::read_gather(std::vector<gather_entry> entries) {
+  return qp::gather_awaitable(this->shared_from_this(), std::move(entries));
+}
+
 void qp::destroy() {
   if (qp_ == nullptr) [[unlikely]] {
     return;
@@ -0,0 +1,163 @@
+#include "rdmapp/qp_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "rdmapp/detail/debug.h"
+
+namespace rdmapp {
+
+namespace {
+
+constexpr std::chrono::milliseconds kMinRetryDelay(100);
+constexpr std::chrono::milliseconds kMaxRetryDelay(5000);
+
+} // namespace
+
+bool qp_pool::key::operator==(key const &other) const {
+  return pd_ == other.pd_ && recv_cq_ == other.recv_cq_ &&
+         send_cq_ == other.send_cq_ && srq_ == other.srq_;
+}
+
+size_t qp_pool::key_hash::operator()(key const &k) const {
+  size_t hash = std::hash<pd *>()(k.pd_);
+  hash = hash * 31 + std::hash<cq *>()(k.recv_cq_);
+  hash = hash * 31 + std::hash<cq *>()(k.send_cq_);
+  hash = hash * 31 + std::hash<srq *>()(k.srq_);
+  return hash;
+}
+
+qp_pool::qp_pool(size_t target_size)
+    : target_size_(target_size), stopped_(false),
+      refiller_thread_(&qp_pool::refiller, this) {}
+
+void qp_pool::reserve(std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+                      std::shared_ptr<cq> send_cq, std::shared_ptr<srq> srq) {
+  {
+    std::lock_guard lock(mutex_);
+    pools_.try_emplace(key{pd.get(), recv_cq.get(), send_cq.get(), srq.get()},
+                       entry{pd, recv_cq, send_cq, srq, {}});
+  }
+  refill_cv_.notify_one();
+}
+
+std::shared_ptr<qp> qp_pool::acquire(std::shared_ptr<pd> pd,
+                                     std::shared_ptr<cq> recv_cq,
+                                     std::shared_ptr<cq> send_cq,
+                                     std::shared_ptr<srq> srq) {
+  std::shared_ptr<qp> qp_ptr;
+  {
+    std::lock_guard lock(mutex_);
+    auto [it, _] = pools_.try_emplace(
+        key{pd.get(), recv_cq.get(), send_cq.get(), srq.get()},
+        entry{pd, recv_cq, send_cq, srq, {}});
+    auto &qps = it->second.qps_;
+    if (!qps.empty()) {
+      qp_ptr = std::move(qps.front());
+      qps.pop_front();
+    }
+  }
+  refill_cv_.notify_one();
+  if (!qp_ptr) [[unlikely]] {
+    RDMAPP_LOG_DEBUG("qp pool empty, creating qp inline");
+    qp_ptr = std::make_shared<qp>(pd, recv_cq, send_cq, srq);
+  }
+  return qp_ptr;
+}
+
+size_t qp_pool::available(std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+                          std::shared_ptr<cq> send_cq,
+                          std::shared_ptr<srq> srq) {
+  std::lock_guard lock(mutex_);
+  auto it =
+      pools_.find(key{pd.get(), recv_cq.get(), send_cq.get(), srq.get()});
+  return it == pools_.end() ? 0 : it->second.qps_.size();
+}
+
+bool qp_pool::needs_refill() const {
+  for (auto const &[_, pool] : pools_) {
+    if (pool.qps_.size() < target_size_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void qp_pool::refiller() {
+  auto retry_delay = kMinRetryDelay;
+  std::unique_lock lock(mutex_);
+  while (true) {
+    refill_cv_.wait(lock, [this]() { return stopped_ || needs_refill(); });
+    if (stopped_) {
+      return;
+    }
+    // Iterators are not kept across unlocking as acquiring may rehash the
+    // map. References to entries stay valid since entries are never erased.
+    std::vector<entry *> pending;
+    for (auto &[_, pool] : pools_) {
+      if (pool.qps_.size() < target_size_) {
+        pending.push_back(&pool);
+      }
+    }
+    bool failed = false;
+    for (auto pool : pending) {
+      auto const missing = target_size_ - std::min(target_size_,
+                                                   pool->qps_.size());
+      auto pd = pool->pd_;
+      auto recv_cq = pool->recv_cq_;
+      auto send_cq = pool->send_cq_;
+      auto srq = pool->srq_;
+      // The Queue Pairs are created without holding the lock, so that
+      // acquiring from a pool never waits for the kernel.
+      lock.unlock();
+      std::vector<std::shared_ptr<qp>> created;
+      created.reserve(missing);
+      try {
+        for (size_t i = 0; i < missing && !stopped_; ++i) {
+          created.emplace_back(
+              std::make_shared<qp>(pd, recv_cq, send_cq, srq));
+        }
+      } catch (std::runtime_error &e) {
+        RDMAPP_LOG_ERROR("failed to refill qp pool, retrying in %lld ms: %s",
+                         static_cast<long long>(retry_delay.count()),
+                         e.what());
+        failed = true;
+      }
+      lock.lock();
+      for (auto &qp_ptr : created) {
+        pool->qps_.push_back(std::move(qp_ptr));
+      }
+      RDMAPP_LOG_TRACE("refilled qp pool with %zu qps", created.size());
+      if (failed) {
+        break;
+      }
+    }
+    if (failed) {
+      // Only the destructor stops the refiller. Resources may be freed later,
+      // so it keeps retrying without spinning on the error.
+      refill_cv_.wait_for(lock, retry_delay,
+                          [this]() { return stopped_.load(); });
+      retry_delay = std::min(retry_delay * 2, kMaxRetryDelay);
+    } else {
+      retry_delay = kMinRetryDelay;
+    }
+  }
+}
+
+qp_pool::~qp_pool() {
+  {
+    std::lock_guard lock(mutex_);
+    stopped_ = true;
+  }
+  refill_cv_.notify_one();
+  refiller_thread_.join();
+}
+
+} // namespace rdmapp
@@ -0,0 +1,234 @@
+#include "rdmapp/remote_sync.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+
+#include "rdmapp/executor.h"
+#include "rdmapp/lazy_task.h"
+#include "rdmapp/mr.h"
+#include "rdmapp/qp.h"
+
+#include "rdmapp/detail/timer_queue.h"
+
+namespace rdmapp {
+
+remote_atomic::remote_atomic(std::shared_ptr<qp> qp, remote_mr const &remote_mr)
+    : qp_(qp), remote_mr_(remote_mr), scratch_(std::make_unique<uint64_t>(0)),
+      scratch_mr_(std::make_shared<local_mr>(
+          qp_->pd_ptr()->reg_mr(scratch_.get(), sizeof(uint64_t)))) {
+  assert(reinterpret_cast<uintptr_t>(remote_mr_.addr()) % sizeof(uint64_t) ==
+         0);
+}
+
+remote_mr remote_atomic::word(size_t offset) {
+  assert(offset % sizeof(uint64_t) == 0);
+  assert(offset + sizeof(uint64_t) <= remote_mr_.length());
+  return remote_mr(static_cast<uint8_t *>(remote_mr_.addr()) + offset,
+                   sizeof(uint64_t), remote_mr_.rkey());
+}
+
+lazy_task<uint64_t> remote_atomic::fetch_and_add(size_t offset, uint64_t add) {
+  co_await qp_->fetch_and_add(word(offset), scratch_mr_, add);
+  uint64_t old_value = *scratch_;
+  co_return old_value;
+}
+
+lazy_task<uint64_t> remote_atomic::compare_and_swap(size_t offset,
+                                                    uint64_t compare,
+                                                    uint64_t swap) {
+  co_await qp_->compare_and_swap(word(offset), scratch_mr_, compare, swap);
+  uint64_t old_value = *scratch_;
+  co_return old_value;
+}
+
+lazy_task<uint64_t> remote_atomic::load(size_t offset) {
+  co_await qp_->read(word(offset), scratch_mr_);
+  uint64_t value = *scratch_;
+  co_return value;
+}
+
+backoff::backoff(std::chrono::nanoseconds min, std::chrono::nanoseconds max)
+    : min_(min), max_(max), current_(min) {}
+
+backoff::pause_awaitable::pause_awaitable(std::chrono::nanoseconds delay)
+    : delay_(delay) {}
+
+bool backoff::pause_awaitable::await_ready() const noexcept {
+  return delay_.count() <= 0;
+}
+
+void backoff::pause_awaitable::await_suspend(std::coroutine_handle<> h) {
+  auto executor = executor::current();
+  detail::timer_queue::instance().schedule(
+      detail::timer_queue::clock::now() + delay_, [executor, h]() {
+        if (executor == nullptr) {
+          h.resume();
+          return;
+        }
+        try {
+          executor->post([h]() { h.resume(); });
+        } catch (executor::queue_closed_error &) {
+          // The executor is shutting down and will resume nothing else of
+          // this coroutine either.
+        }
+      });
+}
+
+void backoff::pause_awaitable::await_resume() const noexcept {}
+
+backoff::pause_awaitable backoff::pause() {
+  auto delay = current_;
+  current_ = std::min(current_ * 2, max_);
+  return pause_awaitable(delay);
+}
+
+backoff::pause_awaitable backoff::pause(uint64_t factor) {
+  return pause_awaitable(
+      std::min<std::chrono::nanoseconds>(min_ * factor, max_));
+}
+
+void backoff::reset() { current_ = min_; }
+
+remote_spinlock::remote_spinlock(std::shared_ptr<qp> qp,
+                                 remote_mr const &remote_mr, size_t offset,
+                                 uint64_t owner_id)
+    : atomic_(qp, remote_mr), offset_(offset), owner_id_(owner_id) {
+  assert(owner_id_ != 0);
+}
+
+lazy_task<bool> remote_spinlock::try_lock() {
+  auto old_value = co_await atomic_.compare_and_swap(offset_, 0, owner_id_);
+  co_return old_value == 0;
+}
+
+lazy_task<void> remote_spinlock::lock() {
+  backoff delay;
+  while (true) {
+    auto old_value = co_await atomic_.compare_and_swap(offset_, 0, owner_id_);
+    if (old_value == 0) {
+      co_return;
+    }
+    co_await delay.pause();
+  }
+}
+
+lazy_task<void> remote_spinlock::unlock() {
+  auto old_value = co_await atomic_.compare_and_swap(offset_, owner_id_, 0);
+  assert(old_value == owner_id_);
+  (void)old_value;
+  co_return;
+}
+
+remote_ticket_lock::remote_ticket_lock(std::shared_ptr<qp> qp,
+                                       remote_mr const &remote_mr,
+                                       size_t offset)
+    : atomic_(qp, remote_mr), offset_(offset), ticket_(0) {}
+
+lazy_task<void> remote_ticket_lock::lock() {
+  ticket_ = co_await atomic_.fetch_and_add(offset_, 1);
+  backoff delay;
+  while (true) {
+    auto serving = co_await atomic_.load(offset_ + sizeof(uint64_t));
+    if (serving == ticket_) {
+      co_return;
+    }
+    co_await delay.pause(ticket_ - serving);
+  }
+}
+
+lazy_task<void> remote_ticket_lock::unlock() {
+  co_await atomic_.fetch_and_add(offset_ + sizeof(uint64_t), 1);
+  co_return;
+}
+
+remote_rw_lock::remote_rw_lock(std::shared_ptr<qp> qp,
+                               remote_mr const &remote_mr, size_t offset)
+    : atomic_(qp, remote_mr), offset_(offset) {}
+
+lazy_task<void> remote_rw_lock::lock_shared() {
+  backoff delay;
+  while (true) {
+    auto old_value = co_await atomic_.fetch_and_add(offset_, 1);
+    if ((old_value & kWriterBit) == 0) {
+      co_return;
+    }
+    // A writer holds the lock, so undo the increment and wait.
+    co_await atomic_.fetch_and_add(offset_, static_cast<uint64_t>(-1));
+    co_await delay.pause();
+  }
+}
+
+lazy_task<void> remote_rw_lock::unlock_shared() {
+  co_await atomic_.fetch_and_add(offset_, static_cast<uint64_t>(-1));
+  co_return;
+}
+
+lazy_task<void> remote_rw_lock::lock() {
+  backoff delay;
+  while (true) {
+    auto old_value = co_await atomic_.compare_and_swap(offset_, 0, kWriterBit);
+    if (old_value == 0) {
+      co_return;
+    }
+    co_await delay.pause();
+  }
+}
+
+lazy_task<void> remote_rw_lock::unlock() {
+  // Readers that raced with the writer may have bumped the count, so only the
+  // writer bit is cleared.
+  co_await atomic_.fetch_and_add(offset_, static_cast<uint64_t>(-kWriterBit));
+  co_return;
+}
+
+remote_sequence::remote_sequence(std::shared_ptr<qp> qp,
+                                 remote_mr const &remote_mr, size_t offset,
+                                 uint64_t block_size)
+    : atomic_(qp, remote_mr), offset_(offset),
+      block_size_(std::max<uint64_t>(block_size, 1)), next_(0), end_(0) {}
+
+lazy_task<uint64_t> remote_sequence::next() {
+  if (next_ == end_) {
+    next_ = co_await atomic_.fetch_and_add(offset_, block_size_);
+    end_ = next_ + block_size_;
+  }
+  uint64_t id = next_++;
+  co_return id;
+}
+
+remote_counter::remote_counter(std::shared_ptr<qp> qp,
+                               remote_mr const &remote_mr, size_t offset,
+                               uint64_t flush_threshold)
+    : atomic_(qp, remote_mr), offset_(offset),
+      flush_threshold_(flush_threshold), pending_(0), flushing_(false),
+      last_value_(0) {}
+
+bool remote_counter::add(uint64_t delta) {
+  return pending_.fetch_add(delta, std::memory_order_relaxed) + delta >=
+         flush_threshold_;
+}
+
+lazy_task<uint64_t> remote_counter::flush() {
+  if (flushing_.exchange(true, std::memory_order_acquire)) {
+    uint64_t value = last_value_.load(std::memory_order_relaxed);
+    co_return value;
+  }
+  auto delta = pending_.exchange(0, std::memory_order_relaxed);
+  try {
+    auto old_value = co_await atomic_.fetch_and_add(offset_, delta);
+    last_value_.store(old_value + delta, std::memory_order_relaxed);
+  } catch (...) {
+    pending_.fetch_add(delta, std::memory_order_relaxed);
+    flushing_.store(false, std::memory_order_release);
+    throw;
+  }
+  flushing_.store(false, std::memory_order_release);
+  uint64_t value = last_value_.load(std::memory_order_relaxed);
+  co_return value;
+}
+
+} // namespace rdmapp
@@ -0,0 +1,289 @@
+#include "rdmapp/stats.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/cq_poller.h"
+#include "rdmapp/qp.h"
+
+namespace rdmapp {
+
+size_t qp_stats::opcode_index(enum ibv_wr_opcode opcode) {
+  // The opcodes up to fetch-and-add are numbered from 0, the rest share the
+  // last entry.
+  if (opcode <= IBV_WR_ATOMIC_FETCH_AND_ADD) {
+    return opcode;
+  }
+  return kNrOpcodes - 1;
+}
+
+char const *qp_stats::opcode_name(size_t index) {
+  static char const *const names[kNrOpcodes] = {
+      "rdma_write",    "rdma_write_with_imm", "send",
+      "send_with_imm", "rdma_read",           "compare_and_swap",
+      "fetch_and_add", "other",
+  };
+  return index < kNrOpcodes ? names[index] : "other";
+}
+
+size_t cq_stats::opcode_index(enum ibv_wc_opcode opcode) {
+  switch (opcode) {
+  case IBV_WC_SEND:
+  case IBV_WC_RDMA_WRITE:
+  case IBV_WC_RDMA_READ:
+  case IBV_WC_COMP_SWAP:
+  case IBV_WC_FETCH_ADD:
+  case IBV_WC_BIND_MW:
+  case IBV_WC_LOCAL_INV:
+  case IBV_WC_TSO:
+    return opcode;
+  case IBV_WC_RECV:
+    return 8;
+  case IBV_WC_RECV_RDMA_WITH_IMM:
+    return 9;
+  default:
+    return kNrOpcodes - 1;
+  }
+}
+
+char const *cq_stats::opcode_name(size_t index) {
+  static char const *const names[kNrOpcodes] = {
+      "send",          "rdma_write", "rdma_read", "compare_and_swap",
+      "fetch_and_add", "bind_mw",    "local_inv", "tso",
+      "recv",          "recv_rdma_with_imm",      "other",
+  };
+  return index < kNrOpcodes ? names[index] : "other";
+}
+
+double cq_stats::batch_fill_ratio() const {
+  auto const nr_filled_polls = polls - std::min(empty_polls, polls);
+  if (nr_filled_polls == 0 || batch_size == 0) {
+    return 0;
+  }
+  return std::min(1.0, static_cast<double>(completions) /
+                           (static_cast<double>(nr_filled_polls) * batch_size));
+}
+
+void stats_registry::add(std::shared_ptr<qp> qp) {
+  std::lock_guard lock(mutex_);
+  qps_.emplace_back(qp);
+}
+
+void stats_registry::add(std::string name, std::shared_ptr<cq_poller> poller) {
+  std::lock_guard lock(mutex_);
+  pollers_.emplace_back(std::move(name), poller);
+}
+
+stats_snapshot stats_registry::snapshot() {
+  stats_snapshot snapshot;
+  std::lock_guard lock(mutex_);
+  std::erase_if(qps_, [&snapshot](auto const &weak) {
+    auto qp = weak.lock();
+    if (qp == nullptr) {
+      return true;
+    }
+    snapshot.qps.push_back(qp->stats());
+    return false;
+  });
+  std::erase_if(pollers_, [&snapshot](auto const &entry) {
+    auto poller = entry.second.lock();
+    if (poller == nullptr) {
+      return true;
+    }
+    snapshot.cqs.push_back(poller->stats());
+    snapshot.cqs.back().name = entry.first;
+    return false;
+  });
+  return snapshot;
+}
+
+namespace {
+
+/*
+ * Appends the Prometheus text format, one metric family at a time.
+ */
+class exposition {
+  std::string out_;
+
+public:
+  __attribute__((format(printf, 2, 3))) void append(char const *fmt, ...) {
+    va_list args;
+    va_list copy;
+    va_start(args, fmt);
+    va_copy(copy, args);
+    auto n = ::vsnprintf(nullptr, 0, fmt, args);
+    if (n > 0) {
+      auto const offset = out_.size();
+      out_.resize(offset + n + 1);
+      ::vsnprintf(&out_[offset], n + 1, fmt, copy);
+      out_.resize(offset + n);
+    }
+    va_end(copy);
+    va_end(args);
+  }
+
+  void family(char const *name, char const *type, char const *help) {
+    append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  }
+
+  std::string take() { return std::move(out_); }
+};
+
+std::string escape(std::string const &value) {
+  std::string escaped;
+  for (auto c : value) {
+    if (c == '\\' || c == '"') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (c == '\n') {
+      escaped.append("\\n");
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+} // namespace
+
+std::string stats_snapshot::to_prometheus() const {
+  exposition out;
+  using u64 = unsigned long long;
+
+  out.family("rdmapp_qp_sends_posted_total", "counter",
+             "Send work requests posted.");
+  for (auto const &qp : qps) {
+    for (size_t i = 0; i < qp_stats::kNrOpcodes; ++i) {
+      if (qp.sends_posted[i].count != 0) {
+        out.append("rdmapp_qp_sends_posted_total{qp=\"%u\",opcode=\"%s\"} "
+                   "%llu\n",
+                   qp.qp_num, qp_stats::opcode_name(i),
+                   u64(qp.sends_posted[i].count));
+      }
+    }
+  }
+  out.family("rdmapp_qp_send_bytes_posted_total", "counter",
+             "Payload bytes of the send work requests posted.");
+  for (auto const &qp : qps) {
+    for (size_t i = 0; i < qp_stats::kNrOpcodes; ++i) {
+      if (qp.sends_posted[i].count != 0) {
+        out.append("rdmapp_qp_send_bytes_posted_total"
+                   "{qp=\"%u\",opcode=\"%s\"} %llu\n",
+                   qp.qp_num, qp_stats::opcode_name(i),
+                   u64(qp.sends_posted[i].bytes));
+      }
+    }
+  }
+
+  struct qp_metric {
+    char const *name;
+    char const *type;
+    char const *help;
+    uint64_t qp_stats::*field;
+  };
+  static qp_metric const qp_metrics[] = {
+      {"rdmapp_qp_sends_completed_total", "counter",
+       "Send work requests that completed or failed.",
+       &qp_stats::sends_completed},
+      {"rdmapp_qp_sends_deferred_total", "counter",
+       "Send chains that waited for send queue slots.",
+       &qp_stats::sends_deferred},
+      {"rdmapp_qp_send_post_errors_total", "counter",
+       "Send chains that could not be posted.", &qp_stats::send_post_errors},
+      {"rdmapp_qp_recvs_posted_total", "counter",
+       "Receive work requests posted.", &qp_stats::recvs_posted},
+      {"rdmapp_qp_recv_post_errors_total", "counter",
+       "Receive work requests that could not be posted.",
+       &qp_stats::recv_post_errors},
+  };
+  for (auto const &metric : qp_metrics) {
+    out.family(metric.name, metric.type, metric.help);
+    for (auto const &qp : qps) {
+      out.append("%s{qp=\"%u\"} %llu\n", metric.name, qp.qp_num,
+                 u64(qp.*metric.field));
+    }
+  }
+  out.family("rdmapp_qp_outstanding_sends", "gauge",
+             "Send work requests posted and not yet completed.");
+  for (auto const &qp : qps) {
+    out.append("rdmapp_qp_outstanding_sends{qp=\"%u\"} %u\n", qp.qp_num,
+               qp.outstanding_sends);
+  }
+
+  std::vector<std::string> names;
+  for (size_t i = 0; i < cqs.size(); ++i) {
+    names.push_back(cqs[i].name.empty() ? std::to_string(i)
+                                        : escape(cqs[i].name));
+  }
+  out.family("rdmapp_cq_polls_total", "counter", "Polls of the CQ.");
+  for (size_t i = 0; i < cqs.size(); ++i) {
+    out.append("rdmapp_cq_polls_total{cq=\"%s\"} %llu\n", names[i].c_str(),
+               u64(cqs[i].polls));
+  }
+  out.family("rdmapp_cq_empty_polls_total", "counter",
+             "Polls that returned no completion.");
+  for (size_t i = 0; i < cqs.size(); ++i) {
+    out.append("rdmapp_cq_empty_polls_total{cq=\"%s\"} %llu\n",
+               names[i].c_str(), u64(cqs[i].empty_polls));
+  }
+  out.family("rdmapp_cq_completions_total", "counter",
+             "Successful completions.");
+  for (size_t i = 0; i < cqs.size(); ++i) {
+    for (size_t j = 0; j < cq_stats::kNrOpcodes; ++j) {
+      if (cqs[i].by_opcode[j].count != 0) {
+        out.append("rdmapp_cq_completions_total{cq=\"%s\",opcode=\"%s\"} "
+                   "%llu\n",
+                   names[i].c_str(), cq_stats::opcode_name(j),
+                   u64(cqs[i].by_opcode[j].count));
+      }
+    }
+  }
+  out.family("rdmapp_cq_completion_bytes_total", "counter",
+             "Bytes reported by successful completions.");
+  for (size_t i = 0; i < cqs.size(); ++i) {
+    for (size_t j = 0; j < cq_stats::kNrOpcodes; ++j) {
+      if (cqs[i].by_opcode[j].count != 0) {
+        out.append("rdmapp_cq_completion_bytes_total"
+                   "{cq=\"%s\",opcode=\"%s\"} %llu\n",
+                   names[i].c_str(), cq_stats::opcode_name(j),
+                   u64(cqs[i].by_opcode[j].bytes));
+      }
+    }
+  }
+  out.family("rdmapp_cq_errors_total", "counter",
+             "Failed completions by status.");
+  for (size_t i = 0; i < cqs.size(); ++i) {
+    for (size_t j = 1; j < cq_stats::kNrStatuses; ++j) {
+      if (cqs[i].errors[j] != 0) {
+        out.append("rdmapp_cq_errors_total{cq=\"%s\",status=\"%s\"} %llu\n",
+                   names[i].c_str(),
+                   ::ibv_wc_status_str(static_cast<enum ibv_wc_status>(j)),
+                   u64(cqs[i].errors[j]));
+      }
+    }
+  }
+  out.family("rdmapp_cq_batch_size", "gauge",
+             "Completions polled at most at a time.");
+  for (size_t i = 0; i < cqs.size(); ++i) {
+    out.append("rdmapp_cq_batch_size{cq=\"%s\"} %zu\n", names[i].c_str(),
+               cqs[i].batch_size);
+  }
+  out.family("rdmapp_cq_batch_fill_ratio", "gauge",
+             "Average share of the batch filled by non-empty polls.");
+  for (size_t i = 0; i < cqs.size(); ++i) {
+    out.append("rdmapp_cq_batch_fill_ratio{cq=\"%s\"} %.4f\n",
+               names[i].c_str(), cqs[i].batch_fill_ratio());
+  }
+  return out.take();
+}
+
+} // namespace rdmapp
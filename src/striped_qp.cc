@@ -0,0 +1,61 @@
+#include "rdmapp/striped_qp.h"
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/mr.h"
+#include "rdmapp/qp.h"
+
+namespace rdmapp {
+
+striped_qp::striped_qp(std::vector<std::shared_ptr<qp>> qps)
+    : qps_(std::move(qps)) {
+  if (qps_.empty()) {
+    throw std::invalid_argument("striped qp requires at least one qp");
+  }
+}
+
+size_t striped_qp::size() const { return qps_.size(); }
+
+std::shared_ptr<qp> striped_qp::at(size_t i) const { return qps_.at(i); }
+
+striped_qp::bulk_awaitable
+striped_qp::write_bulk(remote_mr const &remote_mr,
+                       std::shared_ptr<local_mr> local_mr, size_t chunk_size,
+                       size_t window) {
+  return write_bulk(std::vector<rdmapp::remote_mr>(qps_.size(), remote_mr),
+                    std::vector<std::shared_ptr<rdmapp::local_mr>>(
+                        qps_.size(), local_mr),
+                    chunk_size, window);
+}
+
+striped_qp::bulk_awaitable
+striped_qp::read_bulk(remote_mr const &remote_mr,
+                      std::shared_ptr<local_mr> local_mr, size_t chunk_size,
+                      size_t window) {
+  return read_bulk(std::vector<rdmapp::remote_mr>(qps_.size(), remote_mr),
+                   std::vector<std::shared_ptr<rdmapp::local_mr>>(qps_.size(),
+                                                                  local_mr),
+                   chunk_size, window);
+}
+
+striped_qp::bulk_awaitable
+striped_qp::write_bulk(std::vector<remote_mr> const &remote_mrs,
+                       std::vector<std::shared_ptr<local_mr>> const &local_mrs,
+                       size_t chunk_size, size_t window) {
+  return striped_qp::bulk_awaitable(qps_, local_mrs, IBV_WR_RDMA_WRITE,
+                                    remote_mrs, chunk_size, window);
+}
+
+striped_qp::bulk_awaitable
+striped_qp::read_bulk(std::vector<remote_mr> const &remote_mrs,
+                      std::vector<std::shared_ptr<local_mr>> const &local_mrs,
+                      size_t chunk_size, size_t window) {
+  return striped_qp::bulk_awaitable(qps_, local_mrs, IBV_WR_RDMA_READ,
+                                    remote_mrs, chunk_size, window);
+}
+
+} // namespace rdmapp
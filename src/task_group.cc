@@ -0,0 +1,155 @@
+#include "rdmapp/task_group.h"
+
+#include <cassert>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <stop_token>
+#include <utility>
+#include <vector>
+
+#include "rdmapp/detail/debug.h"
+
+namespace rdmapp {
+
+namespace detail {
+
+std::coroutine_handle<> group_task::promise_type::final_awaiter::await_suspend(
+    std::coroutine_handle<promise_type> h) noexcept {
+  auto group = h.promise().group_;
+  h.destroy();
+  return group->on_child_done();
+}
+
+void group_task::promise_type::unhandled_exception() noexcept {
+  group_->on_child_failed(std::current_exception());
+}
+
+} // namespace detail
+
+task_group::spawn_awaitable::spawn_awaitable(task_group &group,
+                                             detail::group_task child)
+    : group_(group), child_(std::move(child)), admitted_(false) {}
+
+bool task_group::spawn_awaitable::await_ready() const noexcept {
+  return false;
+}
+
+bool task_group::spawn_awaitable::await_suspend(
+    std::coroutine_handle<> h) noexcept {
+  std::lock_guard lock(group_.mutex_);
+  if (group_.stop_source_.stop_requested()) {
+    return false;
+  }
+  if (group_.active_ < group_.max_concurrency_) {
+    ++group_.active_;
+    admitted_ = true;
+    return false;
+  }
+  h_ = h;
+  group_.waiters_.push_back(this);
+  return true;
+}
+
+void task_group::spawn_awaitable::await_resume() {
+  if (admitted_) {
+    child_.start(&group_);
+  } else {
+    RDMAPP_LOG_TRACE("task group stopped, dropping child");
+  }
+}
+
+task_group::join_awaitable::join_awaitable(task_group &group)
+    : group_(group) {}
+
+bool task_group::join_awaitable::await_ready() const noexcept {
+  std::lock_guard lock(group_.mutex_);
+  return group_.active_ == 0 && group_.waiters_.empty();
+}
+
+bool task_group::join_awaitable::await_suspend(
+    std::coroutine_handle<> h) noexcept {
+  std::lock_guard lock(group_.mutex_);
+  if (group_.active_ == 0 && group_.waiters_.empty()) {
+    return false;
+  }
+  assert(!group_.joiner_);
+  group_.joiner_ = h;
+  return true;
+}
+
+void task_group::join_awaitable::await_resume() const {
+  std::lock_guard lock(group_.mutex_);
+  if (group_.exception_) {
+    std::rethrow_exception(group_.exception_);
+  }
+}
+
+task_group::task_group(size_t max_concurrency)
+    : max_concurrency_(max_concurrency), active_(0) {
+  if (max_concurrency == 0) {
+    throw std::invalid_argument("max_concurrency must be positive");
+  }
+}
+
+std::coroutine_handle<> task_group::on_child_done() noexcept {
+  std::unique_lock lock(mutex_);
+  --active_;
+  if (!waiters_.empty()) {
+    if (!stop_source_.stop_requested()) {
+      auto waiter = waiters_.front();
+      waiters_.pop_front();
+      ++active_;
+      waiter->admitted_ = true;
+      return waiter->h_;
+    }
+    std::vector<std::coroutine_handle<>> resumed;
+    for (auto waiter : waiters_) {
+      resumed.push_back(waiter->h_);
+    }
+    waiters_.clear();
+    if (active_ == 0 && joiner_) {
+      resumed.push_back(std::exchange(joiner_, {}));
+    }
+    lock.unlock();
+    for (size_t i = 0; i + 1 < resumed.size(); ++i) {
+      resumed[i].resume();
+    }
+    return resumed.back();
+  }
+  if (active_ == 0 && joiner_) {
+    return std::exchange(joiner_, {});
+  }
+  return std::noop_coroutine();
+}
+
+void task_group::on_child_failed(std::exception_ptr exception) noexcept {
+  {
+    std::lock_guard lock(mutex_);
+    if (!exception_) {
+      exception_ = exception;
+    }
+  }
+  stop_source_.request_stop();
+}
+
+task_group::join_awaitable task_group::join() { return join_awaitable(*this); }
+
+void task_group::request_stop() noexcept { stop_source_.request_stop(); }
+
+std::stop_token task_group::get_stop_token() const noexcept {
+  return stop_source_.get_token();
+}
+
+size_t task_group::active() const {
+  std::lock_guard lock(mutex_);
+  return active_;
+}
+
+task_group::~task_group() {
+  assert(active_ == 0 && waiters_.empty());
+}
+
+} // namespace rdmapp
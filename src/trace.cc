@@ -0,0 +1,28 @@
+#include "rdmapp/trace.h"
+
+#include <atomic>
+
+#include "rdmapp/detail/trace.h"
+
+namespace rdmapp {
+
+#if defined(RDMAPP_TRACE_HOOKS)
+
+namespace detail {
+
+std::atomic<trace_hook> current_trace_hook = nullptr;
+
+} // namespace detail
+
+bool set_trace_hook(trace_hook hook) noexcept {
+  detail::current_trace_hook.store(hook, std::memory_order_release);
+  return true;
+}
+
+#else
+
+bool set_trace_hook(trace_hook) noexcept { return false; }
+
+#endif
+
+} // namespace rdmapp
@@ -0,0 +1,431 @@
+#include "rdmapp/ud_qp.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <strings.h>
+#include <utility>
+#include <vector>
+
+#include <infiniband/verbs.h>
+
+#include "rdmapp/error.h"
+#include "rdmapp/executor.h"
+#include "rdmapp/pd.h"
+#include "rdmapp/qp.h"
+#include "rdmapp/srq.h"
+
+#include "rdmapp/detail/debug.h"
+#include "rdmapp/detail/trace.h"
+#include "rdmapp/detail/serdes.h"
+
+namespace rdmapp {
+
+address_handle::address_handle(std::shared_ptr<pd> pd, uint16_t lid,
+                               union ibv_gid gid)
+    : ah_(nullptr), pd_(pd) {
+  struct ibv_ah_attr ah_attr = {};
+  ::bzero(&ah_attr, sizeof(ah_attr));
+  ah_attr.is_global = 1;
+  ah_attr.grh.dgid = gid;
+  ah_attr.grh.sgid_index = pd_->device_->gid_index_;
+  ah_attr.grh.hop_limit = 16;
+  ah_attr.dlid = lid;
+  ah_attr.sl = 0;
+  ah_attr.src_path_bits = 0;
+  ah_attr.port_num = pd_->device_ptr()->port_num();
+  ah_ = ::ibv_create_ah(pd_->pd_, &ah_attr);
+  check_ptr(ah_, "failed to create ah");
+  RDMAPP_LOG_TRACE("created ah %p lid=%u", reinterpret_cast<void *>(ah_), lid);
+}
+
+address_handle::~address_handle() {
+  if (ah_ == nullptr) [[unlikely]] {
+    return;
+  }
+  if (auto rc = ::ibv_destroy_ah(ah_); rc != 0) [[unlikely]] {
+    RDMAPP_LOG_ERROR("failed to destroy ah %p: %s (rc=%d)",
+                     reinterpret_cast<void *>(ah_), strerror(rc), rc);
+  } else {
+    RDMAPP_LOG_TRACE("destroyed ah %p", reinterpret_cast<void *>(ah_));
+  }
+}
+
+std::vector<uint8_t> ud_qp::endpoint::serialize() const {
+  std::vector<uint8_t> buffer;
+  auto it = std::back_inserter(buffer);
+  detail::serialize(lid, it);
+  detail::serialize(qp_num, it);
+  detail::serialize(qkey, it);
+  detail::serialize(gid, it);
+  return buffer;
+}
+
+bool ud_qp::ah_key::operator==(ah_key const &other) const {
+  return lid == other.lid && qp_num == other.qp_num &&
+         ::memcmp(gid.raw, other.gid.raw, sizeof(gid.raw)) == 0;
+}
+
+size_t ud_qp::ah_key_hash::operator()(ah_key const &key) const {
+  auto h = std::hash<uint64_t>()(key.gid.global.subnet_prefix);
+  h ^= std::hash<uint64_t>()(key.gid.global.interface_id) + 0x9e3779b9 +
+       (h << 6) + (h >> 2);
+  h ^= std::hash<uint64_t>()((uint64_t(key.lid) << 32) | key.qp_num) +
+       0x9e3779b9 + (h << 6) + (h >> 2);
+  return h;
+}
+
+std::atomic<uint32_t> ud_qp::next_sq_psn = 1;
+
+ud_qp::ud_qp(std::shared_ptr<pd> pd, std::shared_ptr<cq> cq,
+             std::shared_ptr<srq> srq, size_t ah_cache_capacity, uint32_t qkey)
+    : ud_qp(pd, cq, cq, srq, ah_cache_capacity, qkey) {}
+
+ud_qp::ud_qp(std::shared_ptr<pd> pd, std::shared_ptr<cq> recv_cq,
+             std::shared_ptr<cq> send_cq, std::shared_ptr<srq> srq,
+             size_t ah_cache_capacity, uint32_t qkey)
+    : qp_(nullptr), raw_srq_(nullptr), qkey_(qkey), pd_(pd), recv_cq_(recv_cq),
+      send_cq_(send_cq), srq_(srq),
+      ah_cache_capacity_(std::max<size_t>(ah_cache_capacity, 1)) {
+  create();
+  init();
+  rtr();
+  rts();
+}
+
+void ud_qp::create() {
+  struct ibv_qp_init_attr qp_init_attr = {};
+  ::bzero(&qp_init_attr, sizeof(qp_init_attr));
+  qp_init_attr.qp_type = IBV_QPT_UD;
+  qp_init_attr.recv_cq = recv_cq_->cq_;
+  qp_init_attr.send_cq = send_cq_->cq_;
+  qp_init_attr.cap.max_recv_sge = 1;
+  qp_init_attr.cap.max_send_sge = 1;
+  qp_init_attr.cap.max_recv_wr = qp::kMaxRecvWr;
+  qp_init_attr.cap.max_send_wr = qp::kMaxSendWr;
+  qp_init_attr.sq_sig_all = 0;
+  qp_init_attr.qp_context = this;
+
+  if (srq_ != nullptr) {
+    qp_init_attr.srq = srq_->srq_;
+    raw_srq_ = srq_->srq_;
+  }
+
+  qp_ = ::ibv_create_qp(pd_->pd_, &qp_init_attr);
+  check_ptr(qp_, "failed to create ud qp");
+  sq_psn_ = next_sq_psn.fetch_add(1);
+  RDMAPP_LOG_TRACE("created ud qp %p lid=%u qpn=%u psn=%u",
+                   reinterpret_cast<void *>(qp_), pd_->device_ptr()->lid(),
+                   qp_->qp_num, sq_psn_);
+}
+
+void ud_qp::init() {
+  struct ibv_qp_attr qp_attr = {};
+  ::bzero(&qp_attr, sizeof(qp_attr));
+  qp_attr.qp_state = IBV_QPS_INIT;
+  qp_attr.pkey_index = 0;
+  qp_attr.port_num = pd_->device_ptr()->port_num();
+  qp_attr.qkey = qkey_;
+  try {
+    check_rc(::ibv_modify_qp(qp_, &qp_attr,
+                             IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT |
+                                 IBV_QP_QKEY),
+             "failed to transition ud qp to init state");
+  } catch (const std::exception &e) {
+    RDMAPP_LOG_ERROR("%s", e.what());
+    destroy();
+    throw;
+  }
+}
+
+void ud_qp::rtr() {
+  struct ibv_qp_attr qp_attr = {};
+  ::bzero(&qp_attr, sizeof(qp_attr));
+  qp_attr.qp_state = IBV_QPS_RTR;
+  try {
+    check_rc(::ibv_modify_qp(qp_, &qp_attr, IBV_QP_STATE),
+             "failed to transition ud qp to rtr state");
+  } catch (const std::exception &e) {
+    RDMAPP_LOG_ERROR("%s", e.what());
+    destroy();
+    throw;
+  }
+}
+
+void ud_qp::rts() {
+  struct ibv_qp_attr qp_attr = {};
+  ::bzero(&qp_attr, sizeof(qp_attr));
+  qp_attr.qp_state = IBV_QPS_RTS;
+  qp_attr.sq_psn = sq_psn_;
+  try {
+    check_rc(::ibv_modify_qp(qp_, &qp_attr, IBV_QP_STATE | IBV_QP_SQ_PSN),
+             "failed to transition ud qp to rts state");
+  } catch (const std::exception &e) {
+    RDMAPP_LOG_ERROR("%s", e.what());
+    destroy();
+    throw;
+  }
+}
+
+ud_qp::endpoint ud_qp::local_endpoint() const {
+  endpoint ep;
+  ep.lid = pd_->device_ptr()->lid();
+  ep.qp_num = qp_->qp_num;
+  ep.qkey = qkey_;
+  ep.gid = pd_->device_ptr()->gid();
+  return ep;
+}
+
+std::shared_ptr<pd> ud_qp::pd_ptr() const { return pd_; }
+
+std::shared_ptr<address_handle> ud_qp::get_ah(endpoint const &remote) {
+  ah_key key{remote.lid, remote.qp_num, remote.gid};
+  {
+    std::lock_guard lock(ah_mutex_);
+    if (auto it = ah_cache_.find(key); it != ah_cache_.end()) {
+      ah_lru_.splice(ah_lru_.begin(), ah_lru_, it->second);
+      return it->second->second;
+    }
+  }
+  // Creating an Address Handle may resolve the route in the kernel, so it is
+  // done without blocking the senders that hit the cache. Racing misses each
+  // create one and the first to be inserted wins.
+  auto ah = std::make_shared<address_handle>(pd_, remote.lid, remote.gid);
+  std::lock_guard lock(ah_mutex_);
+  if (auto it = ah_cache_.find(key); it != ah_cache_.end()) {
+    ah_lru_.splice(ah_lru_.begin(), ah_lru_, it->second);
+    return it->second->second;
+  }
+  if (ah_cache_.size() >= ah_cache_capacity_) {
+    // In-flight sends hold their own reference, so eviction only drops the
+    // cache's.
+    ah_cache_.erase(ah_lru_.back().first);
+    ah_lru_.pop_back();
+  }
+  ah_lru_.emplace_front(key, ah);
+  ah_cache_.emplace(key, ah_lru_.begin());
+  return ah;
+}
+
+std::optional<union ibv_gid> ud_qp::source_gid(struct ibv_wc const &wc,
+                                               void *grh) const {
+  // On RoCEv2 over IPv4 the GRH slot holds an IPv4 header in its last 20
+  // bytes instead, so the layout is left to libibverbs.
+  struct ibv_ah_attr ah_attr = {};
+  auto device = pd_->device_ptr();
+  if (::ibv_init_ah_from_wc(device->ctx_, device->port_num_,
+                            const_cast<struct ibv_wc *>(&wc),
+                            static_cast<struct ibv_grh *>(grh), &ah_attr) != 0)
+      [[unlikely]] {
+    RDMAPP_LOG_ERROR("failed to parse grh of datagram from qp %u: %s",
+                     wc.src_qp, ::strerror(errno));
+    return std::nullopt;
+  }
+  if (!ah_attr.is_global) {
+    return std::nullopt;
+  }
+  return ah_attr.grh.dgid;
+}
+
+void ud_qp::post_send(struct ibv_send_wr const &send_wr,
+                      struct ibv_send_wr *&bad_send_wr) {
+  RDMAPP_LOG_TRACE("post ud send wr_id=%p addr=%p",
+                   reinterpret_cast<void *>(send_wr.wr_id),
+                   reinterpret_cast<void *>(send_wr.sg_list->addr));
+  detail::trace_post_send(qp_->qp_num, &send_wr);
+  check_rc(::ibv_post_send(qp_, const_cast<struct ibv_send_wr *>(&send_wr),
+                           &bad_send_wr),
+           "failed to post ud send");
+}
+
+void ud_qp::post_recv(struct ibv_recv_wr const &recv_wr,
+                      struct ibv_recv_wr *&bad_recv_wr) const {
+  RDMAPP_LOG_TRACE("post ud recv wr_id=%p addr=%p",
+                   reinterpret_cast<void *>(recv_wr.wr_id),
+                   reinterpret_cast<void *>(recv_wr.sg_list->addr));
+  detail::trace_post_recv(qp_->qp_num, &recv_wr);
+  if (raw_srq_ != nullptr) {
+    check_rc(::ibv_post_srq_recv(raw_srq_,
+                                 const_cast<struct ibv_recv_wr *>(&recv_wr),
+                                 &bad_recv_wr),
+             "failed to post srq recv");
+  } else {
+    check_rc(::ibv_post_recv(qp_, const_cast<struct ibv_recv_wr *>(&recv_wr),
+                             &bad_recv_wr),
+             "failed to post ud recv");
+  }
+}
+
+ud_qp::send_awaitable::send_awaitable(std::shared_ptr<ud_qp> qp,
+                                      std::shared_ptr<local_mr> local_mr,
+                                      endpoint const &remote,
+                                      std::optional<uint32_t> imm)
+    : qp_(qp), local_mr_(local_mr), ah_(qp_->get_ah(remote)),
+      remote_qpn_(remote.qp_num), remote_qkey_(remote.qkey), imm_(imm),
+      wc_() {}
+
+ud_qp::send_awaitable::send_awaitable(std::shared_ptr<ud_qp> qp, void *buffer,
+                                      size_t length, endpoint const &remote,
+                                      std::optional<uint32_t> imm)
+    : send_awaitable(
+          qp, std::make_shared<local_mr>(qp->pd_->reg_mr(buffer, length)),
+          remote, imm) {}
+
+bool ud_qp::send_awaitable::await_ready() const noexcept { return false; }
+
+bool ud_qp::send_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
+  auto callback = executor::make_callback([h, this](struct ibv_wc const &wc) {
+    wc_ = wc;
+    RDMAPP_TRACE_WC(resume, wc);
+    h.resume();
+  });
+
+  struct ibv_sge send_sge = {};
+  send_sge.addr = reinterpret_cast<uint64_t>(local_mr_->addr());
+  send_sge.length = local_mr_->length();
+  send_sge.lkey = local_mr_->lkey();
+
+  struct ibv_send_wr send_wr = {};
+  struct ibv_send_wr *bad_send_wr = nullptr;
+  send_wr.opcode = imm_.has_value() ? IBV_WR_SEND_WITH_IMM : IBV_WR_SEND;
+  send_wr.next = nullptr;
+  send_wr.num_sge = 1;
+  send_wr.wr_id = reinterpret_cast<uint64_t>(callback);
+  send_wr.send_flags = IBV_SEND_SIGNALED;
+  send_wr.sg_list = &send_sge;
+  send_wr.wr.ud.ah = ah_->ah_;
+  send_wr.wr.ud.remote_qpn = remote_qpn_;
+  send_wr.wr.ud.remote_qkey = remote_qkey_;
+  if (imm_.has_value()) {
+    send_wr.imm_data = imm_.value();
+  }
+
+  try {
+    qp_->post_send(send_wr, bad_send_wr);
+  } catch (std::runtime_error &e) {
+    exception_ = std::make_exception_ptr(e);
+    executor::destroy_callback(callback);
+    return false;
+  }
+  return true;
+}
+
+uint32_t ud_qp::send_awaitable::await_resume() const {
+  if (exception_) [[unlikely]] {
+    std::rethrow_exception(exception_);
+  }
+  check_wc_status(wc_.status, "failed to send datagram");
+  return local_mr_->length();
+}
+
+ud_qp::recv_awaitable::recv_awaitable(std::shared_ptr<ud_qp> qp,
+                                      std::shared_ptr<local_mr> local_mr)
+    : qp_(qp), local_mr_(local_mr), wc_() {
+  assert(local_mr_->length() > kGrhBytes);
+}
+
+ud_qp::recv_awaitable::recv_awaitable(std::shared_ptr<ud_qp> qp, void *buffer,
+                                      size_t length)
+    : recv_awaitable(
+          qp, std::make_shared<local_mr>(qp->pd_->reg_mr(buffer, length))) {}
+
+bool ud_qp::recv_awaitable::await_ready() const noexcept { return false; }
+
+bool ud_qp::recv_awaitable::await_suspend(std::coroutine_handle<> h) noexcept {
+  auto callback = executor::make_callback([h, this](struct ibv_wc const &wc) {
+    wc_ = wc;
+    RDMAPP_TRACE_WC(resume, wc);
+    h.resume();
+  });
+
+  struct ibv_sge recv_sge = {};
+  recv_sge.addr = reinterpret_cast<uint64_t>(local_mr_->addr());
+  recv_sge.length = local_mr_->length();
+  recv_sge.lkey = local_mr_->lkey();
+
+  struct ibv_recv_wr recv_wr = {};
+  struct ibv_recv_wr *bad_recv_wr = nullptr;
+  recv_wr.next = nullptr;
+  recv_wr.num_sge = 1;
+  recv_wr.wr_id = reinterpret_cast<uint64_t>(callback);
+  recv_wr.sg_list = &recv_sge;
+
+  try {
+    qp_->post_recv(recv_wr, bad_recv_wr);
+  } catch (std::runtime_error &e) {
+    exception_ = std::make_exception_ptr(e);
+    executor::destroy_callback(callback);
+    return false;
+  }
+  return true;
+}
+
+ud_qp::recv_result ud_qp::recv_awaitable::await_resume() const {
+  if (exception_) [[unlikely]] {
+    std::rethrow_exception(exception_);
+  }
+  check_wc_status(wc_.status, "failed to recv datagram");
+  recv_result result;
+  result.length = wc_.byte_len - kGrhBytes;
+  result.src_qp = wc_.src_qp;
+  result.slid = wc_.slid;
+  if (wc_.wc_flags & IBV_WC_GRH) {
+    result.sgid = qp_->source_gid(wc_, local_mr_->addr());
+  }
+  if (wc_.wc_flags & IBV_WC_WITH_IMM) {
+    result.imm = wc_.imm_data;
+  }
+  return result;
+}
+
+ud_qp::send_awaitable ud_qp::send(endpoint const &remote,
+                                  std::shared_ptr<local_mr> local_mr) {
+  return ud_qp::send_awaitable(this->shared_from_this(), local_mr, remote,
+                               std::nullopt);
+}
+
+ud_qp::send_awaitable ud_qp::send_with_imm(endpoint const &remote,
+                                           std::shared_ptr<local_mr> local_mr,
+                                           uint32_t imm) {
+  return ud_qp::send_awaitable(this->shared_from_this(), local_mr, remote, imm);
+}
+
+ud_qp::send_awaitable ud_qp::send(endpoint const &remote, void *buffer,
+                                  size_t length) {
+  return ud_qp::send_awaitable(this->shared_from_this(), buffer, length, remote,
+                               std::nullopt);
+}
+
+ud_qp::recv_awaitable ud_qp::recv(std::shared_ptr<local_mr> local_mr) {
+  return ud_qp::recv_awaitable(this->shared_from_this(), local_mr);
+}
+
+ud_qp::recv_awaitable ud_qp::recv(void *buffer, size_t length) {
+  return ud_qp::recv_awaitable(this->shared_from_this(), buffer, length);
+}
+
+void ud_qp::destroy() {
+  if (qp_ == nullptr) [[unlikely]] {
+    return;
+  }
+
+  if (auto rc = ::ibv_destroy_qp(qp_); rc != 0) [[unlikely]] {
+    RDMAPP_LOG_ERROR("failed to destroy ud qp %p: %s",
+                     reinterpret_cast<void *>(qp_), strerror(errno));
+  } else {
+    RDMAPP_LOG_TRACE("destroyed ud qp %p", reinterpret_cast<void *>(qp_));
+  }
+  qp_ = nullptr;
+}
+
+ud_qp::~ud_qp() { destroy(); }
+
+} // namespace rdmapp
@@ -0,0 +1,52 @@
+#include "mock_test.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <rdmapp/rdmapp.h>
+
+/*
+ * Sends beyond the send queue depth wait for free slots. They must still
+ * reach the peer in the order they were issued.
+ */
+
+static rdmapp::lazy_task<void> send_seq(std::shared_ptr<rdmapp::qp> qp,
+                                        uint32_t *seq) {
+  co_await qp->send(seq, sizeof(*seq));
+}
+
+static rdmapp::lazy_task<void> recv_all(std::shared_ptr<rdmapp::qp> sender,
+                                        std::shared_ptr<rdmapp::qp> qp,
+                                        uint32_t nr_sends) {
+  // The sends were started first. Nothing was received yet, so they pile up
+  // behind the first window.
+  RDMAPP_TEST_CHECK(sender->stats().sends_deferred > 0);
+  for (uint32_t i = 0; i < nr_sends; ++i) {
+    uint32_t seq = 0;
+    co_await qp->recv(&seq, sizeof(seq));
+    RDMAPP_TEST_CHECK(seq == i);
+  }
+}
+
+int main() {
+  constexpr uint32_t kNrSends = 4 * rdmapp::qp::kMaxSendWr;
+  rdmapp::test::loopback net;
+  auto sender = net.make_qp();
+  auto receiver = net.make_qp();
+  rdmapp::test::connect(*sender, *receiver);
+
+  std::vector<uint32_t> seqs(kNrSends);
+  std::vector<rdmapp::lazy_task<void>> sends;
+  for (uint32_t i = 0; i < kNrSends; ++i) {
+    seqs[i] = i;
+    sends.push_back(send_seq(sender, &seqs[i]));
+  }
+  rdmapp::sync_wait(rdmapp::when_all(rdmapp::when_all(std::move(sends)),
+                                     recv_all(sender, receiver, kNrSends)));
+  auto const stats = sender->stats();
+  RDMAPP_TEST_CHECK(stats.sends_deferred ==
+                    kNrSends - rdmapp::qp::kMaxSendWr);
+  RDMAPP_TEST_CHECK(stats.sends_completed == kNrSends);
+  return 0;
+}
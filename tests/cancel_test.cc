@@ -0,0 +1,61 @@
+#include "mock_test.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <utility>
+
+#include <rdmapp/rdmapp.h>
+
+/*
+ * Cancelling an operation moves its Queue Pair to the error state. The
+ * operation reports the cancellation, and every other outstanding one is
+ * flushed back through its completion.
+ */
+
+using recv_result =
+    rdmapp::result<std::pair<uint32_t, std::optional<uint32_t>>>;
+
+static rdmapp::lazy_task<recv_result> recv(std::shared_ptr<rdmapp::qp> qp,
+                                           uint32_t *buffer) {
+  co_return co_await qp->recv(buffer, sizeof(*buffer)).as_result();
+}
+
+static rdmapp::lazy_task<recv_result>
+recv_until_stopped(std::shared_ptr<rdmapp::qp> qp, uint32_t *buffer,
+                   std::stop_token stop_token) {
+  co_return co_await qp->recv(buffer, sizeof(*buffer))
+      .with_stop_token(stop_token)
+      .as_result();
+}
+
+// Started after both receives are posted, as `when_all` starts its children in
+// order.
+static rdmapp::lazy_task<bool> stop(std::stop_source &stop_source) {
+  co_return stop_source.request_stop();
+}
+
+int main() {
+  rdmapp::test::loopback net;
+  auto a = net.make_qp();
+  auto b = net.make_qp();
+  rdmapp::test::connect(*a, *b);
+
+  std::stop_source stop_source;
+  uint32_t first = 0;
+  uint32_t second = 0;
+  auto [cancelled_result, flushed_result, stopped] = rdmapp::sync_wait(
+      rdmapp::when_all(recv_until_stopped(a, &first, stop_source.get_token()),
+                       recv(a, &second), stop(stop_source)));
+  RDMAPP_TEST_CHECK(stopped);
+  RDMAPP_TEST_CHECK(!cancelled_result.has_value());
+  RDMAPP_TEST_CHECK(cancelled_result.error().kind ==
+                    rdmapp::op_error::kind::cancelled);
+
+  RDMAPP_TEST_CHECK(!flushed_result.has_value());
+  RDMAPP_TEST_CHECK(flushed_result.error().kind ==
+                    rdmapp::op_error::kind::completion);
+  RDMAPP_TEST_CHECK(flushed_result.error().status == IBV_WC_WR_FLUSH_ERR);
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include "mock_test.h"
+#include "qp_transmission.h"
+#include "socket/channel.h"
+#include "socket/event_loop.h"
+#include "socket/tcp_connection.h"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+#include <rdmapp/rdmapp.h>
+
+#include <rdmapp/detail/serdes.h>
+
+/*
+ * The Queue Pair handshake over a socket pair: a peer of the same wire version
+ * is accepted and its capabilities are negotiated, a peer of another version
+ * is rejected before anything else is read.
+ */
+
+static rdmapp::lazy_task<void>
+send_raw(std::vector<uint8_t> const &data,
+         rdmapp::socket::tcp_connection &connection) {
+  auto n = co_await connection.send(data.data(), data.size());
+  RDMAPP_TEST_CHECK(n == static_cast<int>(data.size()));
+}
+
+int main() {
+  rdmapp::test::loopback net;
+  auto local = net.make_qp();
+  auto remote = net.make_qp();
+
+  int fds[2];
+  RDMAPP_TEST_CHECK(::socketpair(AF_UNIX,
+                                 SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+                                 fds) == 0);
+  auto loop = rdmapp::socket::event_loop::new_loop();
+  auto looper = std::thread([loop]() { loop->loop(); });
+  auto sender = std::make_shared<rdmapp::socket::tcp_connection>(
+      std::make_shared<rdmapp::socket::channel>(fds[0], loop));
+  auto receiver = std::make_shared<rdmapp::socket::tcp_connection>(
+      std::make_shared<rdmapp::socket::channel>(fds[1], loop));
+
+  rdmapp::sync_wait(rdmapp::send_qp(*remote, *sender));
+  auto peer = rdmapp::sync_wait(rdmapp::recv_qp(*receiver));
+  RDMAPP_TEST_CHECK(peer.header.version ==
+                    rdmapp::deserialized_qp::kWireVersion);
+  RDMAPP_TEST_CHECK(peer.header.qp_num == remote->qp_num());
+  auto const advertised = remote->local_capabilities();
+  RDMAPP_TEST_CHECK(peer.capabilities.path_mtu == advertised.path_mtu);
+  RDMAPP_TEST_CHECK(peer.capabilities.max_recv_wr == advertised.max_recv_wr);
+  RDMAPP_TEST_CHECK(peer.capabilities.features == advertised.features);
+
+  local->negotiate(peer.capabilities);
+  local->rtr(peer.header.lid, peer.header.qp_num, peer.header.sq_psn,
+             peer.header.gid);
+  local->rts();
+  auto const &negotiated = local->capabilities();
+  RDMAPP_TEST_CHECK(negotiated.max_recv_wr == advertised.max_recv_wr);
+  RDMAPP_TEST_CHECK(negotiated.features ==
+                    (local->local_capabilities().features &
+                     advertised.features));
+
+  // A peer speaking another version is rejected.
+  auto data = remote->serialize();
+  rdmapp::detail::pack(std::span<uint8_t, sizeof(uint16_t)>(data.data(),
+                                                            sizeof(uint16_t)),
+                       static_cast<uint16_t>(
+                           rdmapp::deserialized_qp::kWireVersion + 1));
+  rdmapp::sync_wait(send_raw(data, *sender));
+  bool rejected = false;
+  try {
+    rdmapp::sync_wait(rdmapp::recv_qp(*receiver));
+  } catch (std::runtime_error &) {
+    rejected = true;
+  }
+  RDMAPP_TEST_CHECK(rejected);
+
+  loop->close();
+  looper.join();
+  sender.reset();
+  receiver.reset();
+  return 0;
+}
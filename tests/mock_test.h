@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#include <rdmapp/rdmapp.h>
+
+/*
+ * Helpers shared by the tests that run over the mock verbs backend. Every
+ * Queue Pair lives in this process, so they are connected by exchanging
+ * their serialized headers directly.
+ */
+
+#define RDMAPP_TEST_CHECK(cond)                                                \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,    \
+                   #cond);                                                     \
+      std::exit(EXIT_FAILURE);                                                 \
+    }                                                                          \
+  } while (0)
+
+namespace rdmapp {
+namespace test {
+
+/**
+ * @brief A device with one Completion Queue polled by a single executor
+ * thread, so that callbacks run in completion order.
+ *
+ */
+struct loopback {
+  std::shared_ptr<device> device_ = std::make_shared<device>(0, 1);
+  std::shared_ptr<pd> pd_ = std::make_shared<pd>(device_);
+  std::shared_ptr<cq> cq_ = std::make_shared<cq>(device_, 1024);
+  std::shared_ptr<executor> executor_ = std::make_shared<executor>(1);
+  std::shared_ptr<cq_poller> poller_ =
+      std::make_shared<cq_poller>(cq_, executor_);
+
+  std::shared_ptr<qp> make_qp() { return std::make_shared<qp>(pd_, cq_); }
+};
+
+/**
+ * @brief Move `local` to RTS towards `remote` with the header `remote`
+ * serializes.
+ *
+ */
+inline void connect_to(qp &local, qp const &remote) {
+  auto const data = remote.serialize();
+  auto const header = deserialized_qp::deserialize(data.data()).header;
+  local.rtr(header.lid, header.qp_num, header.sq_psn, header.gid);
+  local.rts();
+}
+
+inline void connect(qp &a, qp &b) {
+  connect_to(a, b);
+  connect_to(b, a);
+}
+
+} // namespace test
+} // namespace rdmapp